@@ -11,6 +11,8 @@
 #include <stddef.h>
 #include "ddriver.h"
 #include "errno.h"
+#include <pthread.h>
+#include <time.h>
 #include "types.h"
 #include "stdint.h"
 
@@ -19,23 +21,178 @@
 *******************************************************************************/
 char* 			     newfs_get_fname(const char* path);
 int 			     newfs_calc_lvl(const char * path);
-int 			     newfs_driver_read(int offset, uint8_t *out_content, int size);
-int 			     newfs_driver_write(int offset, uint8_t *in_content, int size);
+int 			     newfs_driver_read(off_t offset, uint8_t *out_content, int size);
+int 			     newfs_driver_write(off_t offset, uint8_t *in_content, int size);
+int 			     newfs_driver_write_meta(off_t offset, uint8_t *in_content, int size);
+int 			     newfs_alloc_datab(struct newfs_inode * inode);
 
 
 int 	  		     newfs_mount(struct custom_options options);
 int 	   		     newfs_umount();
+int 	   		     newfs_sync_fs();
+int 	   		     newfs_mkfs(struct custom_options options);
 
 int 			     newfs_alloc_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry);
 int 			     newfs_drop_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry);
 struct newfs_inode*  newfs_alloc_inode(struct newfs_dentry * dentry);
+void 			     newfs_mark_inode_dirty(struct newfs_inode* inode, int flags);
 int 			     newfs_sync_inode(struct newfs_inode * inode);
 int 			     newfs_drop_inode(struct newfs_inode * inode);
+boolean 		     newfs_inode_opened(struct newfs_inode* inode);
+void 			     newfs_inode_get(struct newfs_inode* inode, int n);
+void 			     newfs_inode_put(struct newfs_inode* inode, int n);
+struct newfs_inode*  newfs_ino_inode(int ino);
 struct newfs_inode*  newfs_read_inode(struct newfs_dentry * dentry, int ino);
 struct newfs_dentry* newfs_get_dentry(struct newfs_inode * inode, int dir);
+void 			     newfs_fill_stat(struct newfs_inode* inode, struct stat* st);
 
 struct newfs_dentry* newfs_lookup(const char * path, boolean * is_find, boolean* is_root);
 
+/******************************************************************************
+* SECTION: newfs_ops.c
+*******************************************************************************/
+int 			     newfs_do_getattr(struct newfs_inode* inode, struct stat* st);
+int 			     newfs_do_create(struct newfs_dentry* parent, const char* fname, NFS_FILE_TYPE ftype,
+                                     const char* path, struct newfs_dentry** created);
+int 			     newfs_do_write(struct newfs_inode* inode, const char* buf, size_t size, off_t offset);
+int 			     newfs_do_read(struct newfs_inode* inode, char* buf, size_t size, off_t offset);
+int 			     newfs_do_write_buf(struct newfs_inode* inode, struct fuse_bufvec* buf, off_t offset);
+int 			     newfs_do_read_buf(struct newfs_inode* inode, struct fuse_bufvec** bufp, size_t size,
+                                       off_t offset);
+void 			     newfs_do_read_buf_end(struct newfs_inode* inode, struct fuse_bufvec* bufv);
+int 			     newfs_do_truncate(struct newfs_inode* inode, off_t offset);
+int 			     newfs_do_unlink(struct newfs_dentry* dentry);
+int 			     newfs_rmdir_rs(struct newfs_inode* inode);
+int 			     newfs_do_rename(struct newfs_dentry* dentry, struct newfs_dentry* new_parent,
+                                     const char* fname);
+int 			     newfs_do_open(struct newfs_inode* inode, struct fuse_file_info* fi);
+int 			     newfs_do_release(struct fuse_file_info* fi);
+int 			     newfs_do_readdir(struct newfs_inode* inode, void* buf, fuse_fill_dir_t filler,
+                                      off_t offset, struct file_info* f_info);
+
+/******************************************************************************
+* SECTION: newfs_ll.c
+*******************************************************************************/
+int 			     newfs_ll_main(struct fuse_args* args);
+
+/******************************************************************************
+* SECTION: newfs_bdev.c
+*******************************************************************************/
+int 			     newfs_bdev_open(struct custom_options options);
+int 			     newfs_bdev_read(off_t offset, uint8_t* buf, int size);
+int 			     newfs_bdev_write(off_t offset, const uint8_t* buf, int size);
+int 			     newfs_bdev_submit(struct newfs_bdev_req* reqs, int n);
+int 			     newfs_bdev_sync();
+int 			     newfs_bdev_ioctl(unsigned long cmd, void* ret);
+void 			     newfs_bdev_close();
+
+/******************************************************************************
+* SECTION: newfs_cache.c
+*******************************************************************************/
+int 			     newfs_cache_init(int nr_blks);
+int 			     newfs_cache_get_range(int blk, int n, struct newfs_buf** bufs,
+                                           int nofill_from, int nofill_to);
+int 			     newfs_cache_prefetch(int blk, int n);
+void 			     newfs_cache_mark_dirty(struct newfs_buf* buf);
+void 			     newfs_cache_mark_meta(struct newfs_buf* buf);
+void 			     newfs_cache_lock();
+void 			     newfs_cache_unlock();
+int 			     newfs_dev_read(int blk, uint8_t* data, int n);
+int 			     newfs_dev_write(int blk, const uint8_t* data, int n);
+int 			     newfs_dev_write_bufs(int blk, struct newfs_buf** bufs, int n);
+int 			     newfs_cache_read_through_vec(const int* blks, uint8_t** data, int n);
+int 			     newfs_cache_write_through_vec(const int* blks, uint8_t** data, int n);
+int 			     newfs_cache_overflow();
+int 			     newfs_cache_flush();
+int 			     newfs_cache_destroy();
+
+/******************************************************************************
+* SECTION: newfs_journal.c
+*******************************************************************************/
+int 			     newfs_journal_capacity();
+int 			     newfs_journal_commit(struct newfs_buf** bufs, int n);
+int 			     newfs_journal_clean();
+int 			     newfs_journal_replay();
+void 			     newfs_journal_note_op();
+
+/******************************************************************************
+* SECTION: newfs_bitmap.c
+*******************************************************************************/
+int 			     newfs_bitmap_init(struct newfs_bitmap* bm, int nbits, int group_bits);
+void 			     newfs_bitmap_destroy(struct newfs_bitmap* bm);
+int 			     newfs_bitmap_alloc_group(struct newfs_bitmap* bm, int goal);
+int 			     newfs_bitmap_alloc_at(struct newfs_bitmap* bm, int bit);
+int 			     newfs_bitmap_alloc_run(struct newfs_bitmap* bm, int goal, int unit, int run);
+void 			     newfs_bitmap_free(struct newfs_bitmap* bm, int bit);
+boolean 		     newfs_bitmap_test(const struct newfs_bitmap* bm, int bit);
+
+/******************************************************************************
+* SECTION: newfs_extent.c
+*******************************************************************************/
+int 			     newfs_bmap(struct newfs_inode* inode, int lblk);
+int 			     newfs_extent_append(struct newfs_inode* inode);
+void 			     newfs_extent_truncate(struct newfs_inode* inode, int nblks);
+void 			     newfs_extent_free_all(struct newfs_inode* inode);
+int 			     newfs_extent_load(struct newfs_inode* inode, struct newfs_inode_d* inode_d);
+int 			     newfs_extent_sync(struct newfs_inode* inode, struct newfs_inode_d* inode_d);
+
+/******************************************************************************
+* SECTION: newfs_page.c
+*******************************************************************************/
+int 			     newfs_page_reserve(struct newfs_inode* inode, int nblks);
+int 			     newfs_page_load(struct newfs_inode* inode, int from, int to);
+boolean 		     newfs_page_cached(struct newfs_inode* inode, off_t offset, int size);
+int 			     newfs_page_read(struct newfs_inode* inode, off_t offset, uint8_t* out_content, int size);
+int 			     newfs_page_read_buf(struct newfs_inode* inode, off_t offset, int size, struct fuse_bufvec** bufp);
+int 			     newfs_page_write(struct newfs_inode* inode, off_t offset, const uint8_t* in_content, int size);
+int 			     newfs_page_write_buf(struct newfs_inode* inode, off_t offset, struct fuse_bufvec* buf);
+int 			     newfs_page_zero(struct newfs_inode* inode, off_t from, off_t to);
+void 			     newfs_page_clean(struct newfs_inode* inode, int lblk);
+void 			     newfs_page_release_clean(struct newfs_inode* inode);
+void 			     newfs_page_truncate(struct newfs_inode* inode, int nblks);
+void 			     newfs_page_free_all(struct newfs_inode* inode);
+
+/******************************************************************************
+* SECTION: newfs_lock.c
+*******************************************************************************/
+void 			     newfs_lock_init();
+void 			     newfs_lock_destroy();
+struct newfs_inode*  newfs_dentry_inode(struct newfs_dentry* dentry);
+
+/******************************************************************************
+* SECTION: newfs_writeback.c
+*******************************************************************************/
+int 			     newfs_writeback_start(struct custom_options options);
+void 			     newfs_writeback_stop();
+void 			     newfs_writeback_kick();
+void 			     newfs_writeback_account(int dirty_pages);
+int 			     newfs_writeback_balance();
+
+/******************************************************************************
+* SECTION: newfs_dir.c
+*******************************************************************************/
+uint32_t 		     newfs_dir_hash(const char* name, int len);
+int 			     newfs_dir_insert(struct newfs_inode* inode, struct newfs_dentry* dentry);
+void 			     newfs_dir_remove(struct newfs_inode* inode, struct newfs_dentry* dentry);
+struct newfs_dentry* newfs_dir_find(struct newfs_inode* inode, const char* name, int len);
+void 			     newfs_dir_free(struct newfs_inode* inode);
+boolean 		     newfs_dir_rec_ok(const struct newfs_dentry_d* rec, int off);
+int 			     newfs_dir_add_rec(struct newfs_inode* inode, struct newfs_dentry* dentry);
+int 			     newfs_dir_del_rec(struct newfs_inode* inode, struct newfs_dentry* dentry);
+
+/******************************************************************************
+* SECTION: newfs_dcache.c
+*******************************************************************************/
+struct newfs_dentry* newfs_dcache_lookup(const char* path, boolean* negative);
+void 			     newfs_dcache_insert(const char* path, struct newfs_dentry* dentry, boolean negative);
+void 			     newfs_dcache_invalidate(const char* path, boolean subtree);
+void 			     newfs_dcache_destroy();
+
+/******************************************************************************
+* SECTION: newfs_fsck.c
+*******************************************************************************/
+int 			     newfs_fsck(struct custom_options options, struct newfs_fsck_report* report);
+
 /******************************************************************************
 * SECTION: newfs.c
 *******************************************************************************/
@@ -43,11 +200,14 @@ void* 			   newfs_init(struct fuse_conn_info *);
 void  			   newfs_destroy(void *);
 int   			   newfs_mkdir(const char *, mode_t);
 int   			   newfs_getattr(const char *, struct stat *);
+int   			   newfs_fgetattr(const char *, struct stat *, struct fuse_file_info *);
 int   			   newfs_readdir(const char *, void *, fuse_fill_dir_t, off_t,
 						                struct fuse_file_info *);
 int   			   newfs_mknod(const char *, mode_t, dev_t);
 int   			   newfs_write(const char *, const char *, size_t, off_t,
 					                  struct fuse_file_info *);
+int   			   newfs_write_buf(const char *, struct fuse_bufvec *, off_t,
+					                      struct fuse_file_info *);
 int   			   newfs_read(const char *, char *, size_t, off_t,
 					                 struct fuse_file_info *);
 int   			   newfs_access(const char *, int);
@@ -56,9 +216,13 @@ int   			   newfs_rmdir(const char *);
 int   			   newfs_rename(const char *, const char *);
 int   			   newfs_utimens(const char *, const struct timespec tv[2]);
 int   			   newfs_truncate(const char *, off_t);
+int   			   newfs_ftruncate(const char *, off_t, struct fuse_file_info *);
 			
 int   			   newfs_open(const char *, struct fuse_file_info *);
 int   			   newfs_opendir(const char *, struct fuse_file_info *);
+int   			   newfs_fsync(const char *, int, struct fuse_file_info *);
+int   			   newfs_flush(const char *, struct fuse_file_info *);
+int   			   newfs_release(const char *, struct fuse_file_info *);
 
 /******************************************************************************
 * SECTION: newfs_debug.c
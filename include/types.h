@@ -20,16 +20,18 @@ typedef enum nfs_file_type {
 #define FALSE                   0
 #define UINT32_BITS             32
 #define UINT8_BITS              8
+#define UINT64_BITS             64
 
-#define NFS_MAGIC_NUM           0x52415459  
+#define NFS_MAGIC_NUM           0x52415460  /* 布局变化时递增 */
 #define NFS_SUPER_OFS           0
 #define NFS_ROOT_INO            0
 
 #define NFS_SUPER_BLKS          1 
-#define NFS_MAP_INODE_BLKS      1 // bitmap
-#define NFS_MAP_DATA_BLKS       1 // bitmap
-#define NFS_INODE_BLKS          585 
-#define NFS_DATA_BLKS           3508 
+#define NFS_INODE_RATIO         4096    /* 默认每多少字节设备空间一个inode */
+#define NFS_SMALL_DEV_SZ        (32 * 1024 * 1024) /* 小于此大小的设备使用NFS_SMALL_INODE_RATIO */
+#define NFS_SMALL_INODE_RATIO   768     /* 小设备以小文件为主，4MiB设备约5000个inode */
+#define NFS_INODE_MAX           (1 << 22) /* 未指定--inode_ratio时inode数的上限，inode_table常驻内存 */
+#define NFS_MIN_BLKS            64      /* 可格式化的最少块数 */
 
 #define NFS_ERROR_NONE          0
 #define NFS_ERROR_ACCESS        EACCES
@@ -41,10 +43,18 @@ typedef enum nfs_file_type {
 #define NFS_ERROR_UNSUPPORTED   ENXIO
 #define NFS_ERROR_IO            EIO     /* Error Input/Output */
 #define NFS_ERROR_INVAL         EINVAL  /* Invalid Args */
+#define NFS_ERROR_NOTDIR        ENOTDIR
+#define NFS_ERROR_NOTEMPTY      ENOTEMPTY
+#define NFS_ERROR_FBIG          EFBIG
+#define NFS_ERROR_NAMETOOLONG   ENAMETOOLONG
 
 #define NFS_MAX_FILE_NAME       128
+#define NFS_MAX_BLK_SZ          32768   /* 目录项记录长度为16位，块不能更大 */
+#define NFS_DENTRY_ALIGN        4       /* 目录项记录按4字节对齐 */
 #define NFS_INODE_PER_FILE      1
-#define NFS_DATA_PER_FILE       6
+#define NFS_INLINE_EXTENTS      4       /* inode内直接存放的extent数 */
+#define NFS_DEFAULT_INODE_SZ    128     /* 磁盘inode默认大小，2的幂，不小于sizeof(struct newfs_inode_d) */
+#define NFS_INLINE_MAX          512     /* 不超过此大小的普通文件可占用同一inode块中随后的inode槽内联存放 */
 #define NFS_DEFAULT_PERM        0777
 
 #define NFS_IOC_MAGIC           'S'
@@ -52,6 +62,47 @@ typedef enum nfs_file_type {
 
 #define NFS_FLAG_BUF_DIRTY      0x1
 #define NFS_FLAG_BUF_OCCUPY     0x2
+#define NFS_FLAG_BUF_META       0x4     /* 元数据块，写回原位前需先写入日志 */
+
+#define NFS_PAGE_VALID          0x1     /* 页内容有效 */
+#define NFS_PAGE_DIRTY          0x2     /* 页需写回 */
+#define NFS_INODE_DIRTY         0x1     /* inode本身（大小、extent等）、文件数据或目录块需写回 */
+
+#define NFS_CACHE_BLKS          256     /* 块缓存容量（块数） */
+#define NFS_CACHE_HASH_SZ       512     /* 块缓存哈希桶数，必须为2的幂 */
+#define NFS_CACHE_BATCH         32      /* 单次合并读的最大块数 */
+
+#define NFS_JOURNAL_BLKS        128     /* 日志区块数，位于数据区之后 */
+#define NFS_JOURNAL_MAGIC       0x4A524E4C
+#define NFS_JOURNAL_BATCH       64      /* 累计多少个修改操作后组提交一次 */
+
+#define NFS_FLUSH_AGE           5       /* 默认脏数据最长停留秒数 */
+#define NFS_DIRTY_LIMIT_KB      512     /* 默认脏页上限（KB），超过时唤醒回写线程，超过两倍时写者同步回写 */
+#define NFS_PAGE_CACHE_MAX      1024    /* 已分配页数超过该值时，回写后释放干净页 */
+
+#define NFS_DIR_HASH_MIN        16      /* 目录哈希索引初始桶数，必须为2的幂 */
+
+#define NFS_DCACHE_SZ           1024    /* 路径缓存最大项数 */
+#define NFS_DCACHE_NEG_SZ       256     /* 路径缓存中负项（不存在的路径）最大项数 */
+#define NFS_DCACHE_HASH_SZ      2048    /* 路径缓存哈希桶数，必须为2的幂 */
+
+#define NFS_LL_TIMEOUT          1.0     /* 低层前端默认的目录项与属性缓存秒数 */
+
+#define NFS_BDEV_IO_SZ          512     /* 非ddriver后端的IO单位 */
+#define NFS_BDEV_DEFAULT_KB     4096    /* 新建镜像文件与内存盘的默认大小（KB） */
+#define NFS_BDEV_QD             64      /* uring后端默认队列深度 */
+#ifdef NFS_WITH_DDRIVER
+#define NFS_BDEV_DEFAULT        "ddriver"
+#else
+#define NFS_BDEV_DEFAULT        "file"
+#endif
+
+#define NFS_FSCK_CHUNK          64      /* fsck扫描inode表时每次读入的块数 */
+#define NFS_FSCK_MAX_THREADS    64
+#define NFS_FSCK_MAX_MSGS       100     /* 最多打印的不一致条数，其余只计数 */
+#define NFS_FSCK_TYPE_MASK      0x3     /* fsck的inode状态：低2位为ftype + 1，0表示未分配或损坏 */
+#define NFS_FSCK_REACHED        0x4     /* 已被某个目录项引用 */
+#define NFS_FSCK_INLINE         0x8     /* 前一个内联文件的内容占用的槽 */
 
 /******************************************************************************
 * SECTION: Macro Function
@@ -64,10 +115,39 @@ typedef enum nfs_file_type {
 #define NFS_ROUND_DOWN(value, round)    ((value) % (round) == 0 ? (value) : ((value) / (round)) * (round))
 #define NFS_ROUND_UP(value, round)      ((value) % (round) == 0 ? (value) : ((value) / (round) + 1) * (round))
 
-#define NFS_BLKS_SZ(blks)               ((blks) * NFS_BLK_SZ())
+#define NFS_INODE_SZ()                  (super.sz_inode)
+#define NFS_INODE_PER_BLK()             (NFS_BLK_SZ() / NFS_INODE_SZ())
+
+#define NFS_BLKS_SZ(blks)               ((off_t)(blks) * NFS_BLK_SZ())
 #define NFS_ASSIGN_FNAME(psfs_dentry, _fname)  memcpy(psfs_dentry->fname, _fname, strlen(_fname))
-#define NFS_INO_OFS(ino)                (super.ino_offset  + ino * NFS_BLK_SZ())
-#define NFS_DATA_OFS(ino)               (super.data_offset + ino * NFS_BLK_SZ())
+#define NFS_GROUP_OFS(g)                (super.group_offset + NFS_BLKS_SZ((off_t)(g) * super.group_blks))
+#define NFS_IMAP_OFS(g)                 (NFS_GROUP_OFS(g))
+#define NFS_DMAP_OFS(g)                 (NFS_GROUP_OFS(g) + NFS_BLKS_SZ(super.ino_map_blks))
+#define NFS_ITABLE_OFS(g)               (NFS_DMAP_OFS(g) + NFS_BLKS_SZ(super.data_map_blks))
+#define NFS_GDATA_OFS(g)                (NFS_ITABLE_OFS(g) + NFS_BLKS_SZ(super.ino_blks))
+#define NFS_INO_GROUP(ino)              ((int)(ino) / super.ino_per_group)
+#define NFS_DATA_GROUP(blk)             ((blk) / super.data_per_group)
+#define NFS_INO_OFS(ino)                (NFS_ITABLE_OFS(NFS_INO_GROUP(ino)) \
+                                         + (off_t)((int)(ino) % super.ino_per_group) * NFS_INODE_SZ())
+#define NFS_INO_BLK(ino)                ((int)(NFS_INO_OFS(ino) / NFS_BLK_SZ()))
+#define NFS_INLINE_SZ()                 (NFS_INODE_SZ() - (int)sizeof(struct newfs_inode_d))
+#define NFS_INLINE_OFS(ino)             (NFS_INO_OFS(ino) + (off_t)sizeof(struct newfs_inode_d))
+#define NFS_INLINE_SPAN(size)           ((int)(((size) + (int64_t)sizeof(struct newfs_inode_d) \
+                                         + NFS_INODE_SZ() - 1) / NFS_INODE_SZ()))
+#define NFS_INLINE_CAP(span)            ((span) * NFS_INODE_SZ() - (int)sizeof(struct newfs_inode_d))
+#define NFS_INLINE_FITS(ino, size)      ((size) <= NFS_INLINE_SZ() || ((size) <= NFS_INLINE_MAX && \
+                                         (int)(ino) % NFS_INODE_PER_BLK() + NFS_INLINE_SPAN(size) \
+                                         <= NFS_INODE_PER_BLK()))
+#define NFS_DATA_OFS(blk)               (NFS_GDATA_OFS(NFS_DATA_GROUP(blk)) \
+                                         + NFS_BLKS_SZ((blk) % super.data_per_group))
+#define NFS_CACHE_HASH(blk)             ((blk) & (NFS_CACHE_HASH_SZ - 1))
+
+#define NFS_DENTRY_REC_LEN(name_len)    NFS_ROUND_UP((int)sizeof(struct newfs_dentry_d) + (name_len), \
+                                                     NFS_DENTRY_ALIGN)
+#define NFS_DENTRY_NAME(rec)            ((char *)(rec) + sizeof(struct newfs_dentry_d))
+#define NFS_JOURNAL_CAP()               ((int)((NFS_BLK_SZ() - sizeof(struct newfs_journal_d)) / sizeof(int)))
+#define NFS_EXTENT_PER_BLK()            ((NFS_BLK_SZ() - sizeof(struct newfs_extent_blk_d)) \
+                                         / sizeof(struct newfs_extent))
 
 #define NFS_IS_DIR(pinode)              (pinode->dentry->ftype == NFS_DIR)
 #define NFS_IS_REG(pinode)              (pinode->dentry->ftype == NFS_REG_FILE)
@@ -80,8 +160,61 @@ struct newfs_dentry;
 struct newfs_inode;
 struct newfs_super;
 
+struct newfs_extent {
+    int start;              // 起始数据块号
+    int len;                // 连续块数
+};
+
+struct newfs_bitmap {
+    uint8_t* bits;          // 位图内容，各块组的位图依次拼接
+    int      nbits;         // 有效位数
+    int      nfree;         // 空闲位数
+    int      group_bits;    // 每个块组的位数
+    int*     group_free;    // 各块组的空闲位数
+    int*     group_hint;    // 各块组内next-fit的起点（组内位号）
+    uint8_t* group_dirty;   // 各块组的位图自上次同步以来是否修改过
+};
+
 struct custom_options {
 	const char*        device;
+	int                inode_size;      /* 格式化时使用的inode大小，0表示默认 */
+	int                block_size;      /* 格式化时使用的块大小（字节），0表示2倍IO单位 */
+	int                inode_ratio;     /* 格式化时每多少字节设备空间一个inode，0表示默认 */
+	int                flush_age;       /* 脏数据最长停留秒数，0表示默认 */
+	int                dirty_limit;     /* 脏页超过多少KB时立即回写，0表示默认 */
+	int                lowlevel;        /* 使用低层FUSE前端（newfs_ll.c） */
+	double             entry_timeout;   /* 低层前端：内核缓存目录项的秒数 */
+	double             attr_timeout;    /* 低层前端：内核缓存属性的秒数 */
+	const char*        backend;         /* 块设备后端：ddriver/file/mmap/mem/uring，NULL表示默认 */
+	int                dev_size;        /* 新建镜像文件与内存盘的大小（KB），0表示默认 */
+	int                queue_depth;     /* uring后端同时在途的请求数，0表示默认 */
+	int                format;          /* 挂载时无条件重新格式化（mkfs.newfs） */
+	int                fsck_threads;    /* fsck.newfs的检查线程数，0表示CPU数 */
+};
+
+struct newfs_fsck_report {
+    int      inodes;        /* 可达的inode数 */
+    int      dirs;          /* 可达的目录数 */
+    int64_t  blocks;        /* 可达inode占用的数据块数（含溢出extent块） */
+    int      errors;        /* 发现的不一致数 */
+};
+
+struct newfs_bdev_req {
+    off_t    offset;        /* 设备上的字节偏移，按IO单位对齐 */
+    uint8_t* buf;
+    int      size;          /* 字节数，按IO单位对齐 */
+    boolean  write;
+};
+
+struct newfs_bdev_ops {
+    const char* name;
+    int  (*open)(const char* path, off_t dev_size, off_t* sz_disk, int* sz_io);
+    int  (*read)(off_t offset, uint8_t* buf, int size);
+    int  (*write)(off_t offset, const uint8_t* buf, int size);
+    int  (*submit)(struct newfs_bdev_req* reqs, int n); /* 可为NULL，逐个read/write */
+    int  (*sync)();                                  /* 可为NULL */
+    int  (*ioctl)(unsigned long cmd, void* ret);     /* 为NULL时统计由newfs_bdev.c维护 */
+    void (*close)();
 };
 
 struct newfs_super {
@@ -89,36 +222,57 @@ struct newfs_super {
     int      fd;
 
     /* 块信息 */
-    int sz_io;
-    int sz_disk;
-    int sz_blks;
-    int sz_usage;
-
-    /* 磁盘布局分区信息 */
-    int sb_offset;          // 超级块于磁盘中的偏移，通常默认为0
-    int sb_blks;            // 超级块于磁盘中的块数，通常默认为1
-
-    int max_ino;
-    int ino_map_offset;     // 索引节点位图于磁盘中的偏移
-    int ino_map_blks;       // 索引节点位图于磁盘中的块数
-    uint8_t* ino_map;
-
-    int data_map_offset;    // data位图于磁盘中的偏移
-    int data_map_blks;      // data位图于磁盘中的块数
-    uint8_t* data_map;
-
-    int ino_offset;         // 索引节点于磁盘中的偏移
-    int ino_blks;           // 索引节点于磁盘中的块数
-
-    int data_offset;        // data于磁盘中的偏移
-    int data_blks;          // data于磁盘中的块数
+    int   sz_io;
+    off_t sz_disk;
+    int   sz_blks;
+    off_t sz_usage;
+    int   sz_inode;         // 磁盘inode大小，一个块存放NFS_INODE_PER_BLK()个inode
+
+    /* 磁盘布局分区信息，偏移为字节数，块号与块数为int（块大小4KiB时可寻址8TiB） */
+    off_t sb_offset;        // 超级块于磁盘中的偏移，通常默认为0
+    int   sb_blks;          // 超级块于磁盘中的块数，通常默认为1
+
+    int   max_ino;
+    off_t gd_offset;        // 块组描述符表于磁盘中的偏移
+    int   gd_blks;          // 块组描述符表的块数
+    off_t group_offset;     // 第0个块组于磁盘中的偏移
+    int   groups;           // 块组数
+    int   group_blks;       // 每个块组的块数（最后一组的数据区可以较短）
+    int   ino_per_group;    // 每组的inode数
+    int   data_per_group;   // 每组的数据块数
+
+    int   ino_map_blks;     // 每组索引节点位图的块数
+    struct newfs_bitmap ino_map;
+
+    int   data_map_blks;    // 每组data位图的块数
+    struct newfs_bitmap data_map;
+
+    int   ino_blks;         // 每组索引节点的块数
+    int   data_blks;        // data块总数
+
+    off_t journal_offset;   // 日志区于磁盘中的偏移
+    int   journal_blks;     // 日志区块数，0表示不使用日志
+    uint32_t journal_seq;   // 下一个日志事务序号
+    int   journal_ops;      // 上次提交以来的修改操作数
 
     /* 支持的限制 */
-    int ino_max;            // 最大支持inode数
-    int file_max;           // 支持文件最大大小
+    int   ino_max;          // 最大支持inode数
+    off_t file_max;         // 支持文件最大大小
 
     /* 根目录索引 */
     struct newfs_dentry* root_dentry; // 根目录dentry
+    struct newfs_inode*  dirty_inodes; // 自上次同步以来修改过的inode链表
+    struct newfs_inode** inode_table;  // 按inode号索引已载入的inode，ino_max项
+
+    /* 并发与回写 */
+    pthread_rwlock_t fs_lock;   // 普通操作共享持有，删除/改名/同步独占持有，见newfs_lock.c
+    pthread_mutex_t  alloc_lock; // 保护inode位图与数据位图
+    pthread_mutex_t  dirty_lock; // 保护dirty_inodes、inode->dirty、journal_ops与下面的计数
+    int     dirty_pages;     // 脏页数
+    int     page_cnt;        // 已分配的页数
+    time_t  dirty_since;     // 最早一次未回写修改的时间，0表示没有
+    int     flush_age;       // 秒
+    int     dirty_limit;     // 字节
 
     /* 其他信息 */
     boolean is_mounted;
@@ -127,16 +281,32 @@ struct newfs_super {
 struct newfs_inode {
     uint32_t ino;
 
-    int size;  /* 文件已占用空间 */
+    off_t size;  /* 文件已占用空间 */
     int link;  // link number: 1
     // NFS_FILE_TYPE ftype;
     struct newfs_dentry* dentry; /* 指向该inode的dentry */
     struct newfs_dentry* dentrys; /* 所有目录项 */
     int data_blk_cnt; // data block used 
     int dir_cnt; 
-    int block_pointer[6]; // to the data blocks
-    int dirty[6]; // to the data blocks
-    u_int8_t* data;
+    struct newfs_extent* extents; // 按逻辑块顺序排列，覆盖[0, data_blk_cnt)
+    int ext_cnt;
+    int ext_cap;
+    int* ext_blks;    // 存放溢出extent的数据块
+    int ext_blk_cnt;
+    uint8_t** pages;      // 稀疏页数组，每个逻辑块一页，未载入为NULL
+    uint8_t*  page_flags; // 每页的NFS_PAGE_VALID / NFS_PAGE_DIRTY
+    int page_cap;         // pages与page_flags的容量（块数）
+    boolean inline_data;  // 文件内容存放在磁盘inode记录末尾（NFS_INLINE_OFS），不占数据块
+    int inline_span;      // 占用的inode槽数：自ino起连续、位于同一inode块，内联内容可延伸到其后的槽
+    struct newfs_dentry** dir_hash; // 目录：子项名哈希索引，按需分配
+    int dir_hash_sz;      // dir_hash桶数，2的幂
+    uint32_t dir_gen;     // 目录：删除子项时递增，使readdir游标失效
+    int ref_cnt;          // 打开的句柄数与低层前端内核lookup引用数之和，原子增减
+    boolean orphan;       // 已删除但仍被引用，引用数归零时释放
+    pthread_rwlock_t lock; // 保护本inode的大小、数据页、extent与目录项，见newfs_lock.c
+    int dirty;            // NFS_INODE_DIRTY，非0时在super.dirty_inodes中
+    struct newfs_inode* dirty_prev;
+    struct newfs_inode* dirty_next;
 };
 
 struct newfs_dentry {
@@ -149,6 +319,9 @@ struct newfs_dentry {
     struct newfs_dentry *parent;  // father
     struct newfs_dentry *brother; // brother
     struct newfs_inode  *inode;   // related inode
+    uint32_t             hash;    // 文件名哈希，插入父目录索引时计算
+    struct newfs_dentry *hash_next; // 父目录哈希索引中的链
+    int                  d_off;   // 磁盘记录在父目录数据中的字节偏移，-1表示没有记录
 };
 
 static inline struct newfs_dentry* new_dentry(char * fname, NFS_FILE_TYPE ftype) {
@@ -160,13 +333,37 @@ static inline struct newfs_dentry* new_dentry(char * fname, NFS_FILE_TYPE ftype)
     dentry->inode   = NULL;
     dentry->parent  = NULL;
     dentry->brother = NULL;    
+    dentry->d_off   = -1;
     return dentry;
 }
 
+struct newfs_buf {
+    int      blk;                   /* 缓存的磁盘块号 */
+    flag16   flag;                  /* NFS_FLAG_BUF_DIRTY / NFS_FLAG_BUF_OCCUPY */
+    uint8_t* data;                  /* NFS_BLK_SZ()大小的块数据 */
+
+    struct newfs_buf* hash_next;    /* 哈希链 */
+    struct newfs_buf* lru_prev;     /* LRU链，表头为最近使用 */
+    struct newfs_buf* lru_next;
+};
+
+struct newfs_dcache_entry {
+    char*                path;          /* 完整路径 */
+    uint32_t             hash;
+    struct newfs_dentry* dentry;        /* 负项时为所在目录的dentry */
+    boolean              negative;      /* 路径不存在 */
+
+    struct newfs_dcache_entry* hash_next;
+    struct newfs_dcache_entry* lru_prev;  /* LRU链，表头为最近使用 */
+    struct newfs_dcache_entry* lru_next;
+};
+
 struct file_info {
     struct newfs_inode* inode;  // Pointer to the inode for this file
     off_t offset;               // Current offset in the file (for read/write operations)
     int open_flags;             // Flags to track how the file was opened 
+    struct newfs_dentry* cursor; // readdir: next dentry to emit at offset, NULL to rescan
+    uint32_t cursor_gen;        // readdir: inode->dir_gen when cursor was saved
 };
 
 /******************************************************************************
@@ -175,43 +372,77 @@ struct file_info {
 struct newfs_super_d {
     uint32_t magic;
     int      fd;
+    int      sz_blks;           // 块大小，挂载时按此重建块缓存
+
+    /* 磁盘布局分区信息，偏移均为64位字节数 */
+    int64_t  gd_offset;         // 块组描述符表于磁盘中的偏移
+    int      gd_blks;           // 块组描述符表的块数
+    int64_t  group_offset;      // 第0个块组于磁盘中的偏移
+    int      groups;            // 块组数
+    int      group_blks;        // 每个块组的块数
+    int      ino_per_group;     // 每组的inode数
+    int      data_per_group;    // 每组的数据块数
+
+    int      ino_map_blks;      // 每组索引节点位图的块数
+    int      data_map_blks;     // 每组data位图的块数
+    int      ino_blks;          // 每组索引节点的块数
+    int      data_blks;         // data块总数
 
-    /* 磁盘布局分区信息 */
-    int ino_map_offset;     // 索引节点位图于磁盘中的偏移
-    int ino_map_blks;       // 索引节点位图于磁盘中的块数
-
-    int data_map_offset;    // data位图于磁盘中的偏移
-    int data_map_blks;      // data位图于磁盘中的块数
+    /* 支持的限制 */
+    int      ino_max;           // 最大支持inode数
+    int64_t  file_max;          // 支持文件最大大小
 
-    int ino_offset;         // 索引节点于磁盘中的偏移
-    int ino_blks;           // 索引节点于磁盘中的块数
+    int64_t  sz_usage;
+    int      sz_inode;          // 磁盘inode大小
 
-    int data_offset;        // data于磁盘中的偏移
-    int data_blks;          // data于磁盘中的块数
+    int64_t  journal_offset;    // 日志区于磁盘中的偏移
+    int      journal_blks;      // 日志区块数
+};
 
-    /* 支持的限制 */
-    int ino_max;            // 最大支持inode数
-    int file_max;           // 支持文件最大大小
+struct newfs_group_d {      /* 块组描述符，依次存于描述符表 */
+    int      free_inodes;   // 空闲inode数
+    int      free_blks;     // 空闲数据块数
+};
 
-    int sz_usage;
+struct newfs_journal_d {    /* 日志区第0块：描述最近一次提交的事务 */
+    uint32_t magic;
+    uint32_t seq;
+    int      cnt;           // 事务中的块数，0表示日志已全部写回原位
+    uint32_t csum;          // 覆盖seq、cnt、blks[]及全部块内容
+    /* int blks[cnt] follow: 各块的原位块号，内容依次存于日志区第1..cnt块 */
 };
 
 struct newfs_inode_d {
     uint32_t ino;
 
-    int size;  /* 文件已占用空间 */
+    int64_t size;  /* 文件已占用空间 */
     int link;  // link number: 1
     NFS_FILE_TYPE ftype;
     int data_blk_cnt; // data block used 
     int dir_cnt; 
-    int block_pointer[6]; // to the data blocks
+    int ext_cnt;      // extent总数
+    struct newfs_extent extents[NFS_INLINE_EXTENTS]; 
+    int ext_blk;      // 第一个溢出extent块，-1表示没有
+    /* 普通文件data_blk_cnt为0且NFS_INLINE_FITS(ino, size)时，内容紧随其后存放在inode记录中，
+       超过NFS_INLINE_SZ()时延伸到其后NFS_INLINE_SPAN(size) - 1个inode槽，这些槽在位图中一并占用 */
 };
 
+struct newfs_extent_blk_d {
+    int next;         // 下一个溢出extent块，-1表示没有
+    int cnt;          // 本块中的extent数
+    /* struct newfs_extent extents[]; */
+};
+
+/*
+ * 目录数据由变长记录组成，每块内的记录首尾相接覆盖整块：
+ * 删除时并入块内前一条记录（块首记录置为空闲），插入时拆分剩余空间足够的记录
+ */
 struct newfs_dentry_d {
-    // in disk
-    char     fname[NFS_MAX_FILE_NAME];
     uint32_t ino;
-    NFS_FILE_TYPE ftype;
+    uint16_t rec_len;   // 本记录的长度（到下一条记录），含名字、对齐与空闲空间
+    uint8_t  name_len;  // 0表示空闲记录
+    uint8_t  ftype;
+    /* char name[name_len]; 不以'\0'结尾 */
 };
 
 #endif /* _TYPES_H_ */
\ No newline at end of file
@@ -12,32 +12,132 @@
 *******************************************************************************/
 static const struct fuse_opt option_spec[] = {		/* 用于FUSE文件系统解析参数 */
 	OPTION("--device=%s", device),
+	OPTION("--inode_size=%d", inode_size),
+	OPTION("--block_size=%d", block_size),
+	OPTION("--inode_ratio=%d", inode_ratio),
+	OPTION("--flush_age=%d", flush_age),
+	OPTION("--dirty_limit=%d", dirty_limit),
+	OPTION("--lowlevel", lowlevel),
+	OPTION("--entry_timeout=%lf", entry_timeout),
+	OPTION("--attr_timeout=%lf", attr_timeout),
+	OPTION("--backend=%s", backend),
+	OPTION("--dev_size=%d", dev_size),
+	OPTION("--queue_depth=%d", queue_depth),
 	FUSE_OPT_END
 };
 
 struct custom_options newfs_options;			 /* 全局选项 */
 struct newfs_super super; 
 /******************************************************************************
+* SECTION: FUSE操作加锁
+*
+* 加锁模型见newfs_lock.c：删除、改名、fsync独占super.fs_lock，其余操作共享持有，
+* 操作实现内部再按需持有inode->lock；修改操作释放fs_lock后按需组提交
+*******************************************************************************/
+#define NFS_SHARED(ret, call)	do {						\
+	pthread_rwlock_rdlock(&super.fs_lock);					\
+	ret = (call);								\
+	pthread_rwlock_unlock(&super.fs_lock);					\
+} while (0)
+
+#define NFS_EXCL(ret, call)	do {						\
+	pthread_rwlock_wrlock(&super.fs_lock);					\
+	ret = (call);								\
+	pthread_rwlock_unlock(&super.fs_lock);					\
+} while (0)
+
+static int newfs_balanced(int ret) {
+	if (ret >= 0 && newfs_writeback_balance() != NFS_ERROR_NONE) {
+		return -NFS_ERROR_IO;
+	}
+	return ret;
+}
+static int newfs_locked_mkdir(const char* path, mode_t mode) {
+	int ret; NFS_SHARED(ret, newfs_mkdir(path, mode)); return newfs_balanced(ret);
+}
+static int newfs_locked_getattr(const char* path, struct stat* newfs_stat) {
+	int ret; NFS_SHARED(ret, newfs_getattr(path, newfs_stat)); return ret;
+}
+static int newfs_locked_readdir(const char* path, void* buf, fuse_fill_dir_t filler, off_t offset,
+								struct fuse_file_info* fi) {
+	int ret; NFS_SHARED(ret, newfs_readdir(path, buf, filler, offset, fi)); return ret;
+}
+static int newfs_locked_mknod(const char* path, mode_t mode, dev_t dev) {
+	int ret; NFS_SHARED(ret, newfs_mknod(path, mode, dev)); return newfs_balanced(ret);
+}
+static int newfs_locked_write(const char* path, const char* buf, size_t size, off_t offset,
+							  struct fuse_file_info* fi) {
+	int ret; NFS_SHARED(ret, newfs_write(path, buf, size, offset, fi)); return newfs_balanced(ret);
+}
+static int newfs_locked_write_buf(const char* path, struct fuse_bufvec* buf, off_t offset,
+								  struct fuse_file_info* fi) {
+	int ret; NFS_SHARED(ret, newfs_write_buf(path, buf, offset, fi)); return newfs_balanced(ret);
+}
+static int newfs_locked_read(const char* path, char* buf, size_t size, off_t offset,
+							 struct fuse_file_info* fi) {
+	int ret; NFS_SHARED(ret, newfs_read(path, buf, size, offset, fi)); return ret;
+}
+static int newfs_locked_truncate(const char* path, off_t offset) {
+	int ret; NFS_SHARED(ret, newfs_truncate(path, offset)); return newfs_balanced(ret);
+}
+static int newfs_locked_unlink(const char* path) {
+	int ret; NFS_EXCL(ret, newfs_unlink(path)); return newfs_balanced(ret);
+}
+static int newfs_locked_rmdir(const char* path) {
+	int ret; NFS_EXCL(ret, newfs_rmdir(path)); return newfs_balanced(ret);
+}
+static int newfs_locked_rename(const char* from, const char* to) {
+	int ret; NFS_EXCL(ret, newfs_rename(from, to)); return newfs_balanced(ret);
+}
+static int newfs_locked_open(const char* path, struct fuse_file_info* fi) {
+	int ret; NFS_SHARED(ret, newfs_open(path, fi)); return ret;
+}
+static int newfs_locked_opendir(const char* path, struct fuse_file_info* fi) {
+	int ret; NFS_SHARED(ret, newfs_opendir(path, fi)); return ret;
+}
+static int newfs_locked_access(const char* path, int type) {
+	int ret; NFS_SHARED(ret, newfs_access(path, type)); return ret;
+}
+static int newfs_locked_fgetattr(const char* path, struct stat* newfs_stat, struct fuse_file_info* fi) {
+	int ret; NFS_SHARED(ret, newfs_fgetattr(path, newfs_stat, fi)); return ret;
+}
+static int newfs_locked_ftruncate(const char* path, off_t offset, struct fuse_file_info* fi) {
+	int ret; NFS_SHARED(ret, newfs_ftruncate(path, offset, fi)); return newfs_balanced(ret);
+}
+static int newfs_locked_release(const char* path, struct fuse_file_info* fi) {
+	int ret; NFS_SHARED(ret, newfs_release(path, fi)); return newfs_balanced(ret);
+}
+static int newfs_locked_fsync(const char* path, int datasync, struct fuse_file_info* fi) {
+	int ret; NFS_EXCL(ret, newfs_fsync(path, datasync, fi)); return ret;
+}
+/******************************************************************************
 * SECTION: FUSE操作定义
 *******************************************************************************/
 static struct fuse_operations operations = {
 	.init = newfs_init,						 /* mount文件系统 */		
 	.destroy = newfs_destroy,				 /* umount文件系统 */
-	.mkdir = newfs_mkdir,					 /* 建目录，mkdir */
-	.getattr = newfs_getattr,				 /* 获取文件属性，类似stat，必须完成 */
-	.readdir = newfs_readdir,				 /* 填充dentrys */
-	.mknod = newfs_mknod,					 /* 创建文件，touch相关 */
-	.write = newfs_write,								  	 /* 写入文件 */
-	.read = newfs_read,								  	 /* 读文件 */
+	.mkdir = newfs_locked_mkdir,			 /* 建目录，mkdir */
+	.getattr = newfs_locked_getattr,		 /* 获取文件属性，类似stat，必须完成 */
+	.readdir = newfs_locked_readdir,		 /* 填充dentrys */
+	.mknod = newfs_locked_mknod,			 /* 创建文件，touch相关 */
+	.write = newfs_locked_write,			 /* 写入文件 */
+	.write_buf = newfs_locked_write_buf,	 /* 写入文件，数据从FUSE的buf直接拷贝进页 */
+	.read = newfs_locked_read,				 /* 读文件 */
 	.utimens = newfs_utimens,				 /* 修改时间，忽略，避免touch报错 */
-	.truncate = newfs_truncate,						  		 /* 改变文件大小 */
-	.unlink = newfs_unlink,							  		 /* 删除文件 */
-	.rmdir	= newfs_rmdir,							  		 /* 删除目录， rm -r */
-	.rename = newfs_rename,							  		 /* 重命名，mv */
-
-	.open = newfs_open,							
-	.opendir = newfs_opendir,
-	.access = newfs_access
+	.truncate = newfs_locked_truncate,		 /* 改变文件大小 */
+	.unlink = newfs_locked_unlink,			 /* 删除文件 */
+	.rmdir	= newfs_locked_rmdir,			 /* 删除目录， rm -r */
+	.rename = newfs_locked_rename,			 /* 重命名，mv */
+	.fsync = newfs_locked_fsync,			 /* 提交全部修改 */
+	.flush = newfs_flush,					 /* close时唤醒回写线程 */
+	.release = newfs_locked_release,		 /* 释放open分配的file_info */
+	.releasedir = newfs_locked_release,
+	.fgetattr = newfs_locked_fgetattr,		 /* 已打开文件按句柄获取属性 */
+	.ftruncate = newfs_locked_ftruncate,	 /* 已打开文件按句柄改变大小 */
+
+	.open = newfs_locked_open,							
+	.opendir = newfs_locked_opendir,
+	.access = newfs_locked_access
 };
 /******************************************************************************
 * SECTION: 必做函数实现
@@ -50,6 +150,11 @@ static struct fuse_operations operations = {
  */
 void* newfs_init(struct fuse_conn_info * conn_info) {
 	/* 在这里进行挂载 */
+#ifdef FUSE_CAP_SPLICE_READ
+	if (conn_info->capable & FUSE_CAP_SPLICE_READ) {	/* 写入的数据经管道直接进入文件页 */
+		conn_info->want |= FUSE_CAP_SPLICE_READ;
+	}
+#endif
 
 	// /* 下面是一个控制设备的示例 */
 	// super.fd = ddriver_open(newfs_options.device);
@@ -59,6 +164,9 @@ void* newfs_init(struct fuse_conn_info * conn_info) {
 		fuse_exit(fuse_get_context()->fuse);
 		return NULL;
 	}
+	if (newfs_writeback_start(newfs_options) != NFS_ERROR_NONE) {	/* 启动后台回写线程 */
+		fuse_exit(fuse_get_context()->fuse);
+	}
 	return NULL;
 }
 
@@ -72,6 +180,7 @@ void newfs_destroy(void* p) {
 	/* 在这里进行卸载 */
 	
 	// ddriver_close(super.fd);
+	newfs_writeback_stop();					/* 先停止回写线程，再同步并卸载 */
 	if (newfs_umount(newfs_options) != NFS_ERROR_NONE)
 	{
 		fuse_exit(fuse_get_context()->fuse);
@@ -91,29 +200,35 @@ int newfs_mkdir(const char* path, mode_t mode) {
 	/* 解析路径，创建目录 */
 	(void)mode;
 	boolean is_find, is_root;
-	char* fname;
 	struct newfs_dentry* last_dentry = newfs_lookup(path, &is_find, &is_root);
 	struct newfs_dentry* dentry;
-	struct newfs_inode*  inode;
 
 	// 目录已经存在
 	if (is_find) {
 		return -NFS_ERROR_EXISTS;
 	}
 
-	// former is regular file
-	if (NFS_IS_REG(last_dentry->inode)) {
-		return -NFS_ERROR_UNSUPPORTED;
-	}
-	
 	// 创建一个新目录 
-	fname  = newfs_get_fname(path);
-	dentry = new_dentry(fname, NFS_DIR); 
-	dentry->parent = last_dentry;
-	inode  = newfs_alloc_inode(dentry);
-	newfs_alloc_dentry(last_dentry->inode, dentry);
-	
-	return NFS_ERROR_NONE;
+	return newfs_do_create(last_dentry, newfs_get_fname(path), NFS_DIR, path, &dentry);
+}
+
+/**
+ * @brief 取得操作对象的inode：fi->fh保存了open/opendir分配的file_info时直接使用，
+ * 流式读写不再逐次解析路径；否则按路径查找
+ * 
+ * @param path 相对于挂载点的路径
+ * @param fi 文件信息，可为NULL
+ * @return struct newfs_inode* 找不到时为NULL
+ */
+static struct newfs_inode* newfs_fi_inode(const char* path, struct fuse_file_info* fi) {
+	boolean is_find, is_root;
+	struct newfs_dentry* dentry;
+
+	if (fi != NULL && fi->fh != 0) {
+		return ((struct file_info *)(uintptr_t)fi->fh)->inode;
+	}
+	dentry = newfs_lookup(path, &is_find, &is_root);
+	return is_find ? dentry->inode : NULL;
 }
 
 /**
@@ -125,37 +240,23 @@ int newfs_mkdir(const char* path, mode_t mode) {
  */
 int newfs_getattr(const char* path, struct stat * newfs_stat) {
 	/* TODO: 解析路径，获取Inode，填充newfs_stat，可参考/fs/simplefs/sfs.c的sfs_getattr()函数实现 */
-	boolean	is_find, is_root;
-	// 路径解析
-	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
-	if (is_find == FALSE) { // 找不到对应文件
-		return -NFS_ERROR_NOTFOUND;
-	}
-
-	if (NFS_IS_DIR(dentry->inode)) {
-		newfs_stat->st_mode = S_IFDIR | NFS_DEFAULT_PERM;
-		newfs_stat->st_size = dentry->inode->dir_cnt * sizeof(struct newfs_dentry_d);
-	}
-	else if (NFS_IS_REG(dentry->inode)) {
-		newfs_stat->st_mode = S_IFREG | NFS_DEFAULT_PERM;
-		newfs_stat->st_size = dentry->inode->size;
-	}
-
-	newfs_stat->st_nlink = dentry->inode->link;
-	newfs_stat->st_uid 	 = getuid();
-	newfs_stat->st_gid 	 = getgid();
-	newfs_stat->st_atime   = time(NULL);
-	newfs_stat->st_mtime   = time(NULL);
-	newfs_stat->st_blksize = NFS_BLK_SZ();
-	newfs_stat->st_blocks  = dentry->inode->data_blk_cnt;
+	return newfs_fgetattr(path, newfs_stat, NULL);
+}
 
-	if (is_root) {
-		newfs_stat->st_size	= super.sz_usage; 
-		newfs_stat->st_blocks = NFS_DISK_SZ() / NFS_BLK_SZ();
-		newfs_stat->st_nlink  = 2;		/* 根目录link数为2 */
+/**
+ * @brief 获取已打开文件或目录的属性，直接使用句柄中的inode，不解析路径
+ * 
+ * @param path 相对于挂载点的路径
+ * @param newfs_stat 返回状态
+ * @param fi 文件信息，为NULL时按路径查找
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_fgetattr(const char* path, struct stat * newfs_stat, struct fuse_file_info* fi) {
+	struct newfs_inode* inode = newfs_fi_inode(path, fi);
+	if (inode == NULL) { // 找不到对应文件
+		return -NFS_ERROR_NOTFOUND;
 	}
-
-	return NFS_ERROR_NONE;
+	return newfs_do_getattr(inode, newfs_stat);
 }
 
 /**
@@ -169,32 +270,26 @@ int newfs_getattr(const char* path, struct stat * newfs_stat) {
  *				const struct stat *stbuf, off_t off)
  * buf: name会被复制到buf中
  * name: dentry名字
- * stbuf: 文件状态，可忽略
+ * stbuf: 文件状态，已载入inode的子项填充完整属性，否则只有类型与inode号
  * off: 下一次offset从哪里开始，这里可以理解为第几个dentry
  * 
+ * 一次调用输出offset之后的全部目录项，filler返回非0（buf已满）时停止，
+ * 并在opendir分配的file_info中记下游标，下次调用不必从头遍历兄弟链表
+ * 
  * @param offset 第几个目录项？
- * @param fi 可忽略
+ * @param fi opendir分配的file_info，保存游标
  * @return int 0成功，否则返回对应错误号
  */
 int newfs_readdir(const char * path, void * buf, fuse_fill_dir_t filler, off_t offset,
 			    		 struct fuse_file_info * fi) {
     /* TODO: 解析路径，获取目录的Inode，并读取目录项，利用filler填充到buf，可参考/fs/simplefs/sfs.c的sfs_readdir()函数实现 */
-    boolean	is_find, is_root;
-	int		cur_dir = offset;
+	struct newfs_inode* inode = newfs_fi_inode(path, fi);
 
-	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
-	// printf("ISFIND: %d\n", is_find);
-	struct newfs_dentry* sub_dentry;
-	struct newfs_inode*  inode;
-	if (is_find) {
-		inode = dentry->inode;
-		sub_dentry = newfs_get_dentry(inode, cur_dir);
-		if (sub_dentry) {
-			filler(buf, sub_dentry->fname, NULL, ++offset);
-		}
-		return NFS_ERROR_NONE;
+	if (inode == NULL) {
+		return -NFS_ERROR_NOTFOUND;
 	}
-	return -NFS_ERROR_NOTFOUND;
+	return newfs_do_readdir(inode, buf, filler, offset,
+							fi != NULL ? (struct file_info *)(uintptr_t)fi->fh : NULL);
 }
 
 /**
@@ -210,21 +305,11 @@ int newfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	boolean is_find,is_root;
 	struct newfs_dentry* f_dentry = newfs_lookup(path,&is_find,&is_root);
 	struct newfs_dentry* dentry;
-	struct newfs_inode* inode;
 
 	if(is_find){
 		return -NFS_ERROR_EXISTS;
 	}
-	if(NFS_IS_REG(f_dentry->inode)){
-		return -NFS_ERROR_UNSUPPORTED;
-	}
-
-	char* fname = newfs_get_fname(path);
-	dentry = new_dentry(fname, NFS_REG_FILE);
-	inode = newfs_alloc_inode(dentry);
-	newfs_alloc_dentry(f_dentry->inode, dentry);
-	return NFS_ERROR_NONE;
-	return 0;
+	return newfs_do_create(f_dentry, newfs_get_fname(path), NFS_REG_FILE, path, &dentry);
 }
 
 /**
@@ -248,47 +333,38 @@ int newfs_utimens(const char* path, const struct timespec tv[2]) {
  * @param buf 写入的内容
  * @param size 写入的字节数
  * @param offset 相对文件的偏移
- * @param fi 可忽略
+ * @param fi open分配的file_info，为NULL时按路径查找
  * @return int 写入大小
  */
 int newfs_write(const char* path, const char* buf, size_t size, off_t offset,
 		        struct fuse_file_info* fi) {
 	/* 选做 */
-	boolean is_find,is_root;
-	struct newfs_dentry* dentry = newfs_lookup(path,&is_find,&is_root);
-	struct newfs_inode* inode;
+	struct newfs_inode* inode = newfs_fi_inode(path, fi);
 
-	if (!is_find) {
+	if (inode == NULL) {
 		return -NFS_ERROR_NOTFOUND;
 	}
+	return newfs_do_write(inode, buf, size, offset);
+}
 
-	inode = dentry->inode;
-
-	if (NFS_IS_DIR(inode)) {
-		return -NFS_ERROR_ISDIR;	
-	}
-
-	if(inode->size < offset)
-	{
-		return -NFS_ERROR_SEEK;
-	}
-
-	memcpy(inode->data + offset, buf, size);
-	if(inode->size < offset + size)
-	{
-		inode->size = offset + size;
-	}
-
-	int l_block = (int)(NFS_ROUND_DOWN(offset, NFS_BLK_SZ())/NFS_BLK_SZ());
-	int r_block = (int)(NFS_ROUND_UP(offset + size, NFS_BLK_SZ())/NFS_BLK_SZ());
+/**
+ * @brief 写入文件，FUSE不先把数据拷贝到自己的buffer，内核开启splice时buf是管道，
+ * 数据从管道直接读入文件页
+ * 
+ * @param path 相对于挂载点的路径
+ * @param buf 写入的内容（内存或管道）
+ * @param offset 相对文件的偏移
+ * @param fi open分配的file_info，为NULL时按路径查找
+ * @return int 写入大小
+ */
+int newfs_write_buf(const char* path, struct fuse_bufvec* buf, off_t offset,
+		            struct fuse_file_info* fi) {
+	struct newfs_inode* inode = newfs_fi_inode(path, fi);
 
-	// dirty
-	for(int blk_cnt = l_block; blk_cnt < r_block && blk_cnt < NFS_DATA_PER_FILE; blk_cnt++) 
-	{
-		inode->dirty[blk_cnt] = 1;
+	if (inode == NULL) {
+		return -NFS_ERROR_NOTFOUND;
 	}
-
-	return size;
+	return newfs_do_write_buf(inode, buf, offset);
 }
 
 /**
@@ -298,34 +374,18 @@ int newfs_write(const char* path, const char* buf, size_t size, off_t offset,
  * @param buf 读取的内容
  * @param size 读取的字节数
  * @param offset 相对文件的偏移
- * @param fi 可忽略
+ * @param fi open分配的file_info，为NULL时按路径查找
  * @return int 读取大小
  */
 int newfs_read(const char* path, char* buf, size_t size, off_t offset,
 		       struct fuse_file_info* fi) {
 	/* 选做 */
-	boolean is_find,is_root;
-	struct newfs_dentry* dentry = newfs_lookup(path,&is_find,&is_root);
-	struct newfs_inode* inode;
+	struct newfs_inode* inode = newfs_fi_inode(path, fi);
 
-	if (!is_find) {
+	if (inode == NULL) {
 		return -NFS_ERROR_NOTFOUND;
 	}
-
-	inode = dentry->inode;
-
-	if (NFS_IS_DIR(inode)) {
-		return -NFS_ERROR_ISDIR;	
-	}
-
-	if(inode->size < offset)
-	{
-		return -NFS_ERROR_SEEK;
-	}
-
-	memcpy(buf, inode->data + offset, size);
-
-	return size;			   
+	return newfs_do_read(inode, buf, size, offset);
 }
 
 /**
@@ -338,61 +398,16 @@ int newfs_unlink(const char* path) {
 	/* 选做 */
 	boolean is_find,is_root;
 	struct newfs_dentry* dentry = newfs_lookup(path,&is_find,&is_root);
-	struct newfs_inode* inode;
 
 	if (!is_find) {
 		return -NFS_ERROR_NOTFOUND;
 	}
-
-	inode = dentry->inode;
-
-	if (NFS_IS_DIR(inode)) {
+	if (NFS_IS_DIR(dentry->inode)) {
 		return -NFS_ERROR_ISDIR;	
 	}
 
-	newfs_drop_inode(inode);
-	newfs_drop_dentry(dentry->parent->inode, dentry);
-
-	free(dentry);
-	
-	return NFS_ERROR_NONE;
-}
-
-int newfs_rmdir_rs(struct newfs_inode* inode)
-{
-    struct newfs_dentry* dentry = inode->dentry;
-	struct newfs_dentry* dentry_cursor = NULL;
-	struct newfs_dentry* old_dentry = NULL;
-
-	if (!NFS_IS_DIR(inode)) {
-        return -NFS_ERROR_UNSUPPORTED; // Path is not a directory
-    }
-
-	dentry_cursor = inode->dentrys;
-
-	while(dentry_cursor != NULL)
-	{
-		struct newfs_inode* sub_inode = dentry_cursor->inode;
-		if(NFS_IS_REG(sub_inode))
-		{
-			newfs_drop_inode(sub_inode);
-			newfs_drop_dentry(inode, dentry_cursor);
-			old_dentry = dentry_cursor;
-			dentry_cursor = dentry_cursor->brother;
-			free(old_dentry);
-			continue;
-		}
-		else if(NFS_IS_DIR(sub_inode))
-		{
-			newfs_rmdir_rs(sub_inode);
-		}
-	}
-
-	// Drop the inode and dentry
-    newfs_drop_inode(inode);
-    newfs_drop_dentry(dentry->parent->inode, dentry);
-
-	return NFS_ERROR_NONE;
+	newfs_dcache_invalidate(path, FALSE);
+	return newfs_do_unlink(dentry);
 }
 
 /**
@@ -419,14 +434,14 @@ int newfs_rmdir(const char* path) {
 
     inode = dentry->inode;
 
-	int ret = newfs_rmdir_rs(inode);
-	if(ret != NFS_ERROR_NONE)
-	{
-		return ret;
+	if (is_root) {
+		return -NFS_ERROR_INVAL;
 	}
+	newfs_dcache_invalidate(path, TRUE);	/* 目录及其下所有路径失效 */
+	int ret = newfs_rmdir_rs(inode);
 
-    return NFS_ERROR_NONE; // Successfully removed the directory
-	return 0;
+    newfs_journal_note_op(); // 累计到一定操作数后组提交；出错时已删除的子项同样需要提交
+	return ret;
 }
 
 /**
@@ -441,10 +456,15 @@ int newfs_rename(const char* from, const char* to) {
 	boolean is_find_from, is_find_to, is_root_from, is_root_to;
     struct newfs_dentry* dentry_from = newfs_lookup(from, &is_find_from, &is_root_from);
     struct newfs_dentry* dentry_to = newfs_lookup(to, &is_find_to, &is_root_to);
+	struct newfs_dentry* dentry_cursor;
+	int lvl;
 
     if (!is_find_from) {
         return -NFS_ERROR_NOTFOUND; // Source file not found
     }
+	if (strlen(newfs_get_fname(to)) >= NFS_MAX_FILE_NAME) {
+		return -NFS_ERROR_NAMETOOLONG;
+	}
 
 	if(strcmp(from,to) == 0){
 		return NFS_ERROR_NONE;
@@ -454,13 +474,21 @@ int newfs_rename(const char* from, const char* to) {
         return -NFS_ERROR_EXISTS; // Target file already exists
     }
 
-	memcpy(dentry_from->fname, to, NFS_MAX_FILE_NAME);
+	if (is_root_from || !NFS_IS_DIR(dentry_to->inode)) {
+		return -NFS_ERROR_UNSUPPORTED;
+	}
+	for (lvl = 0, dentry_cursor = dentry_to; dentry_cursor != super.root_dentry; 
+		 dentry_cursor = dentry_cursor->parent) {
+		lvl++;
+	}
+	if (lvl != newfs_calc_lvl(to) - 1) {	/* 目标的上级目录不存在 */
+		return -NFS_ERROR_NOTFOUND;
+	}
+	newfs_dcache_invalidate(from, TRUE);	/* 源路径及其下所有路径失效 */
+	newfs_dcache_invalidate(to, FALSE);		/* 目标路径的负项失效 */
     
     // Update the parent directory of the "to" dentry
-    newfs_drop_dentry(dentry_from->parent->inode, dentry_from);
-    newfs_alloc_dentry(dentry_to->inode, dentry_from);
-
-	return 0;
+	return newfs_do_rename(dentry_from, dentry_to, newfs_get_fname(to));
 }
 
 /**
@@ -479,16 +507,7 @@ int newfs_open(const char* path, struct fuse_file_info* fi) {
     if (!is_find) {
         return -NFS_ERROR_NOTFOUND; // File not found
     }
-
-	struct file_info* f_info = malloc(sizeof(struct file_info));
-    if (!f_info) {
-        return -NFS_ERROR_NOSPACE; // Allocation failed
-    }
-
-	f_info->inode = dentry->inode;
-    fi->fh = (uintptr_t)f_info;
-
-	return NFS_ERROR_NONE;
+	return newfs_do_open(dentry->inode, fi);
 }
 
 /**
@@ -510,32 +529,52 @@ int newfs_opendir(const char* path, struct fuse_file_info* fi) {
     if (!NFS_IS_DIR(dentry->inode)) {
         return -NFS_ERROR_UNSUPPORTED; // Path is not a directory
     }
+	return newfs_do_open(dentry->inode, fi);	/* 游标为空 */
+}
 
-	struct file_info* f_info = malloc(sizeof(struct file_info));
-    if (!f_info) {
-        return -NFS_ERROR_NOSPACE; // Allocation failed
-    }
-
-	f_info->inode = dentry->inode;
-    fi->fh = (uintptr_t)f_info;
+/**
+ * @brief 同步文件，提交文件系统的全部修改（包括元数据日志）后返回
+ * 
+ * @param path 相对于挂载点的路径
+ * @param datasync 可忽略，元数据与数据总是一起提交
+ * @param fi 文件信息
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_fsync(const char* path, int datasync, struct fuse_file_info* fi) {
+	(void)path;
+	(void)datasync;
+	(void)fi;
+	if (newfs_sync_fs() != NFS_ERROR_NONE) {
+		return -NFS_ERROR_IO;
+	}
+	return NFS_ERROR_NONE;
+}
 
-	return 0;
+/**
+ * @brief close时调用，不等待写回，只唤醒回写线程
+ * 
+ * @param path 相对于挂载点的路径
+ * @param fi 文件信息
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_flush(const char* path, struct fuse_file_info* fi) {
+	(void)path;
+	(void)fi;
+	newfs_writeback_kick();
+	return NFS_ERROR_NONE;
 }
 
-void shrink_data_map(struct newfs_inode* inode){
-	int data_ino = inode->ino * NFS_DATA_PER_FILE;
-	if(NFS_IS_REG(inode)){
-		inode->data_blk_cnt = NFS_ROUND_UP(inode->size, NFS_BLK_SZ()) / NFS_BLK_SZ();
-		for(int i=0;i<super.file_max;i++,data_ino++){
-			if(i < inode->data_blk_cnt){
-				super.data_map[data_ino / 8] |= (0x1 << (data_ino % 8));
-			}
-			else{
-				super.data_map[data_ino / 8] &= (uint8_t)(~(0x1 << (data_ino % 8)));
-			}
-		}
-	}
-	return; 
+/**
+ * @brief 文件或目录的最后一个引用关闭，释放open/opendir分配的file_info；
+ * 已被删除的文件在最后一个句柄关闭时才释放inode、数据块与dentry
+ * 
+ * @param path 相对于挂载点的路径
+ * @param fi 文件信息
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_release(const char* path, struct fuse_file_info* fi) {
+	(void)path;
+	return newfs_do_release(fi);
 }
 
 /**
@@ -547,21 +586,24 @@ void shrink_data_map(struct newfs_inode* inode){
  */
 int newfs_truncate(const char* path, off_t offset) {
 	/* 选做 */
-	boolean	is_find, is_root;
-	struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
-	struct newfs_inode*  inode;
+	return newfs_ftruncate(path, offset, NULL);
+}
 
-	if (is_find == FALSE) {
+/**
+ * @brief 改变已打开文件的大小，直接使用句柄中的inode
+ * 
+ * @param path 相对于挂载点的路径
+ * @param offset 改变后文件大小
+ * @param fi 文件信息，为NULL时按路径查找
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_ftruncate(const char* path, off_t offset, struct fuse_file_info* fi) {
+	struct newfs_inode*  inode = newfs_fi_inode(path, fi);
+
+	if (inode == NULL) {
 		return -NFS_ERROR_NOTFOUND;
 	}
-	inode = dentry->inode;
-	if (NFS_IS_DIR(inode)) {
-		return -NFS_ERROR_ISDIR;
-	}
-
-	inode->size = offset;  // 改变文件的大小
-	shrink_data_map(inode);
-	return NFS_ERROR_NONE;
+	return newfs_do_truncate(inode, offset);
 }
 
 
@@ -612,11 +654,18 @@ int main(int argc, char **argv)
 	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
 
 	newfs_options.device = strdup("TODO: 这里填写你的ddriver设备路径");
+	newfs_options.entry_timeout = NFS_LL_TIMEOUT;
+	newfs_options.attr_timeout  = NFS_LL_TIMEOUT;
 
 	if (fuse_opt_parse(&args, &newfs_options, option_spec, NULL) == -1)
 		return -1;
 	
-	ret = fuse_main(args.argc, args.argv, &operations, NULL);
+	if (newfs_options.lowlevel) {
+		ret = newfs_ll_main(&args);		/* 按inode号的低层前端，见newfs_ll.c */
+	}
+	else {
+		ret = fuse_main(args.argc, args.argv, &operations, NULL);
+	}
 	fuse_opt_free_args(&args);
 	return ret;
 }
\ No newline at end of file
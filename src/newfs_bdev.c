@@ -0,0 +1,638 @@
+#include "../include/newfs.h"
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#ifdef NFS_WITH_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+extern struct newfs_super      super;
+
+/*
+ * 块设备后端：块缓存与日志经newfs_bdev_read/newfs_bdev_write按字节偏移读写设备，
+ * 挂载时由--backend选择实现
+ *
+ * 1. ddriver：课程提供的模拟磁盘，只能按IO单位读写且先seek；记录磁头位置，顺序IO不重复seek
+ * 2. file：磁盘镜像文件或块设备，pread/pwrite；格式化或指定了--dev_size时，
+ *    文件不存在或为空则按--dev_size（默认NFS_BDEV_DEFAULT_KB）创建，否则不存在时返回ENOENT
+ * 3. mmap：同file，映射到内存后直接拷贝
+ * 4. mem：内存盘，大小为--dev_size，卸载后内容丢失，用于测试与基准
+ * 5. uring：同file，经io_uring提交；newfs_bdev_submit的一批请求保持--queue_depth个在途，
+ *    完成一个补一个，回写、预读与挂载时读位图由串行IO变为深队列
+ * 6. 各后端给出设备大小与IO单位；IOC_REQ_DEVICE_STATE的统计（按IO单位计的读写次数、
+ *    不连续访问次数）ddriver由驱动给出，其余后端在本层统计，口径相同
+ * 7. 调用者持有块缓存锁（newfs_cache.c），本层不另加锁；没有submit的后端逐个执行一批请求
+ * 8. newfs_bdev_sync在日志提交前后与flush结束时调用，file/mmap后端借此保证写入顺序落盘
+ */
+static const struct newfs_bdev_ops* bdev;
+static int                          bdev_fd   = -1;
+static uint8_t*                     bdev_mem;
+static off_t                        bdev_head = -1;    /* 上一次IO结束的位置，-1表示未知 */
+static struct ddriver_state         bdev_state;
+static int                          bdev_qd;
+static boolean                      bdev_create;       /* 镜像文件不存在或为空时可按dev_size创建 */
+
+#ifdef NFS_WITH_DDRIVER
+static int nfs_ddriver_open(const char* path, off_t dev_size, off_t* sz_disk, int* sz_io) {
+    int size;
+    (void)dev_size;
+    bdev_fd = ddriver_open((char *)path);
+    if (bdev_fd < 0) {
+        return -NFS_ERROR_IO;
+    }
+    ddriver_ioctl(bdev_fd, IOC_REQ_DEVICE_SIZE,  &size);
+    ddriver_ioctl(bdev_fd, IOC_REQ_DEVICE_IO_SZ, sz_io);
+    *sz_disk = size;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 移动磁头，若磁头已在offset处则省去ddriver_seek
+ *
+ * @param offset
+ * @return int
+ */
+static int nfs_ddriver_seek(off_t offset) {
+    if (bdev_head == offset) {
+        return NFS_ERROR_NONE;
+    }
+    if (ddriver_seek(bdev_fd, offset, SEEK_SET) < 0) {
+        bdev_head = -1;
+        return -NFS_ERROR_SEEK;
+    }
+    bdev_head = offset;
+    return NFS_ERROR_NONE;
+}
+
+static int nfs_ddriver_read(off_t offset, uint8_t* buf, int size) {
+    if (nfs_ddriver_seek(offset) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    while (size > 0)
+    {
+        if (ddriver_read(bdev_fd, (char *)buf, NFS_IO_SZ()) < 0) {
+            bdev_head = -1;
+            return -NFS_ERROR_IO;
+        }
+        bdev_head += NFS_IO_SZ();
+        buf       += NFS_IO_SZ();
+        size      -= NFS_IO_SZ();
+    }
+    return NFS_ERROR_NONE;
+}
+
+static int nfs_ddriver_write(off_t offset, const uint8_t* buf, int size) {
+    if (nfs_ddriver_seek(offset) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    while (size > 0)
+    {
+        if (ddriver_write(bdev_fd, (char *)buf, NFS_IO_SZ()) < 0) {
+            bdev_head = -1;
+            return -NFS_ERROR_IO;
+        }
+        bdev_head += NFS_IO_SZ();
+        buf       += NFS_IO_SZ();
+        size      -= NFS_IO_SZ();
+    }
+    return NFS_ERROR_NONE;
+}
+
+static int nfs_ddriver_ioctl(unsigned long cmd, void* ret) {
+    return ddriver_ioctl(bdev_fd, cmd, ret) < 0 ? -NFS_ERROR_IO : NFS_ERROR_NONE;
+}
+
+static void nfs_ddriver_close() {
+    ddriver_close(bdev_fd);
+}
+#endif
+static void nfs_file_close();
+/**
+ * @brief 打开镜像文件或块设备；bdev_create时文件不存在则创建，为空时扩展到dev_size字节
+ *
+ * @param path
+ * @param dev_size
+ * @param sz_disk 返回设备大小，按IO单位向下取整
+ * @param sz_io
+ * @return int 文件不存在且不能创建时返回-NFS_ERROR_NOTFOUND，失败时不留打开的描述符
+ */
+static int nfs_file_open(const char* path, off_t dev_size, off_t* sz_disk, int* sz_io) {
+    struct stat st;
+    uint64_t    size;
+
+    bdev_fd = open(path, O_RDWR | (bdev_create ? O_CREAT : 0), 0644);
+    if (bdev_fd < 0) {
+        return errno == ENOENT ? -NFS_ERROR_NOTFOUND : -NFS_ERROR_IO;
+    }
+    if (fstat(bdev_fd, &st) < 0) {
+        nfs_file_close();
+        return -NFS_ERROR_IO;
+    }
+    size = st.st_size;
+    if (S_ISBLK(st.st_mode)) {
+        if (ioctl(bdev_fd, BLKGETSIZE64, &size) < 0) {
+            nfs_file_close();
+            return -NFS_ERROR_IO;
+        }
+    }
+    else if (size == 0 && bdev_create) {            /* 新镜像 */
+        if (ftruncate(bdev_fd, dev_size) < 0) {
+            nfs_file_close();
+            return -NFS_ERROR_IO;
+        }
+        size = dev_size;
+    }
+    *sz_io   = NFS_BDEV_IO_SZ;
+    *sz_disk = (off_t)(size / NFS_BDEV_IO_SZ * NFS_BDEV_IO_SZ);
+    return NFS_ERROR_NONE;
+}
+
+static int nfs_file_read(off_t offset, uint8_t* buf, int size) {
+    ssize_t n;
+    while (size > 0)
+    {
+        n = pread(bdev_fd, buf, size, offset);
+        if (n <= 0) {
+            return -NFS_ERROR_IO;
+        }
+        buf    += n;
+        size   -= n;
+        offset += n;
+    }
+    return NFS_ERROR_NONE;
+}
+
+static int nfs_file_write(off_t offset, const uint8_t* buf, int size) {
+    ssize_t n;
+    while (size > 0)
+    {
+        n = pwrite(bdev_fd, buf, size, offset);
+        if (n <= 0) {
+            return -NFS_ERROR_IO;
+        }
+        buf    += n;
+        size   -= n;
+        offset += n;
+    }
+    return NFS_ERROR_NONE;
+}
+
+static int nfs_file_sync() {
+    return fdatasync(bdev_fd) < 0 ? -NFS_ERROR_IO : NFS_ERROR_NONE;
+}
+
+static void nfs_file_close() {
+    close(bdev_fd);
+    bdev_fd = -1;
+}
+
+static int nfs_mmap_open(const char* path, off_t dev_size, off_t* sz_disk, int* sz_io) {
+    int ret = nfs_file_open(path, dev_size, sz_disk, sz_io);
+    if (ret != NFS_ERROR_NONE) {
+        return ret;
+    }
+    bdev_mem = (uint8_t *)mmap(NULL, (size_t)*sz_disk, PROT_READ | PROT_WRITE, MAP_SHARED, bdev_fd, 0);
+    if (bdev_mem == MAP_FAILED) {
+        bdev_mem = NULL;
+        nfs_file_close();
+        return -NFS_ERROR_IO;
+    }
+    return NFS_ERROR_NONE;
+}
+
+static int nfs_mem_read(off_t offset, uint8_t* buf, int size) {
+    memcpy(buf, bdev_mem + offset, size);
+    return NFS_ERROR_NONE;
+}
+
+static int nfs_mem_write(off_t offset, const uint8_t* buf, int size) {
+    memcpy(bdev_mem + offset, buf, size);
+    return NFS_ERROR_NONE;
+}
+
+static int nfs_mmap_sync() {
+    return msync(bdev_mem, NFS_DISK_SZ(), MS_SYNC) < 0 ? -NFS_ERROR_IO : NFS_ERROR_NONE;
+}
+
+static void nfs_mmap_close() {
+    munmap(bdev_mem, NFS_DISK_SZ());
+    close(bdev_fd);
+}
+
+static int nfs_mem_open(const char* path, off_t dev_size, off_t* sz_disk, int* sz_io) {
+    (void)path;
+    bdev_mem = (uint8_t *)calloc(1, (size_t)dev_size);
+    if (bdev_mem == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    *sz_io   = NFS_BDEV_IO_SZ;
+    *sz_disk = dev_size / NFS_BDEV_IO_SZ * NFS_BDEV_IO_SZ;
+    return NFS_ERROR_NONE;
+}
+
+static void nfs_mem_close() {
+    free(bdev_mem);
+}
+
+#ifdef NFS_WITH_URING
+/*
+ * io_uring环，未使用liburing，直接经io_uring_setup/io_uring_enter与映射的环交互
+ */
+static struct {
+    int                   fd;
+    unsigned              entries;
+    void*                 sq_ring;
+    void*                 cq_ring;
+    size_t                sq_ring_sz;
+    size_t                cq_ring_sz;
+    struct io_uring_sqe*  sqes;
+    unsigned*             sq_head;
+    unsigned*             sq_tail;
+    unsigned*             sq_mask;
+    unsigned*             sq_array;
+    unsigned*             cq_head;
+    unsigned*             cq_tail;
+    unsigned*             cq_mask;
+    struct io_uring_cqe*  cqes;
+} ring = { .fd = -1 };
+
+/**
+ * @brief 解除环的映射并关闭环，不关闭设备
+ */
+static void nfs_uring_teardown() {
+    if (ring.sqes != NULL) {
+        munmap(ring.sqes, ring.entries * sizeof(struct io_uring_sqe));
+    }
+    if (ring.cq_ring != NULL && ring.cq_ring != ring.sq_ring) {
+        munmap(ring.cq_ring, ring.cq_ring_sz);
+    }
+    if (ring.sq_ring != NULL) {
+        munmap(ring.sq_ring, ring.sq_ring_sz);
+    }
+    if (ring.fd >= 0) {
+        close(ring.fd);
+    }
+    memset(&ring, 0, sizeof(ring));
+    ring.fd = -1;
+}
+
+static void nfs_uring_close() {
+    nfs_uring_teardown();
+    nfs_file_close();
+}
+/**
+ * @brief 建立--queue_depth深的环并映射SQ、CQ与SQE数组
+ *
+ * @return int
+ */
+static int nfs_uring_setup() {
+    struct io_uring_params p;
+    uint8_t*               sq;
+    uint8_t*               cq;
+
+    memset(&p, 0, sizeof(p));
+    ring.fd = (int)syscall(__NR_io_uring_setup, bdev_qd, &p);
+    if (ring.fd < 0) {
+        return -NFS_ERROR_IO;
+    }
+    ring.entries    = p.sq_entries;
+    ring.sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring.cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring.sq_ring_sz = ring.sq_ring_sz > ring.cq_ring_sz ? ring.sq_ring_sz : ring.cq_ring_sz;
+    }
+    sq = mmap(NULL, ring.sq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+              ring.fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        ring.sq_ring = NULL;
+        nfs_uring_teardown();
+        return -NFS_ERROR_IO;
+    }
+    ring.sq_ring = sq;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cq = sq;
+    }
+    else {
+        cq = mmap(NULL, ring.cq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring.fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) {
+            nfs_uring_teardown();
+            return -NFS_ERROR_IO;
+        }
+    }
+    ring.cq_ring = cq;
+    ring.sqes    = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED) {
+        ring.sqes = NULL;
+        nfs_uring_teardown();
+        return -NFS_ERROR_IO;
+    }
+    ring.sq_head  = (unsigned *)(sq + p.sq_off.head);
+    ring.sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    ring.sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring.cq_head  = (unsigned *)(cq + p.cq_off.head);
+    ring.cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+    ring.cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring.cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return NFS_ERROR_NONE;
+}
+
+static int nfs_uring_open(const char* path, off_t dev_size, off_t* sz_disk, int* sz_io) {
+    int ret = nfs_file_open(path, dev_size, sz_disk, sz_io);
+    if (ret != NFS_ERROR_NONE) {
+        return ret;
+    }
+    if (nfs_uring_setup() != NFS_ERROR_NONE) {
+        nfs_file_close();
+        return -NFS_ERROR_IO;
+    }
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief io_uring_enter失败后收回已交给内核的请求，之后调用者才能释放请求的缓冲区：
+ * 撤回内核尚未取走的SQE，收割其余在途请求直到全部完成；
+ * 连等待也失败时关闭环（内核取消其上的请求）并重建，供之后的提交使用
+ *
+ * @param inflight 已放入SQ但尚未收割的请求数
+ * @return int 总是-NFS_ERROR_IO
+ */
+static int nfs_uring_drain(int inflight) {
+    unsigned head = __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+
+    inflight -= (int)(*ring.sq_tail - head);        /* 没有SQPOLL，只有本线程写sq_tail */
+    __atomic_store_n(ring.sq_tail, head, __ATOMIC_RELEASE);
+    while (TRUE) {
+        head = *ring.cq_head;
+        while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+            head++;
+            inflight--;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        if (inflight <= 0) {
+            break;
+        }
+        if (syscall(__NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+            errno != EINTR) {
+            nfs_uring_teardown();
+            nfs_uring_setup();
+            break;
+        }
+    }
+    return -NFS_ERROR_IO;
+}
+/**
+ * @brief 提交一批请求，始终保持最多ring.entries个在途，收割一个完成项就补交下一个
+ * 短读写（通常只在文件末尾附近出现）用pread/pwrite补完
+ *
+ * @param reqs
+ * @param n
+ * @return int
+ */
+static int nfs_uring_submit(struct newfs_bdev_req* reqs, int n) {
+    int                   next = 0, done = 0, inflight = 0, queued = 0, ret = NFS_ERROR_NONE;
+    unsigned              tail, head, idx;
+    struct io_uring_sqe*  sqe;
+    struct io_uring_cqe*  cqe;
+    struct newfs_bdev_req* req;
+    int                   res;
+
+    if (ring.fd < 0 && nfs_uring_setup() != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;                       /* 上次重建环失败 */
+    }
+    while (done < n) {
+        tail = *ring.sq_tail;
+        while (next < n && inflight < (int)ring.entries) {
+            idx = tail & *ring.sq_mask;
+            sqe = &ring.sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode    = reqs[next].write ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe->fd        = bdev_fd;
+            sqe->addr      = (uint64_t)(uintptr_t)reqs[next].buf;
+            sqe->len       = reqs[next].size;
+            sqe->off       = reqs[next].offset;
+            sqe->user_data = next;
+            ring.sq_array[idx] = idx;
+            tail++;
+            next++;
+            inflight++;
+            queued++;
+        }
+        __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+        if (syscall(__NR_io_uring_enter, ring.fd, queued, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return nfs_uring_drain(inflight);       /* 之前提交的请求仍在途 */
+        }
+        queued = 0;
+        head   = *ring.cq_head;
+        while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe = &ring.cqes[head & *ring.cq_mask];
+            req = &reqs[cqe->user_data];
+            res = cqe->res;
+            if (res < 0) {
+                ret = -NFS_ERROR_IO;
+            }
+            else if (res < req->size) {
+                if ((req->write ? nfs_file_write(req->offset + res, req->buf + res, req->size - res)
+                                : nfs_file_read(req->offset + res, req->buf + res, req->size - res))
+                    != NFS_ERROR_NONE) {
+                    ret = -NFS_ERROR_IO;
+                }
+            }
+            head++;
+            done++;
+            inflight--;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    return ret;
+}
+
+static int nfs_uring_read(off_t offset, uint8_t* buf, int size) {
+    struct newfs_bdev_req req = { offset, buf, size, FALSE };
+    return nfs_uring_submit(&req, 1);
+}
+
+static int nfs_uring_write(off_t offset, const uint8_t* buf, int size) {
+    struct newfs_bdev_req req = { offset, (uint8_t *)buf, size, TRUE };
+    return nfs_uring_submit(&req, 1);
+}
+#endif
+
+static const struct newfs_bdev_ops bdev_table[] = {
+#ifdef NFS_WITH_DDRIVER
+    { "ddriver", nfs_ddriver_open, nfs_ddriver_read, nfs_ddriver_write, NULL,
+      NULL,              nfs_ddriver_ioctl, nfs_ddriver_close },
+#endif
+    { "file",    nfs_file_open,    nfs_file_read,    nfs_file_write,    NULL,
+      nfs_file_sync,     NULL,              nfs_file_close },
+    { "mmap",    nfs_mmap_open,    nfs_mem_read,     nfs_mem_write,     NULL,
+      nfs_mmap_sync,     NULL,              nfs_mmap_close },
+    { "mem",     nfs_mem_open,     nfs_mem_read,     nfs_mem_write,     NULL,
+      NULL,              NULL,              nfs_mem_close },
+#ifdef NFS_WITH_URING
+    { "uring",   nfs_uring_open,   nfs_uring_read,   nfs_uring_write,   nfs_uring_submit,
+      nfs_file_sync,     NULL,              nfs_uring_close },
+#endif
+};
+/**
+ * @brief 非ddriver后端的访问统计，口径与ddriver相同
+ *
+ * @param offset
+ * @param size
+ * @param cnt read_cnt或write_cnt
+ */
+static void newfs_bdev_account(off_t offset, int size, int* cnt) {
+    if (offset != bdev_head) {
+        bdev_state.seek_cnt++;
+    }
+    bdev_head = offset + size;
+    *cnt     += size / NFS_IO_SZ();
+}
+/**
+ * @brief 按options.backend打开设备，设置super.fd、super.sz_disk与super.sz_io
+ *
+ * @param options
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_bdev_open(struct custom_options options) {
+    const char* name = options.backend ? options.backend : NFS_BDEV_DEFAULT;
+    off_t       dev_size = (off_t)(options.dev_size ? options.dev_size : NFS_BDEV_DEFAULT_KB) * 1024;
+    int         ret;
+    size_t      i;
+
+    bdev = NULL;
+    for (i = 0; i < sizeof(bdev_table) / sizeof(bdev_table[0]); i++) {
+        if (strcmp(bdev_table[i].name, name) == 0) {
+            bdev = &bdev_table[i];
+        }
+    }
+    if (bdev == NULL) {
+        return -NFS_ERROR_INVAL;
+    }
+    bdev_fd   = -1;
+    bdev_mem  = NULL;
+    bdev_head = -1;
+    bdev_qd   = options.queue_depth > 0 ? options.queue_depth : NFS_BDEV_QD;
+    bdev_create = options.format || options.dev_size > 0;
+    memset(&bdev_state, 0, sizeof(struct ddriver_state));
+    ret = bdev->open(options.device, dev_size, &super.sz_disk, &super.sz_io);
+    if (ret != NFS_ERROR_NONE) {                    /* 各后端失败时自行关闭已打开的设备 */
+        bdev = NULL;
+        return ret;
+    }
+    super.fd = bdev_fd;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 从设备offset处读size字节，offset与size按IO单位对齐
+ *
+ * @param offset
+ * @param buf
+ * @param size
+ * @return int
+ */
+int newfs_bdev_read(off_t offset, uint8_t* buf, int size) {
+    if (bdev->ioctl == NULL) {
+        newfs_bdev_account(offset, size, &bdev_state.read_cnt);
+    }
+    return bdev->read(offset, buf, size);
+}
+/**
+ * @brief 向设备offset处写size字节，offset与size按IO单位对齐
+ *
+ * @param offset
+ * @param buf
+ * @param size
+ * @return int
+ */
+int newfs_bdev_write(off_t offset, const uint8_t* buf, int size) {
+    if (bdev->ioctl == NULL) {
+        newfs_bdev_account(offset, size, &bdev_state.write_cnt);
+    }
+    return bdev->write(offset, buf, size);
+}
+/**
+ * @brief 执行一批互不重叠的读写，全部完成后返回
+ * 支持异步提交的后端（uring）一次提交多个请求，其余后端按数组顺序逐个执行
+ *
+ * @param reqs
+ * @param n
+ * @return int 任一请求失败返回-NFS_ERROR_IO
+ */
+int newfs_bdev_submit(struct newfs_bdev_req* reqs, int n) {
+    int i;
+    if (bdev->ioctl == NULL) {
+        for (i = 0; i < n; i++) {
+            newfs_bdev_account(reqs[i].offset, reqs[i].size,
+                               reqs[i].write ? &bdev_state.write_cnt : &bdev_state.read_cnt);
+        }
+    }
+    if (bdev->submit) {
+        return bdev->submit(reqs, n);
+    }
+    for (i = 0; i < n; i++) {
+        if ((reqs[i].write ? bdev->write(reqs[i].offset, reqs[i].buf, reqs[i].size)
+                           : bdev->read(reqs[i].offset, reqs[i].buf, reqs[i].size))
+            != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+    }
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 之前的写入落盘后返回
+ *
+ * @return int
+ */
+int newfs_bdev_sync() {
+    return bdev->sync ? bdev->sync() : NFS_ERROR_NONE;
+}
+/**
+ * @brief 与ddriver_ioctl相同的命令：IOC_REQ_DEVICE_SIZE/IO_SZ/STATE/RESET
+ *
+ * @param cmd
+ * @param ret
+ * @return int
+ */
+int newfs_bdev_ioctl(unsigned long cmd, void* ret) {
+    if (bdev->ioctl) {
+        return bdev->ioctl(cmd, ret);
+    }
+    switch (cmd)
+    {
+        case IOC_REQ_DEVICE_SIZE:                  /* 与ddriver相同为int，超过2GiB时截断 */
+            *(int *)ret = NFS_DISK_SZ() > INT_MAX ? INT_MAX : (int)NFS_DISK_SZ();
+            break;
+        case IOC_REQ_DEVICE_IO_SZ:
+            *(int *)ret = NFS_IO_SZ();
+            break;
+        case IOC_REQ_DEVICE_STATE:
+            memcpy(ret, &bdev_state, sizeof(struct ddriver_state));
+            break;
+        case IOC_REQ_DEVICE_RESET:
+            memset(&bdev_state, 0, sizeof(struct ddriver_state));
+            break;
+        default:
+            return -NFS_ERROR_INVAL;
+    }
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 关闭设备
+ *
+ */
+void newfs_bdev_close() {
+    if (bdev != NULL) {
+        bdev->close();
+    }
+    bdev      = NULL;
+    bdev_fd   = -1;
+    bdev_mem  = NULL;
+    bdev_head = -1;
+    super.fd  = -1;
+}
@@ -0,0 +1,278 @@
+#include "../include/newfs.h"
+
+extern struct newfs_super      super;
+
+#if defined(__SSE2__) && !defined(NFS_BITMAP_NO_SIMD)
+#include <emmintrin.h>
+#define NFS_BITMAP_SSE2
+#endif
+
+/*
+ * 位图引擎：super.ino_map与super.data_map共用
+ *
+ * 1. 按64位字扫描，__builtin_ctzll找到字内第一个空闲位；支持SSE2时一次跳过128位全满的区域
+ * 2. next-fit：组内从上次分配的位置之后开始找，找到组末尾再从组首绕回
+ * 3. 缓存空闲位数，满时直接返回；释放按下标直接清位
+ * 4. 分配与释放持有super.alloc_lock，两张位图共用一把锁
+ * 5. 位图按块组划分，每组group_bits位，记录各组空闲位数与修改标记；
+ *    newfs_bitmap_alloc_group先在目标组内next-fit，满时依次尝试之后的组
+ *
+ * 位序与原实现一致：第i位位于bits[i / 8]的第(i % 8)位（小端下即64位字的第(i % 64)位）
+ */
+static inline uint64_t newfs_bitmap_word(const struct newfs_bitmap* bm, int w) {
+    uint64_t word;
+    memcpy(&word, bm->bits + w * sizeof(uint64_t), sizeof(uint64_t));
+    return word;
+}
+/**
+ * @brief 查找[from, to)内第一个为0的位
+ *
+ * @param bm
+ * @param from
+ * @param to
+ * @return int 找不到返回-1
+ */
+static int newfs_bitmap_find_zero(const struct newfs_bitmap* bm, int from, int to) {
+    int      w, w_end;
+    uint64_t word;
+
+    if (from >= to) {
+        return -1;
+    }
+    w     = from / UINT64_BITS;
+    w_end = (to + UINT64_BITS - 1) / UINT64_BITS;
+
+    word  = newfs_bitmap_word(bm, w) | ((1ULL << (from % UINT64_BITS)) - 1);
+    while (TRUE)
+    {
+        if (~word != 0) {
+            int bit = w * UINT64_BITS + __builtin_ctzll(~word);
+            return bit < to ? bit : -1;
+        }
+        w++;
+#ifdef NFS_BITMAP_SSE2
+        while ((w & 1) == 0 && w + 2 <= w_end) {     /* 16字节对齐处每次检查128位 */
+            __m128i v = _mm_loadu_si128((const __m128i *)(bm->bits + w * sizeof(uint64_t)));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)0xFF))) != 0xFFFF) {
+                break;
+            }
+            w += 2;
+        }
+#endif
+        if (w >= w_end) {
+            return -1;
+        }
+        word = newfs_bitmap_word(bm, w);
+    }
+}
+/**
+ * @brief 统计[from, to)内已占用的位数
+ *
+ * @param bm
+ * @param from
+ * @param to
+ * @return int
+ */
+static int newfs_bitmap_count(const struct newfs_bitmap* bm, int from, int to) {
+    int used = 0;
+    for (; from < to && from % UINT64_BITS != 0; from++) {
+        used += newfs_bitmap_test(bm, from);
+    }
+    for (; from + UINT64_BITS <= to; from += UINT64_BITS) {
+        used += __builtin_popcountll(newfs_bitmap_word(bm, from / UINT64_BITS));
+    }
+    for (; from < to; from++) {
+        used += newfs_bitmap_test(bm, from);
+    }
+    return used;
+}
+
+static inline int newfs_bitmap_groups(const struct newfs_bitmap* bm) {
+    return (bm->nbits + bm->group_bits - 1) / bm->group_bits;
+}
+/**
+ * @brief 置位或清位，并更新空闲计数与所在块组的修改标记，调用者持有super.alloc_lock
+ *
+ * @param bm
+ * @param bit
+ * @param set
+ */
+static void newfs_bitmap_update(struct newfs_bitmap* bm, int bit, boolean set) {
+    int g = bit / bm->group_bits;
+    if (set) {
+        bm->bits[bit / UINT8_BITS] |= (uint8_t)(0x1 << (bit % UINT8_BITS));
+    }
+    else {
+        bm->bits[bit / UINT8_BITS] &= (uint8_t)(~(0x1 << (bit % UINT8_BITS)));
+    }
+    bm->nfree         += set ? -1 : 1;
+    bm->group_free[g] += set ? -1 : 1;
+    bm->group_dirty[g] = TRUE;
+}
+/**
+ * @brief 初始化位图状态，bits需已从磁盘读入
+ *
+ * @param bm
+ * @param nbits 有效位数，超出部分不参与分配
+ * @param group_bits 每个块组的位数
+ * @return int
+ */
+int newfs_bitmap_init(struct newfs_bitmap* bm, int nbits, int group_bits) {
+    int g, from, to;
+    bm->nbits       = nbits;
+    bm->nfree       = 0;
+    bm->group_bits  = group_bits;
+    bm->group_free  = (int*)calloc(newfs_bitmap_groups(bm), sizeof(int));
+    bm->group_hint  = (int*)calloc(newfs_bitmap_groups(bm), sizeof(int));
+    bm->group_dirty = (uint8_t*)calloc(newfs_bitmap_groups(bm), sizeof(uint8_t));
+    if (bm->group_free == NULL || bm->group_hint == NULL || bm->group_dirty == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    for (g = 0; g < newfs_bitmap_groups(bm); g++) {
+        from = g * group_bits;
+        to   = from + group_bits < nbits ? from + group_bits : nbits;
+        bm->group_free[g] = (to - from) - newfs_bitmap_count(bm, from, to);
+        bm->nfree        += bm->group_free[g];
+    }
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 释放位图及块组计数
+ *
+ * @param bm
+ */
+void newfs_bitmap_destroy(struct newfs_bitmap* bm) {
+    free(bm->bits);
+    free(bm->group_free);
+    free(bm->group_hint);
+    free(bm->group_dirty);
+    bm->bits        = NULL;
+    bm->group_free  = NULL;
+    bm->group_hint  = NULL;
+    bm->group_dirty = NULL;
+}
+/**
+ * @brief 记录bit所在块组下次分配的起点，调用者持有super.alloc_lock
+ *
+ * @param bm
+ * @param bit 刚分配的位
+ */
+static void newfs_bitmap_set_hint(struct newfs_bitmap* bm, int bit) {
+    int g    = bit / bm->group_bits;
+    int next = bit + 1 - g * bm->group_bits;
+    bm->group_hint[g] = next < bm->group_bits && bit + 1 < bm->nbits ? next : 0;
+}
+/**
+ * @brief 优先在goal块组内分配（组内next-fit），该组已满时依次尝试之后的块组
+ *
+ * @param bm
+ * @param goal 目标块组，越界时从第0组开始
+ * @return int 位下标，位图已满返回-NFS_ERROR_NOSPACE
+ */
+int newfs_bitmap_alloc_group(struct newfs_bitmap* bm, int goal) {
+    int ngroups = newfs_bitmap_groups(bm);
+    int bit = -1, i, g, from, to, start;
+
+    goal = goal >= 0 && goal < ngroups ? goal : 0;
+    pthread_mutex_lock(&super.alloc_lock);
+    for (i = 0; i < ngroups && bit < 0 && bm->nfree > 0; i++) {
+        g = (goal + i) % ngroups;
+        if (bm->group_free[g] == 0) {
+            continue;
+        }
+        from = g * bm->group_bits;
+        to   = from + bm->group_bits < bm->nbits ? from + bm->group_bits : bm->nbits;
+        start = from + bm->group_hint[g];
+        bit   = newfs_bitmap_find_zero(bm, start, to);
+        if (bit < 0) {
+            bit = newfs_bitmap_find_zero(bm, from, start);
+        }
+    }
+    if (bit >= 0) {
+        newfs_bitmap_update(bm, bit, TRUE);
+        newfs_bitmap_set_hint(bm, bit);
+    }
+    pthread_mutex_unlock(&super.alloc_lock);
+    return bit >= 0 ? bit : -NFS_ERROR_NOSPACE;
+}
+/**
+ * @brief 在goal块组内找run个连续空闲位，只占用其首位，其余位留给之后newfs_bitmap_alloc_at
+ * 每unit位划分为若干个run位的格子，不跨unit边界；不修改next-fit起点
+ *
+ * @param bm
+ * @param goal 目标块组
+ * @param unit 组内位号按unit对齐，如每个inode块的inode数
+ * @param run 不超过unit
+ * @return int 位下标，组内没有这样的格子返回-NFS_ERROR_NOSPACE
+ */
+int newfs_bitmap_alloc_run(struct newfs_bitmap* bm, int goal, int unit, int run) {
+    int from, to, bit = -1, pos, cell;
+
+    if (goal < 0 || goal >= newfs_bitmap_groups(bm) || run > unit) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    from = goal * bm->group_bits;
+    to   = from + bm->group_bits < bm->nbits ? from + bm->group_bits : bm->nbits;
+    pthread_mutex_lock(&super.alloc_lock);
+    while (bm->group_free[goal] >= run && (bit = newfs_bitmap_find_zero(bm, from, to)) >= 0) {
+        pos  = (bit - goal * bm->group_bits) % unit;
+        cell = bit - pos + NFS_ROUND_UP(pos, run);  /* bit所在或之后的第一个格子 */
+        if (cell + run > bit - pos + unit) {        /* 本区间内已没有完整的格子 */
+            from = bit - pos + unit;
+        }
+        else if (cell + run <= to && newfs_bitmap_count(bm, cell, cell + run) == 0) {
+            bit = cell;
+            break;
+        }
+        else {
+            from = cell + 1;
+        }
+        bit = -1;
+    }
+    if (bit >= 0) {
+        newfs_bitmap_update(bm, bit, TRUE);
+    }
+    pthread_mutex_unlock(&super.alloc_lock);
+    return bit >= 0 ? bit : -NFS_ERROR_NOSPACE;
+}
+/**
+ * @brief 分配指定的位，用于紧接在已有extent之后扩展，或内联文件占用随后的inode槽
+ *
+ * @param bm
+ * @param bit
+ * @return int 该位已占用或越界返回-NFS_ERROR_NOSPACE
+ */
+int newfs_bitmap_alloc_at(struct newfs_bitmap* bm, int bit) {
+    pthread_mutex_lock(&super.alloc_lock);
+    if (bit < 0 || bit >= bm->nbits || newfs_bitmap_test(bm, bit)) {
+        pthread_mutex_unlock(&super.alloc_lock);
+        return -NFS_ERROR_NOSPACE;
+    }
+    newfs_bitmap_update(bm, bit, TRUE);
+    newfs_bitmap_set_hint(bm, bit);
+    pthread_mutex_unlock(&super.alloc_lock);
+    return bit;
+}
+/**
+ * @brief 释放一个位
+ *
+ * @param bm
+ * @param bit
+ */
+void newfs_bitmap_free(struct newfs_bitmap* bm, int bit) {
+    pthread_mutex_lock(&super.alloc_lock);
+    if (bit >= 0 && bit < bm->nbits && newfs_bitmap_test(bm, bit)) {
+        newfs_bitmap_update(bm, bit, FALSE);
+    }
+    pthread_mutex_unlock(&super.alloc_lock);
+}
+/**
+ * @brief 测试一个位是否已占用
+ *
+ * @param bm
+ * @param bit
+ * @return boolean
+ */
+boolean newfs_bitmap_test(const struct newfs_bitmap* bm, int bit) {
+    return (bm->bits[bit / UINT8_BITS] >> (bit % UINT8_BITS)) & 0x1;
+}
@@ -0,0 +1,596 @@
+#include "../include/newfs.h"
+
+extern struct newfs_super      super;
+extern struct custom_options newfs_options;
+
+/*
+ * 块缓存：位于newfs_driver_read / newfs_driver_write与块设备后端（newfs_bdev.c）之间
+ *
+ * 1. 以逻辑块号（offset / NFS_BLK_SZ()）为键，哈希链查找
+ * 2. LRU链淘汰，表头为最近使用的块，淘汰表尾
+ * 3. 写操作只修改缓存并置NFS_FLAG_BUF_DIRTY，淘汰或newfs_cache_flush时才写回磁盘
+ * 4. 多块请求中的未命中块、flush的各组脏块都作为一批请求交给newfs_bdev_submit，
+ *    uring后端并行执行；其余后端按块号顺序执行，相邻块只需一次seek（磁头位置由ddriver后端记录）
+ * 5. 元数据块带NFS_FLAG_BUF_META，flush时先写回普通数据块，再经日志提交元数据块后写回原位；
+ *    脏元数据块不会被淘汰，只由newfs_sync_fs提交，日志中不会出现操作进行到一半的元数据；
+ *    其余块都是脏元数据块时缓存临时超出容量，多出的块在flush后释放，
+ *    newfs_writeback_balance见到缓存超出容量即同步提交
+ * 6. cache_lock（可重入）保护缓存与设备访问；newfs_cache_get_range返回的块只在持锁期间有效，
+ *    newfs_driver_read/newfs_driver_write在整个拷贝过程中持有newfs_cache_lock
+ * 7. 普通文件数据页经newfs_cache_read_through_vec/newfs_cache_write_through_vec直接与磁盘交换，
+ *    只有块已在缓存中时才经缓存拷贝，大文件顺序读写不在缓存中多拷贝一次，也不冲掉元数据块
+ */
+static struct newfs_buf*  cache_bufs;
+static uint8_t*           cache_arena;
+static struct newfs_buf*  cache_hash[NFS_CACHE_HASH_SZ];
+static struct newfs_buf*  lru_head;
+static struct newfs_buf*  lru_tail;
+static int                cache_nbufs;      /* 含超出容量临时分配的块 */
+static int                cache_base;       /* cache_bufs中的块数 */
+static pthread_mutex_t    cache_lock;
+
+/**
+ * @brief 从磁盘读入连续的n个逻辑块[blk, blk + n)，作为一批请求提交
+ *
+ * @param blk 起始块号
+ * @param bufs 每块对应的缓存块
+ * @param n
+ * @return int
+ */
+static int newfs_dev_read_blks(int blk, struct newfs_buf** bufs, int n) {
+    struct newfs_bdev_req reqs[NFS_CACHE_BATCH];
+    int i;
+    for (i = 0; i < n; i++) {
+        reqs[i].offset = NFS_BLKS_SZ((off_t)(blk + i));
+        reqs[i].buf    = bufs[i]->data;
+        reqs[i].size   = NFS_BLK_SZ();
+        reqs[i].write  = FALSE;
+    }
+    return newfs_bdev_submit(reqs, n);
+}
+/**
+ * @brief 将n个缓存块的内容写到[blk, blk + n)，blk为-1时各自写回原位，作为一批请求提交
+ *
+ * @param blk
+ * @param bufs
+ * @param n
+ * @return int
+ */
+static int newfs_dev_write_bufs_nolock(int blk, struct newfs_buf** bufs, int n) {
+    struct newfs_bdev_req* reqs;
+    int i, ret;
+    if (n == 0) {
+        return NFS_ERROR_NONE;
+    }
+    reqs = (struct newfs_bdev_req *)malloc(n * sizeof(struct newfs_bdev_req));
+    if (reqs == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    for (i = 0; i < n; i++) {
+        reqs[i].offset = NFS_BLKS_SZ((off_t)(blk < 0 ? bufs[i]->blk : blk + i));
+        reqs[i].buf    = bufs[i]->data;
+        reqs[i].size   = NFS_BLK_SZ();
+        reqs[i].write  = TRUE;
+    }
+    ret = newfs_bdev_submit(reqs, n);
+    free(reqs);
+    return ret;
+}
+int newfs_dev_write_bufs(int blk, struct newfs_buf** bufs, int n) {
+    int ret;
+    pthread_mutex_lock(&cache_lock);
+    ret = newfs_dev_write_bufs_nolock(blk, bufs, n);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+/**
+ * @brief 绕过缓存向磁盘顺序写n个逻辑块
+ * 写入的块不能在缓存中有脏副本（供日志区使用）
+ *
+ * @param blk 起始块号
+ * @param data
+ * @param n
+ * @return int
+ */
+static int newfs_dev_write_nolock(int blk, const uint8_t* data, int n) {
+    return newfs_bdev_write(NFS_BLKS_SZ((off_t)blk), data, NFS_BLKS_SZ(n));
+}
+int newfs_dev_write(int blk, const uint8_t* data, int n) {
+    int ret;
+    pthread_mutex_lock(&cache_lock);
+    ret = newfs_dev_write_nolock(blk, data, n);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+/**
+ * @brief 绕过缓存从磁盘顺序读n个逻辑块
+ *
+ * @param blk 起始块号
+ * @param data
+ * @param n
+ * @return int
+ */
+static int newfs_dev_read_nolock(int blk, uint8_t* data, int n) {
+    return newfs_bdev_read(NFS_BLKS_SZ((off_t)blk), data, NFS_BLKS_SZ(n));
+}
+int newfs_dev_read(int blk, uint8_t* data, int n) {
+    int ret;
+    pthread_mutex_lock(&cache_lock);
+    ret = newfs_dev_read_nolock(blk, data, n);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+/**
+ * @brief 将缓存块写回原位
+ *
+ * @param buf
+ * @return int
+ */
+static int newfs_dev_write_blk(struct newfs_buf* buf) {
+    if (newfs_dev_write(buf->blk, buf->data, 1) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    buf->flag &= ~(NFS_FLAG_BUF_DIRTY | NFS_FLAG_BUF_META);
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 将n个缓存块一起写回原位
+ *
+ * @param bufs
+ * @param n
+ * @return int
+ */
+static int newfs_dev_write_blks(struct newfs_buf** bufs, int n) {
+    int i;
+    if (newfs_dev_write_bufs_nolock(-1, bufs, n) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    for (i = 0; i < n; i++) {
+        bufs[i]->flag &= ~(NFS_FLAG_BUF_DIRTY | NFS_FLAG_BUF_META);
+    }
+    return NFS_ERROR_NONE;
+}
+
+static void newfs_lru_unlink(struct newfs_buf* buf) {
+    if (buf->lru_prev) buf->lru_prev->lru_next = buf->lru_next;
+    else               lru_head = buf->lru_next;
+    if (buf->lru_next) buf->lru_next->lru_prev = buf->lru_prev;
+    else               lru_tail = buf->lru_prev;
+    buf->lru_prev = buf->lru_next = NULL;
+}
+
+static void newfs_lru_push_head(struct newfs_buf* buf) {
+    buf->lru_prev = NULL;
+    buf->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = buf;
+    lru_head = buf;
+    if (lru_tail == NULL) lru_tail = buf;
+}
+
+static void newfs_hash_remove(struct newfs_buf* buf) {
+    struct newfs_buf** pp = &cache_hash[NFS_CACHE_HASH(buf->blk)];
+    while (*pp) {
+        if (*pp == buf) {
+            *pp = buf->hash_next;
+            break;
+        }
+        pp = &(*pp)->hash_next;
+    }
+    buf->hash_next = NULL;
+}
+/**
+ * @brief 在哈希表中查找blk，命中则移到LRU表头
+ *
+ * @param blk
+ * @return struct newfs_buf* 未命中返回NULL
+ */
+static struct newfs_buf* newfs_cache_lookup(int blk) {
+    struct newfs_buf* buf = cache_hash[NFS_CACHE_HASH(blk)];
+    while (buf) {
+        if (buf->blk == blk) {
+            newfs_lru_unlink(buf);
+            newfs_lru_push_head(buf);
+            return buf;
+        }
+        buf = buf->hash_next;
+    }
+    return NULL;
+}
+static boolean newfs_buf_extra(struct newfs_buf* buf) {
+    return buf < cache_bufs || buf >= cache_bufs + cache_base;
+}
+/**
+ * @brief 缓存中只剩脏元数据块时临时多分配一块，flush后由newfs_cache_shrink释放
+ *
+ * @return struct newfs_buf*
+ */
+static struct newfs_buf* newfs_cache_grow() {
+    struct newfs_buf* buf = (struct newfs_buf*)calloc(1, sizeof(struct newfs_buf));
+    if (buf == NULL || posix_memalign((void **)&buf->data, NFS_IO_SZ(), NFS_BLK_SZ()) != 0) {
+        free(buf);
+        return NULL;
+    }
+    buf->blk = -1;
+    newfs_lru_push_head(buf);
+    __atomic_add_fetch(&cache_nbufs, 1, __ATOMIC_RELAXED);    /* newfs_cache_overflow不持锁读 */
+    return buf;
+}
+/**
+ * @brief 释放超出容量的干净块，flush成功后调用
+ *
+ */
+static void newfs_cache_shrink() {
+    struct newfs_buf* buf = lru_head;
+    struct newfs_buf* next;
+    while (buf && cache_nbufs > cache_base) {
+        next = buf->lru_next;
+        if (newfs_buf_extra(buf) && !(buf->flag & NFS_FLAG_BUF_DIRTY)) {
+            if (buf->flag & NFS_FLAG_BUF_OCCUPY) {
+                newfs_hash_remove(buf);
+            }
+            newfs_lru_unlink(buf);
+            free(buf->data);
+            free(buf);
+            __atomic_sub_fetch(&cache_nbufs, 1, __ATOMIC_RELAXED);
+        }
+        buf = next;
+    }
+}
+/**
+ * @brief 淘汰LRU中最久未用的非元数据块，将其绑定到blk并移到表头，内容未读入
+ * 脏元数据块留在缓存中直到newfs_sync_fs提交，全是脏元数据块时临时多分配一块
+ *
+ * @param blk
+ * @return struct newfs_buf*
+ */
+static struct newfs_buf* newfs_cache_evict(int blk) {
+    struct newfs_buf* buf = lru_tail;
+    while (buf && (buf->flag & NFS_FLAG_BUF_META)) {
+        buf = buf->lru_prev;
+    }
+    if (buf == NULL && (buf = newfs_cache_grow()) == NULL) {
+        return NULL;
+    }
+    if (buf->flag & NFS_FLAG_BUF_DIRTY) {
+        if (newfs_dev_write_blk(buf) != NFS_ERROR_NONE) {
+            return NULL;
+        }
+    }
+    if (buf->flag & NFS_FLAG_BUF_OCCUPY) {
+        newfs_hash_remove(buf);
+    }
+    buf->blk       = blk;
+    buf->flag      = NFS_FLAG_BUF_OCCUPY;
+    buf->hash_next = cache_hash[NFS_CACHE_HASH(blk)];
+    cache_hash[NFS_CACHE_HASH(blk)] = buf;
+    newfs_lru_unlink(buf);
+    newfs_lru_push_head(buf);
+    return buf;
+}
+/**
+ * @brief 放弃一个未成功读入的缓存块
+ *
+ * @param buf
+ */
+static void newfs_cache_discard(struct newfs_buf* buf) {
+    newfs_hash_remove(buf);
+    buf->blk  = -1;
+    buf->flag = 0;
+    newfs_lru_unlink(buf);                           /* 放回表尾，优先被取用 */
+    buf->lru_prev = lru_tail;
+    if (lru_tail) lru_tail->lru_next = buf;
+    else          lru_head = buf;
+    lru_tail = buf;
+}
+/**
+ * @brief 初始化块缓存，需在super.sz_blks确定后调用
+ *
+ * @param nr_blks 缓存容量（块数），不小于NFS_CACHE_BATCH
+ * @return int
+ */
+int newfs_cache_init(int nr_blks) {
+    pthread_mutexattr_t attr;
+    int i;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);   /* flush中提交日志会再加锁 */
+    pthread_mutex_init(&cache_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    cache_bufs  = (struct newfs_buf*)calloc(nr_blks, sizeof(struct newfs_buf));
+    if (cache_bufs == NULL || 
+        posix_memalign((void **)&cache_arena, NFS_IO_SZ(), NFS_BLKS_SZ(nr_blks)) != 0) {
+        free(cache_bufs);
+        cache_bufs = NULL;
+        return -NFS_ERROR_NOSPACE;
+    }
+    memset(cache_hash, 0, sizeof(cache_hash));
+    lru_head = lru_tail = NULL;
+    cache_nbufs = nr_blks;
+    cache_base  = nr_blks;
+    for (i = 0; i < nr_blks; i++) {
+        cache_bufs[i].blk  = -1;
+        cache_bufs[i].data = cache_arena + NFS_BLKS_SZ(i);
+        newfs_lru_push_head(&cache_bufs[i]);
+    }
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 获取[blk, blk + n)的缓存块，n不超过NFS_CACHE_BATCH
+ * 未命中的块先全部分配好，再按连续段各seek一次顺序读入
+ * [blk + nofill_from, blk + nofill_to)内的块将被调用者整块覆盖，未命中时不读盘
+ *
+ * @param blk 起始块号
+ * @param n 块数
+ * @param bufs 输出，bufs[i]对应blk + i
+ * @param nofill_from 
+ * @param nofill_to 
+ * @return int
+ */
+static int newfs_cache_get_range_nolock(int blk, int n, struct newfs_buf** bufs, 
+                          int nofill_from, int nofill_to) {
+    int i, run;
+    boolean miss[NFS_CACHE_BATCH];
+
+    for (i = 0; i < n; i++) {
+        bufs[i] = newfs_cache_lookup(blk + i);
+        miss[i] = (bufs[i] == NULL);
+    }
+    for (i = 0; i < n; i++) {                        /* 先分配，淘汰写回不会打断后面的顺序读 */
+        if (miss[i] && (bufs[i] = newfs_cache_evict(blk + i)) == NULL) {
+            while (i-- > 0) {
+                if (miss[i]) newfs_cache_discard(bufs[i]);
+            }
+            return -NFS_ERROR_IO;
+        }
+    }
+    for (i = 0; i < n; i += run) {
+        run = 1;
+        if (!miss[i] || (i >= nofill_from && i < nofill_to)) {
+            continue;
+        }
+        while (i + run < n && miss[i + run] && 
+               !(i + run >= nofill_from && i + run < nofill_to)) {
+            run++;
+        }
+        if (newfs_dev_read_blks(blk + i, &bufs[i], run) != NFS_ERROR_NONE) {
+            for (i = 0; i < n; i++) {
+                if (miss[i]) newfs_cache_discard(bufs[i]);
+            }
+            return -NFS_ERROR_IO;
+        }
+    }
+    return NFS_ERROR_NONE;
+}
+int newfs_cache_get_range(int blk, int n, struct newfs_buf** bufs, 
+                          int nofill_from, int nofill_to) {
+    int ret;
+    pthread_mutex_lock(&cache_lock);
+    ret = newfs_cache_get_range_nolock(blk, n, bufs, nofill_from, nofill_to);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+/**
+ * @brief 预读[blk, blk + n)到缓存，相邻未命中块合并读
+ *
+ * @param blk
+ * @param n
+ * @return int
+ */
+int newfs_cache_prefetch(int blk, int n) {
+    struct newfs_buf* bufs[NFS_CACHE_BATCH];
+    int               batch;
+    while (n > 0) {                                 /* 每批单独持锁，预读不长时间阻塞其他线程 */
+        batch = n > NFS_CACHE_BATCH ? NFS_CACHE_BATCH : n;
+        if (newfs_cache_get_range(blk, batch, bufs, 0, 0) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+        blk += batch;
+        n   -= batch;
+    }
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 读n个文件数据块到data[i]（文件页），不经缓存中转
+ * 块在缓存中（可能是尚未写回的脏块）时从缓存拷贝，其余的作为一批请求直接从磁盘读入，也不占用缓存
+ *
+ * @param blks 逻辑块号
+ * @param data
+ * @param n
+ * @return int
+ */
+int newfs_cache_read_through_vec(const int* blks, uint8_t** data, int n) {
+    struct newfs_bdev_req* reqs;
+    struct newfs_buf*      buf;
+    int                    i, nreq = 0, ret;
+    reqs = (struct newfs_bdev_req *)malloc(n * sizeof(struct newfs_bdev_req));
+    if (reqs == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    pthread_mutex_lock(&cache_lock);
+    for (i = 0; i < n; i++) {
+        buf = newfs_cache_lookup(blks[i]);
+        if (buf != NULL) {
+            memcpy(data[i], buf->data, NFS_BLK_SZ());
+            continue;
+        }
+        reqs[nreq].offset = NFS_BLKS_SZ((off_t)blks[i]);
+        reqs[nreq].buf    = data[i];
+        reqs[nreq].size   = NFS_BLK_SZ();
+        reqs[nreq].write  = FALSE;
+        nreq++;
+    }
+    ret = nreq ? newfs_bdev_submit(reqs, nreq) : NFS_ERROR_NONE;
+    pthread_mutex_unlock(&cache_lock);
+    free(reqs);
+    return ret;
+}
+/**
+ * @brief 写回n个文件数据块，不经缓存中转
+ * 块在缓存中时更新缓存副本并标脏（与之前的写保持顺序），其余的作为一批请求直接从data[i]写入磁盘
+ * 只用于普通文件数据：数据先于引用它的元数据落盘，与flush的顺序一致
+ *
+ * @param blks 逻辑块号
+ * @param data
+ * @param n
+ * @return int
+ */
+int newfs_cache_write_through_vec(const int* blks, uint8_t** data, int n) {
+    struct newfs_bdev_req* reqs;
+    struct newfs_buf*      buf;
+    int                    i, nreq = 0, ret;
+    reqs = (struct newfs_bdev_req *)malloc(n * sizeof(struct newfs_bdev_req));
+    if (reqs == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    pthread_mutex_lock(&cache_lock);
+    for (i = 0; i < n; i++) {
+        buf = newfs_cache_lookup(blks[i]);
+        if (buf != NULL) {
+            memcpy(buf->data, data[i], NFS_BLK_SZ());
+            newfs_cache_mark_dirty(buf);
+            continue;
+        }
+        reqs[nreq].offset = NFS_BLKS_SZ((off_t)blks[i]);
+        reqs[nreq].buf    = data[i];
+        reqs[nreq].size   = NFS_BLK_SZ();
+        reqs[nreq].write  = TRUE;
+        nreq++;
+    }
+    ret = nreq ? newfs_bdev_submit(reqs, nreq) : NFS_ERROR_NONE;
+    pthread_mutex_unlock(&cache_lock);
+    free(reqs);
+    return ret;
+}
+/**
+ * @brief 标记缓存块为脏，需持有newfs_cache_lock
+ *
+ * @param buf
+ */
+void newfs_cache_mark_dirty(struct newfs_buf* buf) {
+    buf->flag |= NFS_FLAG_BUF_DIRTY;
+}
+/**
+ * @brief 标记缓存块为脏的元数据块，写回原位前需经日志提交，需持有newfs_cache_lock
+ *
+ * @param buf
+ */
+void newfs_cache_mark_meta(struct newfs_buf* buf) {
+    buf->flag |= NFS_FLAG_BUF_DIRTY | NFS_FLAG_BUF_META;
+}
+/**
+ * @brief 持有块缓存锁，期间newfs_cache_get_range返回的块不会被淘汰（可重入）
+ *
+ */
+void newfs_cache_lock() {
+    pthread_mutex_lock(&cache_lock);
+}
+/**
+ * @brief 释放块缓存锁
+ *
+ */
+void newfs_cache_unlock() {
+    pthread_mutex_unlock(&cache_lock);
+}
+
+static int newfs_buf_cmp(const void* a, const void* b) {
+    return (*(struct newfs_buf**)a)->blk - (*(struct newfs_buf**)b)->blk;
+}
+/**
+ * @brief 缓存超出容量的块数，大于0说明脏元数据块已占满缓存，应尽快提交
+ *
+ * @return int
+ */
+int newfs_cache_overflow() {
+    return __atomic_load_n(&cache_nbufs, __ATOMIC_RELAXED) - cache_base;
+}
+/**
+ * @brief 将所有脏块按块号顺序写回磁盘
+ * 先写回普通数据块，再将元数据块按日志容量分批提交到日志后写回原位；
+ * 超过日志容量时每批原位写回落盘后才提交下一批（下一批会覆盖日志区），
+ * 每批各自原子，但整次flush不是原子的，崩溃后可能只有前几批生效
+ *
+ * @return int
+ */
+static int newfs_cache_flush_nolock() {
+    int i, nr_data = 0, nr_meta = 0, batch, ret = NFS_ERROR_NONE;
+    struct newfs_buf** meta;
+    struct newfs_buf** data;
+    struct newfs_buf*  buf;
+
+    if (cache_nbufs == 0) {
+        return NFS_ERROR_NONE;
+    }
+    meta = (struct newfs_buf**)malloc(2 * cache_nbufs * sizeof(struct newfs_buf*));
+    if (meta == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    data = meta + cache_nbufs;
+    for (buf = lru_head; buf; buf = buf->lru_next) {
+        if (!(buf->flag & NFS_FLAG_BUF_DIRTY)) {
+            continue;
+        }
+        if (buf->flag & NFS_FLAG_BUF_META) {
+            meta[nr_meta++] = buf;
+        }
+        else {
+            data[nr_data++] = buf;
+        }
+    }
+    qsort(meta, nr_meta, sizeof(struct newfs_buf*), newfs_buf_cmp);
+    qsort(data, nr_data, sizeof(struct newfs_buf*), newfs_buf_cmp);
+    if (newfs_dev_write_blks(data, nr_data) != NFS_ERROR_NONE) {
+        free(meta);                                 /* 普通数据块先于引用它们的元数据落盘 */
+        return -NFS_ERROR_IO;
+    }
+    for (i = 0; i < nr_meta; i += batch) {
+        batch = newfs_journal_capacity();
+        batch = (batch == 0 || batch > nr_meta - i) ? nr_meta - i : batch;
+        if (newfs_journal_commit(meta + i, batch) != NFS_ERROR_NONE ||
+            newfs_dev_write_blks(meta + i, batch) != NFS_ERROR_NONE ||  /* 已进入日志，写回原位 */
+            newfs_bdev_sync() != NFS_ERROR_NONE) {  /* 原位写回落盘后日志区才能复用 */
+            ret = -NFS_ERROR_IO;
+            break;
+        }
+    }
+    free(meta);
+    if (ret == NFS_ERROR_NONE && nr_meta == 0 && newfs_bdev_sync() != NFS_ERROR_NONE) {
+        ret = -NFS_ERROR_IO;
+    }
+    if (ret == NFS_ERROR_NONE) {
+        newfs_cache_shrink();
+    }
+    return ret;
+}
+int newfs_cache_flush() {
+    int ret;
+    pthread_mutex_lock(&cache_lock);
+    ret = newfs_cache_flush_nolock();
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+/**
+ * @brief 刷回脏块并释放缓存
+ *
+ * @return int
+ */
+int newfs_cache_destroy() {
+    int ret = newfs_cache_flush();
+    struct newfs_buf* buf = lru_head;
+    struct newfs_buf* next;
+    for (; buf; buf = next) {                       /* flush失败时可能仍有超出容量的块 */
+        next = buf->lru_next;
+        if (newfs_buf_extra(buf)) {
+            free(buf->data);
+            free(buf);
+        }
+    }
+    free(cache_bufs);
+    free(cache_arena);
+    cache_bufs  = NULL;
+    cache_arena = NULL;
+    cache_nbufs = 0;
+    cache_base  = 0;
+    memset(cache_hash, 0, sizeof(cache_hash));
+    lru_head = lru_tail = NULL;
+    pthread_mutex_destroy(&cache_lock);
+    return ret;
+}
@@ -0,0 +1,177 @@
+#include "../include/newfs.h"
+
+extern struct newfs_super      super;
+
+/*
+ * 路径缓存：完整路径 -> dentry，getattr/access等重复查找同一路径时只需一次哈希查找
+ *
+ * 1. 正项：newfs_lookup找到的非根路径，最多NFS_DCACHE_SZ项
+ * 2. 负项：最后一级不存在的路径，记录其所在目录的dentry，最多NFS_DCACHE_NEG_SZ项；
+ *    在该目录下创建同名文件或目录、或改名到该路径时失效
+ * 3. 正负项各有一条LRU链，满时各自淘汰表尾，大量失败查找不会挤掉正项
+ * 4. unlink删除单个路径；rmdir、rename删除该路径及其下所有路径；卸载时清空
+ * 5. 命中也会调整LRU，所有入口持有dcache_lock
+ */
+static struct newfs_dcache_entry* dcache_hash[NFS_DCACHE_HASH_SZ];
+static struct newfs_dcache_entry* dcache_lru_head[2];     /* 下标为entry->negative */
+static struct newfs_dcache_entry* dcache_lru_tail[2];
+static int                        dcache_cnt[2];
+static const int                  dcache_max[2] = { NFS_DCACHE_SZ, NFS_DCACHE_NEG_SZ };
+static pthread_mutex_t            dcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void newfs_dcache_lru_unlink(struct newfs_dcache_entry* entry) {
+    int kind = entry->negative;
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    }
+    else {
+        dcache_lru_head[kind] = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    }
+    else {
+        dcache_lru_tail[kind] = entry->lru_prev;
+    }
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void newfs_dcache_lru_push(struct newfs_dcache_entry* entry) {
+    int kind = entry->negative;
+    entry->lru_prev = NULL;
+    entry->lru_next = dcache_lru_head[kind];
+    if (dcache_lru_head[kind]) {
+        dcache_lru_head[kind]->lru_prev = entry;
+    }
+    dcache_lru_head[kind] = entry;
+    if (dcache_lru_tail[kind] == NULL) {
+        dcache_lru_tail[kind] = entry;
+    }
+}
+/**
+ * @brief 从哈希链与LRU链中摘下并释放一项
+ *
+ * @param entry
+ */
+static void newfs_dcache_remove(struct newfs_dcache_entry* entry) {
+    struct newfs_dcache_entry** link = &dcache_hash[entry->hash & (NFS_DCACHE_HASH_SZ - 1)];
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    newfs_dcache_lru_unlink(entry);
+    dcache_cnt[entry->negative]--;
+    free(entry->path);
+    free(entry);
+}
+
+static struct newfs_dcache_entry* newfs_dcache_find(const char* path, uint32_t hash) {
+    struct newfs_dcache_entry* entry;
+    for (entry = dcache_hash[hash & (NFS_DCACHE_HASH_SZ - 1)]; entry; entry = entry->hash_next) {
+        if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+/**
+ * @brief 查找路径
+ *
+ * @param path
+ * @param negative 输出，命中负项时为TRUE
+ * @return struct newfs_dentry* 正项返回该路径的dentry，负项返回所在目录的dentry，未缓存返回NULL
+ */
+struct newfs_dentry* newfs_dcache_lookup(const char* path, boolean* negative) {
+    uint32_t                   hash = newfs_dir_hash(path, strlen(path));
+    struct newfs_dcache_entry* entry;
+    struct newfs_dentry*       dentry = NULL;
+    pthread_mutex_lock(&dcache_lock);
+    entry = newfs_dcache_find(path, hash);
+    if (entry != NULL) {
+        if (entry != dcache_lru_head[entry->negative]) {
+            newfs_dcache_lru_unlink(entry);
+            newfs_dcache_lru_push(entry);
+        }
+        *negative = entry->negative;
+        dentry    = entry->dentry;
+    }
+    pthread_mutex_unlock(&dcache_lock);
+    return dentry;
+}
+/**
+ * @brief 缓存路径，同类项已满时淘汰该类最久未使用的项
+ *
+ * @param path
+ * @param dentry 正项为该路径的dentry，负项为所在目录的dentry
+ * @param negative
+ */
+void newfs_dcache_insert(const char* path, struct newfs_dentry* dentry, boolean negative) {
+    uint32_t                   hash  = newfs_dir_hash(path, strlen(path));
+    struct newfs_dcache_entry* entry = (struct newfs_dcache_entry*)malloc(sizeof(struct newfs_dcache_entry));
+    struct newfs_dcache_entry* old;
+    if (entry == NULL) {
+        return;
+    }
+    entry->path = strdup(path);
+    if (entry->path == NULL) {
+        free(entry);
+        return;
+    }
+    pthread_mutex_lock(&dcache_lock);
+    old = newfs_dcache_find(path, hash);
+    if (old != NULL) {
+        newfs_dcache_remove(old);
+    }
+    if (dcache_cnt[negative] >= dcache_max[negative]) {
+        newfs_dcache_remove(dcache_lru_tail[negative]);
+    }
+    entry->hash     = hash;
+    entry->dentry   = dentry;
+    entry->negative = negative;
+    entry->hash_next = dcache_hash[hash & (NFS_DCACHE_HASH_SZ - 1)];
+    dcache_hash[hash & (NFS_DCACHE_HASH_SZ - 1)] = entry;
+    newfs_dcache_lru_push(entry);
+    dcache_cnt[negative]++;
+    pthread_mutex_unlock(&dcache_lock);
+}
+/**
+ * @brief 使路径失效（正项或负项）
+ *
+ * @param path
+ * @param subtree 为TRUE时同时使path下的所有路径失效（目录被删除或改名）
+ */
+void newfs_dcache_invalidate(const char* path, boolean subtree) {
+    struct newfs_dcache_entry* entry;
+    struct newfs_dcache_entry* next;
+    int                        len = strlen(path);
+    int                        kind;
+
+    pthread_mutex_lock(&dcache_lock);
+    entry = newfs_dcache_find(path, newfs_dir_hash(path, len));
+    if (entry != NULL) {
+        newfs_dcache_remove(entry);
+    }
+    for (kind = 0; subtree && kind < 2; kind++) {
+        for (entry = dcache_lru_head[kind]; entry; entry = next) {
+            next = entry->lru_next;
+            if (strncmp(entry->path, path, len) == 0 && entry->path[len] == '/') {
+                newfs_dcache_remove(entry);
+            }
+        }
+    }
+    pthread_mutex_unlock(&dcache_lock);
+}
+/**
+ * @brief 清空路径缓存
+ *
+ */
+void newfs_dcache_destroy() {
+    int kind;
+    pthread_mutex_lock(&dcache_lock);
+    for (kind = 0; kind < 2; kind++) {
+        while (dcache_lru_head[kind]) {
+            newfs_dcache_remove(dcache_lru_head[kind]);
+        }
+    }
+    pthread_mutex_unlock(&dcache_lock);
+}
@@ -12,22 +12,22 @@ void newfs_dump_imap() {
          byte_cursor+=4)
     {
         for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            printf("%d ", (super.ino_map[byte_cursor] & (0x1 << bit_cursor)) >> bit_cursor);   
+            printf("%d ", (super.ino_map.bits[byte_cursor] & (0x1 << bit_cursor)) >> bit_cursor);   
         }
         printf("\t");
 
         for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            printf("%d ", (super.ino_map[byte_cursor + 1] & (0x1 << bit_cursor)) >> bit_cursor);   
+            printf("%d ", (super.ino_map.bits[byte_cursor + 1] & (0x1 << bit_cursor)) >> bit_cursor);   
         }
         printf("\t");
         
         for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            printf("%d ", (super.ino_map[byte_cursor + 2] & (0x1 << bit_cursor)) >> bit_cursor);   
+            printf("%d ", (super.ino_map.bits[byte_cursor + 2] & (0x1 << bit_cursor)) >> bit_cursor);   
         }
         printf("\t");
         
         for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            printf("%d ", (super.ino_map[byte_cursor + 3] & (0x1 << bit_cursor)) >> bit_cursor);   
+            printf("%d ", (super.ino_map.bits[byte_cursor + 3] & (0x1 << bit_cursor)) >> bit_cursor);   
         }
         printf("\n");
         break;
@@ -44,22 +44,22 @@ void newfs_dump_dmap() {
          byte_cursor+=4)
     {
         for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            printf("%d ", (super.data_map[byte_cursor] & (0x1 << bit_cursor)) >> bit_cursor);   
+            printf("%d ", (super.data_map.bits[byte_cursor] & (0x1 << bit_cursor)) >> bit_cursor);   
         }
         printf("\t");
 
         for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            printf("%d ", (super.data_map[byte_cursor + 1] & (0x1 << bit_cursor)) >> bit_cursor);   
+            printf("%d ", (super.data_map.bits[byte_cursor + 1] & (0x1 << bit_cursor)) >> bit_cursor);   
         }
         printf("\t");
         
         for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            printf("%d ", (super.data_map[byte_cursor + 2] & (0x1 << bit_cursor)) >> bit_cursor);   
+            printf("%d ", (super.data_map.bits[byte_cursor + 2] & (0x1 << bit_cursor)) >> bit_cursor);   
         }
         printf("\t");
         
         for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            printf("%d ", (super.data_map[byte_cursor + 3] & (0x1 << bit_cursor)) >> bit_cursor);   
+            printf("%d ", (super.data_map.bits[byte_cursor + 3] & (0x1 << bit_cursor)) >> bit_cursor);   
         }
         printf("\n");
         break;
@@ -0,0 +1,253 @@
+#include "../include/newfs.h"
+
+extern struct newfs_super      super;
+
+/*
+ * 目录项哈希索引：目录inode->dir_hash按完整文件名（名字+长度）索引子目录项
+ *
+ * 由newfs_alloc_dentry/newfs_drop_dentry维护，newfs_lookup每一级只需一次哈希查找
+ * 子项数超过桶数时桶数翻倍；删除按dentry->hash定位桶，不依赖当前文件名
+ *
+ * 目录数据块：与普通文件一样按逻辑块放在inode->pages中，存放变长记录（见struct newfs_dentry_d），
+ * 目录大小为块数 * BLK_SZ；增删目录项时只改动所在的页，sync时与文件一样写回脏页（经日志）
+ */
+/**
+ * @brief 文件名（或路径）哈希，FNV-1a
+ *
+ * @param name
+ * @param len
+ * @return uint32_t
+ */
+uint32_t newfs_dir_hash(const char* name, int len) {
+    uint32_t h = 2166136261u;
+    int      i;
+    for (i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return h;
+}
+/**
+ * @brief 将索引扩展到sz个桶并重新散列
+ *
+ * @param inode
+ * @param sz
+ * @return int
+ */
+static int newfs_dir_rehash(struct newfs_inode* inode, int sz) {
+    struct newfs_dentry** table = (struct newfs_dentry**)calloc(sz, sizeof(struct newfs_dentry*));
+    struct newfs_dentry*  cursor;
+    struct newfs_dentry*  next;
+    int i;
+    if (table == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    for (i = 0; i < inode->dir_hash_sz; i++) {
+        for (cursor = inode->dir_hash[i]; cursor; cursor = next) {
+            next = cursor->hash_next;
+            cursor->hash_next = table[cursor->hash & (sz - 1)];
+            table[cursor->hash & (sz - 1)] = cursor;
+        }
+    }
+    free(inode->dir_hash);
+    inode->dir_hash    = table;
+    inode->dir_hash_sz = sz;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 将dentry加入目录索引
+ *
+ * @param inode 目录inode
+ * @param dentry
+ * @return int
+ */
+int newfs_dir_insert(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    int sz = inode->dir_hash_sz ? inode->dir_hash_sz : NFS_DIR_HASH_MIN;
+    while (sz < inode->dir_cnt + 1) {
+        sz *= 2;
+    }
+    if (sz != inode->dir_hash_sz && newfs_dir_rehash(inode, sz) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    dentry->hash      = newfs_dir_hash(dentry->fname, strlen(dentry->fname));
+    dentry->hash_next = inode->dir_hash[dentry->hash & (inode->dir_hash_sz - 1)];
+    inode->dir_hash[dentry->hash & (inode->dir_hash_sz - 1)] = dentry;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 将dentry移出目录索引
+ *
+ * @param inode 目录inode
+ * @param dentry
+ */
+void newfs_dir_remove(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    struct newfs_dentry** link;
+    if (inode->dir_hash == NULL) {
+        return;
+    }
+    for (link = &inode->dir_hash[dentry->hash & (inode->dir_hash_sz - 1)]; *link;
+         link = &(*link)->hash_next) {
+        if (*link == dentry) {
+            *link = dentry->hash_next;
+            dentry->hash_next = NULL;
+            return;
+        }
+    }
+}
+/**
+ * @brief 按完整文件名查找子目录项
+ *
+ * @param inode 目录inode
+ * @param name 文件名，不必以'\0'结尾
+ * @param len 文件名长度
+ * @return struct newfs_dentry* 找不到返回NULL
+ */
+struct newfs_dentry* newfs_dir_find(struct newfs_inode* inode, const char* name, int len) {
+    struct newfs_dentry* cursor;
+    uint32_t             h;
+    if (inode->dir_hash == NULL || len >= NFS_MAX_FILE_NAME) {
+        return NULL;
+    }
+    h = newfs_dir_hash(name, len);
+    for (cursor = inode->dir_hash[h & (inode->dir_hash_sz - 1)]; cursor; cursor = cursor->hash_next) {
+        if (cursor->hash == h && memcmp(cursor->fname, name, len) == 0 && cursor->fname[len] == '\0') {
+            return cursor;
+        }
+    }
+    return NULL;
+}
+/**
+ * @brief 释放目录索引
+ *
+ * @param inode
+ */
+void newfs_dir_free(struct newfs_inode* inode) {
+    free(inode->dir_hash);
+    inode->dir_hash    = NULL;
+    inode->dir_hash_sz = 0;
+}
+/**
+ * @brief 检查块内off处的记录是否完整、文件名是否可用，读出与遍历目录块前调用
+ * 损坏的块中名字可能超过NFS_MAX_FILE_NAME或含'\0'，通过检查后才能拷入dentry->fname
+ *
+ * @param rec
+ * @param off 记录在块内的偏移
+ * @return boolean
+ */
+boolean newfs_dir_rec_ok(const struct newfs_dentry_d* rec, int off) {
+    if (off + (int)sizeof(struct newfs_dentry_d) > NFS_BLK_SZ() ||
+        rec->rec_len < sizeof(struct newfs_dentry_d) || rec->rec_len % NFS_DENTRY_ALIGN != 0 ||
+        off + rec->rec_len > NFS_BLK_SZ()) {
+        return FALSE;
+    }
+    if (rec->name_len == 0) {
+        return TRUE;
+    }
+    return rec->name_len < NFS_MAX_FILE_NAME && NFS_DENTRY_REC_LEN(rec->name_len) <= rec->rec_len &&
+           memchr(NFS_DENTRY_NAME(rec), '\0', rec->name_len) == NULL;
+}
+/**
+ * @brief 为dentry写入目录项记录：首次适配，拆分剩余空间足够的记录（含删除后留下的空闲记录），
+ * 都放不下时目录增加一块
+ *
+ * @param inode 目录inode，调用者持有inode->lock写锁
+ * @param dentry ino、ftype与fname已设置
+ * @return int
+ */
+int newfs_dir_add_rec(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    uint8_t  rec_buf[sizeof(struct newfs_dentry_d) + NFS_MAX_FILE_NAME];
+    struct newfs_dentry_d* rec = NULL;
+    struct newfs_dentry_d* new_rec = (struct newfs_dentry_d *)rec_buf;
+    struct newfs_dentry_d  head;
+    int      name_len = (int)strlen(dentry->fname);
+    int      need     = NFS_DENTRY_REC_LEN(name_len);
+    int      nblks    = (int)(inode->size / NFS_BLK_SZ());
+    int      lblk, off = 0, used = 0;
+    off_t    base;
+
+    if (newfs_page_load(inode, 0, nblks) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    for (lblk = 0; lblk < nblks; lblk++) {
+        for (off = 0; off < NFS_BLK_SZ(); off += rec->rec_len) {
+            rec  = (struct newfs_dentry_d *)(inode->pages[lblk] + off);
+            if (!newfs_dir_rec_ok(rec, off)) {
+                break;
+            }
+            used = rec->name_len ? NFS_DENTRY_REC_LEN(rec->name_len) : 0;
+            if (rec->rec_len - used >= need) {
+                break;
+            }
+        }
+        if (off < NFS_BLK_SZ() && newfs_dir_rec_ok(rec, off)) {
+            break;
+        }
+    }
+
+    base = NFS_BLKS_SZ(lblk) + off;
+    if (lblk == nblks) {                                /* 新块只有一条记录，覆盖整块 */
+        base             = NFS_BLKS_SZ(nblks);
+        new_rec->rec_len = NFS_BLK_SZ();
+        inode->size     += NFS_BLK_SZ();
+    }
+    else if (used > 0) {                                /* 拆分：原记录只保留自身所需的长度 */
+        head         = *rec;
+        head.rec_len = used;
+        new_rec->rec_len = rec->rec_len - used;
+        if (newfs_page_write(inode, base, (uint8_t *)&head, sizeof(head)) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+        base += used;
+    }
+    else {                                              /* 复用空闲记录 */
+        new_rec->rec_len = rec->rec_len;
+    }
+    new_rec->ino      = dentry->ino;
+    new_rec->name_len = (uint8_t)name_len;
+    new_rec->ftype    = (uint8_t)dentry->ftype;
+    memcpy(NFS_DENTRY_NAME(new_rec), dentry->fname, name_len);
+    if (newfs_page_write(inode, base, rec_buf, sizeof(struct newfs_dentry_d) + name_len) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    dentry->d_off = (int)base;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 删除dentry的目录项记录：并入块内前一条记录，块首记录置为空闲
+ *
+ * @param inode 目录inode，调用者持有inode->lock写锁
+ * @param dentry
+ * @return int
+ */
+int newfs_dir_del_rec(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    struct newfs_dentry_d  head;
+    struct newfs_dentry_d* rec;
+    int      lblk = dentry->d_off / NFS_BLK_SZ();
+    int      boff = dentry->d_off % NFS_BLK_SZ();
+    int      off  = 0;
+    uint8_t* page;
+
+    if (dentry->d_off < 0) {
+        return NFS_ERROR_NONE;
+    }
+    if (newfs_page_load(inode, lblk, lblk + 1) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    page = inode->pages[lblk];
+    head = *(struct newfs_dentry_d *)(page + boff);
+    if (boff == 0) {
+        head.ino      = 0;
+        head.name_len = 0;
+    }
+    else {
+        for (rec = (struct newfs_dentry_d *)page; off + rec->rec_len < boff;
+             rec = (struct newfs_dentry_d *)(page + off)) {
+            off += rec->rec_len;
+        }
+        head.rec_len += rec->rec_len;
+        head.ino      = rec->ino;
+        head.name_len = rec->name_len;
+        head.ftype    = rec->ftype;
+    }
+    dentry->d_off = -1;
+    return newfs_page_write(inode, NFS_BLKS_SZ(lblk) + off, (uint8_t *)&head, sizeof(head));
+}
@@ -0,0 +1,223 @@
+#include "../include/newfs.h"
+
+extern struct newfs_super      super;
+
+/*
+ * 文件块映射：extent (start, len) 列表
+ *
+ * 内存中inode->extents按逻辑块顺序排列，依次覆盖逻辑块[0, data_blk_cnt)
+ * 磁盘上前NFS_INLINE_EXTENTS个extent直接存于newfs_inode_d，其余依次存入
+ * 溢出extent块链（newfs_extent_blk_d + extents[]），链头为newfs_inode_d.ext_blk
+ */
+static int newfs_extent_reserve(struct newfs_inode* inode, int cnt) {
+    struct newfs_extent* extents;
+    int cap = inode->ext_cap ? inode->ext_cap : NFS_INLINE_EXTENTS;
+    if (cnt <= inode->ext_cap) {
+        return NFS_ERROR_NONE;
+    }
+    while (cap < cnt) {
+        cap *= 2;
+    }
+    extents = (struct newfs_extent*)realloc(inode->extents, cap * sizeof(struct newfs_extent));
+    if (extents == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    inode->extents = extents;
+    inode->ext_cap = cap;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 逻辑块号 -> 数据块号
+ *
+ * @param inode
+ * @param lblk 逻辑块号
+ * @return int 数据块号，未分配返回-1
+ */
+int newfs_bmap(struct newfs_inode* inode, int lblk) {
+    int i;
+    for (i = 0; i < inode->ext_cnt; i++) {
+        if (lblk < inode->extents[i].len) {
+            return inode->extents[i].start + lblk;
+        }
+        lblk -= inode->extents[i].len;
+    }
+    return -1;
+}
+/**
+ * @brief 在文件末尾追加一个数据块，优先紧接最后一个extent分配以保持连续，
+ * 否则在最后一个extent所在的块组（没有extent时为inode所在的块组）内分配
+ *
+ * @param inode
+ * @return int 数据块号，失败返回负的错误号
+ */
+int newfs_extent_append(struct newfs_inode* inode) {
+    struct newfs_extent* last = NULL;
+    int data_cursor;
+    int goal = NFS_INO_GROUP(inode->ino);
+
+    if (inode->ext_cnt > 0) {
+        last = &inode->extents[inode->ext_cnt - 1];
+        data_cursor = newfs_bitmap_alloc_at(&super.data_map, last->start + last->len);
+        if (data_cursor >= 0) {
+            last->len++;
+            return data_cursor;
+        }
+        goal = NFS_DATA_GROUP(last->start + last->len - 1);
+    }
+
+    if (newfs_extent_reserve(inode, inode->ext_cnt + 1) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    data_cursor = newfs_bitmap_alloc_group(&super.data_map, goal);
+    if (data_cursor < 0) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    inode->extents[inode->ext_cnt].start = data_cursor;
+    inode->extents[inode->ext_cnt].len   = 1;
+    inode->ext_cnt++;
+    return data_cursor;
+}
+/**
+ * @brief 截断到nblks个逻辑块，释放其后的数据块
+ *
+ * @param inode
+ * @param nblks
+ */
+void newfs_extent_truncate(struct newfs_inode* inode, int nblks) {
+    struct newfs_extent* last;
+    int                  total = inode->data_blk_cnt;
+
+    while (total > nblks && inode->ext_cnt > 0) {
+        last = &inode->extents[inode->ext_cnt - 1];
+        newfs_bitmap_free(&super.data_map, last->start + last->len - 1);
+        last->len--;
+        total--;
+        if (last->len == 0) {
+            inode->ext_cnt--;
+        }
+    }
+    inode->data_blk_cnt = total;
+}
+/**
+ * @brief 释放全部数据块和溢出extent块
+ *
+ * @param inode
+ */
+void newfs_extent_free_all(struct newfs_inode* inode) {
+    int i;
+    newfs_extent_truncate(inode, 0);
+    for (i = 0; i < inode->ext_blk_cnt; i++) {
+        newfs_bitmap_free(&super.data_map, inode->ext_blks[i]);
+    }
+    inode->ext_blk_cnt = 0;
+    free(inode->extents);
+    free(inode->ext_blks);
+    inode->extents  = NULL;
+    inode->ext_blks = NULL;
+    inode->ext_cap  = 0;
+}
+/**
+ * @brief 从磁盘inode读入extent列表（含溢出extent块）
+ *
+ * @param inode
+ * @param inode_d
+ * @return int
+ */
+int newfs_extent_load(struct newfs_inode* inode, struct newfs_inode_d* inode_d) {
+    struct newfs_extent_blk_d* blk_d;
+    int blk = inode_d->ext_blk;
+    int cnt = inode_d->ext_cnt < NFS_INLINE_EXTENTS ? inode_d->ext_cnt : NFS_INLINE_EXTENTS;
+
+    inode->extents     = NULL;
+    inode->ext_cnt     = 0;
+    inode->ext_cap     = 0;
+    inode->ext_blks    = NULL;
+    inode->ext_blk_cnt = 0;
+    if (newfs_extent_reserve(inode, inode_d->ext_cnt > 0 ? inode_d->ext_cnt : 1) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    memcpy(inode->extents, inode_d->extents, cnt * sizeof(struct newfs_extent));
+    inode->ext_cnt = cnt;
+
+    if (blk == -1) {
+        return NFS_ERROR_NONE;
+    }
+    blk_d = (struct newfs_extent_blk_d*)malloc(NFS_BLK_SZ());
+    while (blk != -1 && inode->ext_cnt < inode_d->ext_cnt)
+    {
+        int* ext_blks = (int*)realloc(inode->ext_blks, (inode->ext_blk_cnt + 1) * sizeof(int));
+        if (ext_blks == NULL ||
+            newfs_driver_read(NFS_DATA_OFS(blk), (uint8_t *)blk_d, NFS_BLK_SZ()) != NFS_ERROR_NONE) {
+            free(blk_d);
+            return -NFS_ERROR_IO;
+        }
+        inode->ext_blks = ext_blks;
+        inode->ext_blks[inode->ext_blk_cnt++] = blk;
+        memcpy(inode->extents + inode->ext_cnt, (uint8_t *)blk_d + sizeof(struct newfs_extent_blk_d),
+               blk_d->cnt * sizeof(struct newfs_extent));
+        inode->ext_cnt += blk_d->cnt;
+        blk = blk_d->next;
+    }
+    free(blk_d);
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 将extent列表写入磁盘inode，放不下的部分写入溢出extent块
+ * 溢出extent块按需分配或释放
+ *
+ * @param inode
+ * @param inode_d
+ * @return int
+ */
+int newfs_extent_sync(struct newfs_inode* inode, struct newfs_inode_d* inode_d) {
+    struct newfs_extent_blk_d* blk_d;
+    int cnt      = inode->ext_cnt < NFS_INLINE_EXTENTS ? inode->ext_cnt : NFS_INLINE_EXTENTS;
+    int overflow = inode->ext_cnt - cnt;
+    int need     = (overflow + NFS_EXTENT_PER_BLK() - 1) / NFS_EXTENT_PER_BLK();
+    int i, n;
+
+    memset(inode_d->extents, 0, sizeof(inode_d->extents));
+    memcpy(inode_d->extents, inode->extents, cnt * sizeof(struct newfs_extent));
+    inode_d->ext_cnt = inode->ext_cnt;
+
+    while (inode->ext_blk_cnt > need) {                  /* 释放多余的溢出块 */
+        newfs_bitmap_free(&super.data_map, inode->ext_blks[--inode->ext_blk_cnt]);
+    }
+    if (need > inode->ext_blk_cnt) {
+        int* ext_blks = (int*)realloc(inode->ext_blks, need * sizeof(int));
+        if (ext_blks == NULL) {
+            return -NFS_ERROR_NOSPACE;
+        }
+        inode->ext_blks = ext_blks;
+        while (inode->ext_blk_cnt < need) {
+            int blk = newfs_bitmap_alloc_group(&super.data_map, NFS_INO_GROUP(inode->ino));
+            if (blk < 0) {
+                return -NFS_ERROR_NOSPACE;
+            }
+            inode->ext_blks[inode->ext_blk_cnt++] = blk;
+        }
+    }
+    inode_d->ext_blk = need > 0 ? inode->ext_blks[0] : -1;
+
+    if (need == 0) {
+        return NFS_ERROR_NONE;
+    }
+    blk_d = (struct newfs_extent_blk_d*)malloc(NFS_BLK_SZ());
+    for (i = 0; i < need; i++) {
+        n = overflow < NFS_EXTENT_PER_BLK() ? overflow : NFS_EXTENT_PER_BLK();
+        memset(blk_d, 0, NFS_BLK_SZ());
+        blk_d->next = i + 1 < need ? inode->ext_blks[i + 1] : -1;
+        blk_d->cnt  = n;
+        memcpy((uint8_t *)blk_d + sizeof(struct newfs_extent_blk_d),
+               inode->extents + cnt, n * sizeof(struct newfs_extent));
+        if (newfs_driver_write_meta(NFS_DATA_OFS(inode->ext_blks[i]), (uint8_t *)blk_d,
+                               NFS_BLK_SZ()) != NFS_ERROR_NONE) {
+            free(blk_d);
+            return -NFS_ERROR_IO;
+        }
+        cnt      += n;
+        overflow -= n;
+    }
+    free(blk_d);
+    return NFS_ERROR_NONE;
+}
@@ -0,0 +1,693 @@
+#include "../include/newfs.h"
+#include <stdarg.h>
+
+extern struct newfs_super      super;
+
+/*
+ * 离线一致性检查（fsck.newfs），检查期间设备不能被挂载
+ *
+ * 1. 读super，按其中的块大小初始化块缓存并重放日志（与挂载相同），之后只读；
+ *    读入各块组的位图，与块组描述符中的空闲数比较
+ * 2. 多线程扫描各组的inode表：各线程按NFS_FSCK_CHUNK块领取区间，只读入含已分配inode的区间，
+ *    检查每个已分配inode的编号、类型、extent与大小，把数据块与溢出extent块记入used位图
+ *    （原子置位，已置位说明被重复占用），目录的数据块号留给第3步
+ * 3. 多线程从根目录广度优先遍历目录树：共享目录队列，检查目录项指向的inode已分配、
+ *    类型一致且只被引用一次，子目录入队；每个inode的状态为一个字节，原子更新
+ * 4. 已分配但不可达的inode报错并从used中去掉其占用的块，再将inode位图、数据位图
+ *    与可达性逐位比较
+ */
+struct newfs_fsck_dir {
+    int  ino;
+    int  dir_cnt;
+    int  nblks;
+    int* blks;              /* 目录数据块号（数据区内），共nblks个 */
+};
+
+static struct {
+    uint8_t*               ino_bits;    /* 磁盘上的inode位图 */
+    uint8_t*               data_bits;   /* 磁盘上的数据位图 */
+    uint8_t*               used;        /* 已分配inode实际占用的数据块 */
+    uint8_t*               state;       /* 每个inode一个字节，见NFS_FSCK_TYPE_MASK */
+    struct newfs_fsck_dir* dirs;        /* 按ino排序 */
+    int                    nr_dirs;
+    int                    dirs_cap;
+    int                    next_chunk;  /* 第2步下一个待领取的inode块区间 */
+    int*                   queue;       /* 第3步的目录队列（dirs下标），每个目录至多入队一次 */
+    int                    q_head;
+    int                    q_tail;
+    int                    pending;     /* 已入队但未处理完的目录数 */
+    int                    visited;
+    int                    errors;
+    boolean                cached;      /* 已初始化块缓存 */
+    pthread_mutex_t        lock;
+    pthread_cond_t         cond;
+} fsck;
+
+static void newfs_fsck_error(const char* fmt, ...) {
+    va_list ap;
+    pthread_mutex_lock(&fsck.lock);
+    if (fsck.errors++ < NFS_FSCK_MAX_MSGS) {
+        va_start(ap, fmt);
+        printf("fsck: ");
+        vprintf(fmt, ap);
+        printf("\n");
+        va_end(ap);
+    }
+    pthread_mutex_unlock(&fsck.lock);
+}
+
+static inline boolean newfs_fsck_test(const uint8_t* bits, int bit) {
+    return (bits[bit / UINT8_BITS] >> (bit % UINT8_BITS)) & 1;
+}
+static inline int newfs_fsck_dev_blk(int blk) {
+    return (int)(NFS_DATA_OFS(blk) / NFS_BLK_SZ());
+}
+/**
+ * @brief 读入若干数据块，设备上连续的部分合并为一次读（跨块组的块中间隔着元数据，不合并）
+ *
+ * @param blks 数据区内的块号
+ * @param n
+ * @param out n个块的空间
+ * @return int
+ */
+static int newfs_fsck_read_blks(const int* blks, int n, uint8_t* out) {
+    int i = 0, run, start;
+    while (i < n) {
+        start = newfs_fsck_dev_blk(blks[i]);
+        for (run = 1; i + run < n && newfs_fsck_dev_blk(blks[i + run]) == start + run; run++);
+        if (newfs_dev_read(start, out + NFS_BLKS_SZ(i), run) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+        i += run;
+    }
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 读出inode的完整extent列表与溢出extent块，检查它们都在数据区内
+ *
+ * @param ino
+ * @param inode_d
+ * @param extents 输出，调用者释放
+ * @param ext_blks 输出溢出extent块号，调用者释放
+ * @param ext_blk_cnt
+ * @return int 结构损坏返回-NFS_ERROR_INVAL（已报告）
+ */
+static int newfs_fsck_load_extents(int ino, struct newfs_inode_d* inode_d,
+                                   struct newfs_extent** extents, int** ext_blks, int* ext_blk_cnt) {
+    struct newfs_extent_blk_d* blk_d;
+    int cnt = inode_d->ext_cnt < NFS_INLINE_EXTENTS ? inode_d->ext_cnt : NFS_INLINE_EXTENTS;
+    int need, blk = inode_d->ext_blk;
+
+    *extents     = NULL;
+    *ext_blks    = NULL;
+    *ext_blk_cnt = 0;
+    if (inode_d->ext_cnt < 0 || inode_d->ext_cnt > super.data_blks) {
+        newfs_fsck_error("inode %d: extent数%d无效", ino, inode_d->ext_cnt);
+        return -NFS_ERROR_INVAL;
+    }
+    need      = (inode_d->ext_cnt - cnt + NFS_EXTENT_PER_BLK() - 1) / NFS_EXTENT_PER_BLK();
+    *extents  = (struct newfs_extent*)malloc((inode_d->ext_cnt + 1) * sizeof(struct newfs_extent));
+    *ext_blks = (int*)malloc((need + 1) * sizeof(int));
+    blk_d     = (struct newfs_extent_blk_d*)malloc(NFS_BLK_SZ());
+    if (*extents == NULL || *ext_blks == NULL || blk_d == NULL) {
+        free(blk_d);
+        return -NFS_ERROR_NOSPACE;
+    }
+    memcpy(*extents, inode_d->extents, cnt * sizeof(struct newfs_extent));
+
+    while (cnt < inode_d->ext_cnt) {
+        if (blk < 0 || blk >= super.data_blks || *ext_blk_cnt >= need) {
+            newfs_fsck_error("inode %d: 溢出extent块链在第%d块处断开（块号%d）", ino, *ext_blk_cnt, blk);
+            free(blk_d);
+            return -NFS_ERROR_INVAL;
+        }
+        if (newfs_fsck_read_blks(&blk, 1, (uint8_t *)blk_d) != NFS_ERROR_NONE) {
+            free(blk_d);
+            return -NFS_ERROR_IO;
+        }
+        if (blk_d->cnt <= 0 || blk_d->cnt > NFS_EXTENT_PER_BLK() || cnt + blk_d->cnt > inode_d->ext_cnt) {
+            newfs_fsck_error("inode %d: 溢出extent块%d记录了%d个extent", ino, blk, blk_d->cnt);
+            free(blk_d);
+            return -NFS_ERROR_INVAL;
+        }
+        (*ext_blks)[(*ext_blk_cnt)++] = blk;
+        memcpy(*extents + cnt, (uint8_t *)blk_d + sizeof(struct newfs_extent_blk_d),
+               blk_d->cnt * sizeof(struct newfs_extent));
+        cnt += blk_d->cnt;
+        blk  = blk_d->next;
+    }
+    free(blk_d);
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 在used中置位或清除一个数据块
+ *
+ * @param ino 占用者，用于报告
+ * @param blk
+ * @param claim TRUE置位，重复置位报错
+ */
+static void newfs_fsck_claim(int ino, int blk, boolean claim) {
+    uint8_t mask = (uint8_t)(1 << (blk % UINT8_BITS));
+    uint8_t old;
+    if (!claim) {
+        __atomic_fetch_and(&fsck.used[blk / UINT8_BITS], (uint8_t)~mask, __ATOMIC_RELAXED);
+        return;
+    }
+    old = __atomic_fetch_or(&fsck.used[blk / UINT8_BITS], mask, __ATOMIC_RELAXED);
+    if (old & mask) {
+        newfs_fsck_error("数据块%d被重复占用（inode %d）", blk, ino);
+    }
+}
+/**
+ * @brief 置位或清除一个inode占用的全部数据块与溢出extent块
+ *
+ * @param ino
+ * @param extents
+ * @param ext_cnt
+ * @param ext_blks
+ * @param ext_blk_cnt
+ * @param claim
+ */
+static void newfs_fsck_claim_all(int ino, const struct newfs_extent* extents, int ext_cnt,
+                                 const int* ext_blks, int ext_blk_cnt, boolean claim) {
+    int i, j;
+    for (i = 0; i < ext_cnt; i++) {
+        for (j = 0; j < extents[i].len; j++) {
+            newfs_fsck_claim(ino, extents[i].start + j, claim);
+        }
+    }
+    for (i = 0; i < ext_blk_cnt; i++) {
+        newfs_fsck_claim(ino, ext_blks[i], claim);
+    }
+}
+/**
+ * @brief 检查一个已分配的inode，通过后记录类型并占用其数据块；目录加入fsck.dirs
+ * 内联内容延伸到随后的inode槽时，检查这些槽在位图中已分配并标记为NFS_FSCK_INLINE
+ *
+ * @param ino
+ * @param inode_d
+ * @return int 该inode占用的槽数，调用者跳过其余的槽
+ */
+static int newfs_fsck_inode(int ino, struct newfs_inode_d* inode_d) {
+    struct newfs_extent* extents;
+    int*     ext_blks;
+    int      ext_blk_cnt, i, j, k, span = 1;
+    int64_t  total = 0, nblks;
+
+    if ((int)inode_d->ino != ino) {
+        newfs_fsck_error("inode %d: 记录的编号为%u", ino, inode_d->ino);
+        return span;
+    }
+    if (inode_d->ftype != NFS_REG_FILE && inode_d->ftype != NFS_DIR && inode_d->ftype != NFS_SYM_LINK) {
+        newfs_fsck_error("inode %d: 类型%d无效", ino, inode_d->ftype);
+        return span;
+    }
+    if (newfs_fsck_load_extents(ino, inode_d, &extents, &ext_blks, &ext_blk_cnt) != NFS_ERROR_NONE) {
+        free(extents);
+        free(ext_blks);
+        return span;
+    }
+    for (i = 0; i < inode_d->ext_cnt; i++) {
+        if (extents[i].len <= 0 || extents[i].start < 0 ||
+            (int64_t)extents[i].start + extents[i].len > super.data_blks) {
+            newfs_fsck_error("inode %d: extent %d (%d, %d)超出数据区", ino, i,
+                             extents[i].start, extents[i].len);
+            goto out;
+        }
+        total += extents[i].len;
+    }
+    if (total != inode_d->data_blk_cnt) {
+        newfs_fsck_error("inode %d: extent共%lld块，记录的块数为%d", ino, (long long)total,
+                         inode_d->data_blk_cnt);
+        goto out;
+    }
+    if (inode_d->ftype == NFS_DIR) {
+        nblks = inode_d->dir_cnt < 0 || inode_d->size < 0 || inode_d->size % NFS_BLK_SZ() != 0 ? -1 :
+                inode_d->size / NFS_BLK_SZ();          /* 目录大小总是整块 */
+    }
+    else if (inode_d->data_blk_cnt == 0 && inode_d->size >= 0 && (inode_d->size <= NFS_INLINE_SZ() ||
+             (inode_d->ftype == NFS_REG_FILE && NFS_INLINE_FITS(ino, inode_d->size)))) {
+        nblks = 0;                                      /* 内容内联在inode记录中 */
+        span  = NFS_INLINE_SPAN(inode_d->size);
+    }
+    else {
+        nblks = inode_d->size < 0 ? -1 : NFS_ROUND_UP(inode_d->size, NFS_BLK_SZ()) / NFS_BLK_SZ();
+    }
+    if (nblks != inode_d->data_blk_cnt) {
+        newfs_fsck_error("inode %d: 大小%lld（%d个目录项）与块数%d不符", ino,
+                         (long long)inode_d->size, inode_d->dir_cnt, inode_d->data_blk_cnt);
+        goto out;
+    }
+
+    newfs_fsck_claim_all(ino, extents, inode_d->ext_cnt, ext_blks, ext_blk_cnt, TRUE);
+    if (inode_d->ftype == NFS_DIR) {
+        int* blks = (int*)malloc((inode_d->data_blk_cnt + 1) * sizeof(int));
+        if (blks == NULL) {
+            newfs_fsck_error("inode %d: 内存不足", ino);
+            goto out;
+        }
+        for (i = 0, k = 0; i < inode_d->ext_cnt; i++) {
+            for (j = 0; j < extents[i].len; j++) {
+                blks[k++] = extents[i].start + j;
+            }
+        }
+        pthread_mutex_lock(&fsck.lock);
+        if (fsck.nr_dirs == fsck.dirs_cap) {
+            fsck.dirs_cap = fsck.dirs_cap ? fsck.dirs_cap * 2 : 64;
+            fsck.dirs = (struct newfs_fsck_dir*)realloc(fsck.dirs,
+                                                        fsck.dirs_cap * sizeof(struct newfs_fsck_dir));
+        }
+        fsck.dirs[fsck.nr_dirs].ino     = ino;
+        fsck.dirs[fsck.nr_dirs].dir_cnt = inode_d->dir_cnt;
+        fsck.dirs[fsck.nr_dirs].nblks   = inode_d->data_blk_cnt;
+        fsck.dirs[fsck.nr_dirs].blks    = blks;
+        fsck.nr_dirs++;
+        pthread_mutex_unlock(&fsck.lock);
+    }
+    fsck.state[ino] = (uint8_t)(inode_d->ftype + 1);    /* 各线程的inode区间互不重叠 */
+    for (k = 1; k < span; k++) {                        /* 同一inode块，在本线程的区间内 */
+        if (!newfs_fsck_test(fsck.ino_bits, ino + k)) {
+            newfs_fsck_error("inode %d: 内联内容占用的inode %d在位图中未分配", ino, ino + k);
+        }
+        fsck.state[ino + k] = NFS_FSCK_INLINE;
+    }
+out:
+    free(extents);
+    free(ext_blks);
+    return span;
+}
+/**
+ * @brief 第2步的线程：领取inode块区间（不跨块组），读入并检查其中已分配的inode
+ *
+ * @param arg
+ * @return void*
+ */
+static void* newfs_fsck_scan_worker(void* arg) {
+    int      per_blk = NFS_INODE_PER_BLK();
+    int      per_group = (super.ino_blks + NFS_FSCK_CHUNK - 1) / NFS_FSCK_CHUNK;
+    int      nr_chunks = per_group * super.groups;
+    uint8_t* chunk = (uint8_t *)malloc(NFS_BLKS_SZ(NFS_FSCK_CHUNK));
+    int      c, g, k, blks, from, to, ino;
+
+    while (chunk != NULL && (c = __atomic_fetch_add(&fsck.next_chunk, 1, __ATOMIC_RELAXED)) < nr_chunks) {
+        g    = c / per_group;
+        k    = c % per_group;
+        blks = super.ino_blks - k * NFS_FSCK_CHUNK < NFS_FSCK_CHUNK ?
+               super.ino_blks - k * NFS_FSCK_CHUNK : NFS_FSCK_CHUNK;
+        from = g * super.ino_per_group + k * NFS_FSCK_CHUNK * per_blk;
+        to   = from + blks * per_blk < (g + 1) * super.ino_per_group ?
+               from + blks * per_blk : (g + 1) * super.ino_per_group;
+        for (ino = from; ino < to && !newfs_fsck_test(fsck.ino_bits, ino); ino++);
+        if (ino >= to) {
+            continue;                                   /* 区间内没有已分配的inode，不读 */
+        }
+        if (newfs_dev_read(NFS_INO_BLK(from), chunk, blks) != NFS_ERROR_NONE) {
+            newfs_fsck_error("读inode块%d-%d失败", NFS_INO_BLK(from), NFS_INO_BLK(from) + blks - 1);
+            continue;
+        }
+        for (; ino < to; ino++) {
+            if (newfs_fsck_test(fsck.ino_bits, ino)) {      /* 跳过内联内容占用的槽 */
+                ino += newfs_fsck_inode(ino, (struct newfs_inode_d *)(chunk +
+                                        (off_t)(ino - from) * NFS_INODE_SZ())) - 1;
+            }
+        }
+    }
+    free(chunk);
+    return NULL;
+}
+
+static int newfs_fsck_dir_cmp(const void* a, const void* b) {
+    return ((const struct newfs_fsck_dir*)a)->ino - ((const struct newfs_fsck_dir*)b)->ino;
+}
+
+static struct newfs_fsck_dir* newfs_fsck_find_dir(int ino) {
+    struct newfs_fsck_dir key;
+    key.ino = ino;
+    return (struct newfs_fsck_dir*)bsearch(&key, fsck.dirs, fsck.nr_dirs, sizeof(struct newfs_fsck_dir),
+                                           newfs_fsck_dir_cmp);
+}
+/**
+ * @brief 目录入队，调用者持有fsck.lock
+ *
+ * @param dir
+ */
+static void newfs_fsck_enqueue(struct newfs_fsck_dir* dir) {
+    fsck.queue[fsck.q_tail++] = (int)(dir - fsck.dirs);
+    fsck.pending++;
+    pthread_cond_signal(&fsck.cond);
+}
+/**
+ * @brief 检查一个目录的全部目录项，子目录入队
+ *
+ * @param dir
+ */
+static void newfs_fsck_walk_dir(struct newfs_fsck_dir* dir) {
+    uint8_t* data  = (uint8_t *)malloc(NFS_BLKS_SZ(dir->nblks) + 1);
+    struct newfs_dentry_d* rec;
+    struct newfs_fsck_dir* sub;
+    char     fname[NFS_MAX_FILE_NAME];
+    uint8_t  old;
+    int      lblk, off, live = 0;
+
+    if (data == NULL || newfs_fsck_read_blks(dir->blks, dir->nblks, data) != NFS_ERROR_NONE) {
+        newfs_fsck_error("目录%d: 读目录项失败", dir->ino);
+        free(data);
+        return;
+    }
+    for (lblk = 0; lblk < dir->nblks; lblk++) {
+        for (off = 0; off < NFS_BLK_SZ(); off += rec->rec_len) {
+            rec = (struct newfs_dentry_d *)(data + NFS_BLKS_SZ(lblk) + off);
+            if (!newfs_dir_rec_ok(rec, off)) {
+                newfs_fsck_error("目录%d: 第%d块偏移%d处的记录无效（长度%u，文件名长度%u）", dir->ino,
+                                 lblk, off, rec->rec_len, rec->name_len);
+                break;
+            }
+            if (rec->name_len == 0) {
+                continue;
+            }
+            live++;
+            memcpy(fname, NFS_DENTRY_NAME(rec), rec->name_len);
+            fname[rec->name_len] = '\0';
+            if (rec->ino >= (uint32_t)super.ino_max ||
+                (fsck.state[rec->ino] & NFS_FSCK_TYPE_MASK) == 0) {
+                newfs_fsck_error("目录%d: %s指向未分配或损坏的inode %u", dir->ino, fname, rec->ino);
+                continue;
+            }
+            if ((fsck.state[rec->ino] & NFS_FSCK_TYPE_MASK) != rec->ftype + 1) {
+                newfs_fsck_error("目录%d: %s的类型%d与inode %u不符", dir->ino, fname,
+                                 rec->ftype, rec->ino);
+                continue;
+            }
+            old = __atomic_fetch_or(&fsck.state[rec->ino], NFS_FSCK_REACHED, __ATOMIC_RELAXED);
+            if (old & NFS_FSCK_REACHED) {
+                newfs_fsck_error("目录%d: %s指向的inode %u已被其他目录项引用", dir->ino, fname,
+                                 rec->ino);
+                continue;
+            }
+            if (rec->ftype == NFS_DIR && (sub = newfs_fsck_find_dir(rec->ino)) != NULL) {
+                pthread_mutex_lock(&fsck.lock);
+                newfs_fsck_enqueue(sub);
+                pthread_mutex_unlock(&fsck.lock);
+            }
+        }
+    }
+    if (live != dir->dir_cnt) {
+        newfs_fsck_error("目录%d: 有%d个目录项，记录的数目为%d", dir->ino, live, dir->dir_cnt);
+    }
+    free(data);
+}
+/**
+ * @brief 第3步的线程：从共享队列取目录检查，队列空且没有目录在处理时结束
+ *
+ * @param arg
+ * @return void*
+ */
+static void* newfs_fsck_walk_worker(void* arg) {
+    struct newfs_fsck_dir* dir;
+
+    pthread_mutex_lock(&fsck.lock);
+    while (TRUE)
+    {
+        while (fsck.q_head == fsck.q_tail && fsck.pending > 0) {
+            pthread_cond_wait(&fsck.cond, &fsck.lock);
+        }
+        if (fsck.q_head == fsck.q_tail) {
+            break;
+        }
+        dir = &fsck.dirs[fsck.queue[fsck.q_head++]];
+        pthread_mutex_unlock(&fsck.lock);
+
+        newfs_fsck_walk_dir(dir);
+
+        pthread_mutex_lock(&fsck.lock);
+        fsck.visited++;
+        if (--fsck.pending == 0) {
+            pthread_cond_broadcast(&fsck.cond);
+        }
+    }
+    pthread_mutex_unlock(&fsck.lock);
+    return NULL;
+}
+/**
+ * @brief 用nr_threads个线程运行worker
+ *
+ * @param worker
+ * @param nr_threads
+ */
+static void newfs_fsck_run(void* (*worker)(void*), int nr_threads) {
+    pthread_t threads[NFS_FSCK_MAX_THREADS];
+    int       i, started = 0;
+    for (i = 0; i < nr_threads; i++) {
+        if (pthread_create(&threads[i], NULL, worker, NULL) == 0) {
+            started++;
+        }
+    }
+    if (started == 0) {
+        worker(NULL);
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+/**
+ * @brief 读入各块组的位图，并与块组描述符中的空闲数比较
+ *
+ * @return int
+ */
+static int newfs_fsck_load_groups() {
+    struct newfs_group_d* gd;
+    int g, i, dbits, dfree, ifree;
+
+    gd = (struct newfs_group_d *)malloc(NFS_BLKS_SZ(super.gd_blks));
+    if (gd == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    if (newfs_dev_read((int)(super.gd_offset / NFS_BLK_SZ()), (uint8_t *)gd, super.gd_blks) != NFS_ERROR_NONE) {
+        free(gd);
+        return -NFS_ERROR_IO;
+    }
+    for (g = 0; g < super.groups; g++) {
+        dbits = super.data_blks - g * super.data_per_group;
+        dbits = dbits < super.data_per_group ? dbits : super.data_per_group;
+        if (newfs_driver_read(NFS_IMAP_OFS(g), fsck.ino_bits + (off_t)g * (super.ino_per_group / UINT8_BITS),
+                              super.ino_per_group / UINT8_BITS) != NFS_ERROR_NONE ||
+            newfs_driver_read(NFS_DMAP_OFS(g), fsck.data_bits + (off_t)g * (super.data_per_group / UINT8_BITS),
+                              (dbits + UINT8_BITS - 1) / UINT8_BITS) != NFS_ERROR_NONE) {
+            free(gd);
+            return -NFS_ERROR_IO;
+        }
+        for (i = 0, ifree = 0; i < super.ino_per_group; i++) {
+            ifree += !newfs_fsck_test(fsck.ino_bits, g * super.ino_per_group + i);
+        }
+        for (i = 0, dfree = 0; i < dbits; i++) {
+            dfree += !newfs_fsck_test(fsck.data_bits, g * super.data_per_group + i);
+        }
+        if (gd[g].free_inodes != ifree || gd[g].free_blks != dfree) {
+            newfs_fsck_error("块组%d: 描述符记录空闲inode %d、空闲块%d，位图中为%d、%d", g,
+                             gd[g].free_inodes, gd[g].free_blks, ifree, dfree);
+        }
+    }
+    free(gd);
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 读super与位图，并重放日志
+ *
+ * @param options
+ * @return int
+ */
+static int newfs_fsck_load(struct custom_options options) {
+    struct newfs_super_d super_d;
+    uint8_t* head;
+    int      ret;
+
+    ret = newfs_bdev_open(options);
+    if (ret != NFS_ERROR_NONE) {
+        return ret;
+    }
+    head = (uint8_t *)malloc(NFS_IO_SZ());
+    if (head == NULL || newfs_bdev_read(NFS_SUPER_OFS, head, NFS_IO_SZ()) != NFS_ERROR_NONE) {
+        free(head);
+        return -NFS_ERROR_IO;
+    }
+    memcpy(&super_d, head, sizeof(struct newfs_super_d));
+    free(head);
+    if (super_d.magic != NFS_MAGIC_NUM || super_d.sz_blks <= 0 || super_d.sz_blks % NFS_IO_SZ() != 0) {
+        printf("fsck: %s不是newfs文件系统\n", options.device);
+        return -NFS_ERROR_INVAL;
+    }
+    super.sz_blks        = super_d.sz_blks;
+    super.journal_offset = super_d.journal_offset;
+    super.journal_blks   = super_d.journal_blks;
+    if (newfs_cache_init(NFS_CACHE_BLKS) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    fsck.cached = TRUE;
+    if (newfs_journal_replay() != NFS_ERROR_NONE ||     /* 已提交的事务先写回原位 */
+        newfs_driver_read(NFS_SUPER_OFS, (uint8_t *)&super_d, sizeof(struct newfs_super_d)) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    super.sz_inode        = super_d.sz_inode;
+    super.ino_max         = super_d.ino_max;
+    super.file_max        = super_d.file_max;
+    super.gd_offset       = super_d.gd_offset;
+    super.gd_blks         = super_d.gd_blks;
+    super.group_offset    = super_d.group_offset;
+    super.groups          = super_d.groups;
+    super.group_blks      = super_d.group_blks;
+    super.ino_per_group   = super_d.ino_per_group;
+    super.data_per_group  = super_d.data_per_group;
+    super.ino_map_blks    = super_d.ino_map_blks;
+    super.data_map_blks   = super_d.data_map_blks;
+    super.ino_blks        = super_d.ino_blks;
+    super.data_blks       = super_d.data_blks;
+    super.journal_offset  = super_d.journal_offset;
+    super.journal_blks    = super_d.journal_blks;
+
+    if (super.sz_inode < (int)sizeof(struct newfs_inode_d) || super.sz_inode > NFS_BLK_SZ() ||
+        super.groups <= 0 || super.ino_per_group <= 0 || super.ino_per_group % UINT8_BITS != 0 ||
+        super.data_per_group <= 0 || super.data_per_group % UINT8_BITS != 0 ||
+        super.ino_per_group > super.ino_blks * NFS_INODE_PER_BLK() ||
+        super.ino_per_group > NFS_BLKS_SZ(super.ino_map_blks) * UINT8_BITS ||
+        super.data_per_group > NFS_BLKS_SZ(super.data_map_blks) * UINT8_BITS ||
+        super.group_blks != super.ino_map_blks + super.data_map_blks + super.ino_blks + super.data_per_group ||
+        (int64_t)super.ino_max != (int64_t)super.groups * super.ino_per_group ||
+        super.data_blks <= (int64_t)(super.groups - 1) * super.data_per_group ||
+        super.data_blks > (int64_t)super.groups * super.data_per_group ||
+        super.gd_offset < NFS_SUPER_OFS + NFS_BLKS_SZ(NFS_SUPER_BLKS) ||
+        NFS_BLKS_SZ(super.gd_blks) < (int64_t)super.groups * (int64_t)sizeof(struct newfs_group_d) ||
+        super.gd_offset + NFS_BLKS_SZ(super.gd_blks) > super.group_offset ||
+        NFS_DATA_OFS(super.data_blks - 1) + NFS_BLK_SZ() > super.journal_offset ||
+        super.journal_offset + NFS_BLKS_SZ(super.journal_blks) > NFS_DISK_SZ()) {
+        printf("fsck: super中的布局无效\n");
+        return -NFS_ERROR_INVAL;
+    }
+
+    fsck.ino_bits  = (uint8_t *)calloc((super.ino_max + UINT64_BITS - 1) / UINT64_BITS, sizeof(uint64_t));
+    fsck.data_bits = (uint8_t *)calloc((super.data_blks + UINT64_BITS - 1) / UINT64_BITS, sizeof(uint64_t));
+    fsck.used      = (uint8_t *)calloc((super.data_blks + UINT64_BITS - 1) / UINT64_BITS, sizeof(uint64_t));
+    fsck.state     = (uint8_t *)calloc(super.ino_max, 1);
+    if (fsck.ino_bits == NULL || fsck.data_bits == NULL || fsck.used == NULL || fsck.state == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    return newfs_fsck_load_groups();
+}
+/**
+ * @brief 第4步：处理不可达的inode，再逐位比较两张位图
+ *
+ * @param report
+ */
+static void newfs_fsck_compare(struct newfs_fsck_report* report) {
+    struct newfs_inode_d* inode_d = (struct newfs_inode_d *)malloc(NFS_BLK_SZ());
+    struct newfs_extent*  extents;
+    int*     ext_blks;
+    int      ext_blk_cnt, ino, blk;
+    uint64_t disk, used, diff;
+
+    for (ino = 0; ino < super.ino_max; ino++) {
+        if (fsck.state[ino] & NFS_FSCK_REACHED) {
+            report->inodes++;
+            continue;
+        }
+        if (fsck.state[ino] & NFS_FSCK_INLINE) {
+            continue;                                   /* 属于前面的内联文件 */
+        }
+        if (!newfs_fsck_test(fsck.ino_bits, ino) || (fsck.state[ino] & NFS_FSCK_TYPE_MASK) == 0) {
+            continue;                                   /* 未分配，或损坏的inode已报告过 */
+        }
+        newfs_fsck_error("inode %d已分配但不可达", ino);
+        if (inode_d != NULL &&                          /* 其数据块不算可达 */
+            newfs_dev_read(NFS_INO_BLK(ino), (uint8_t *)inode_d, 1) == NFS_ERROR_NONE) {
+            struct newfs_inode_d* d = (struct newfs_inode_d *)((uint8_t *)inode_d +
+                                      (ino % NFS_INODE_PER_BLK()) * NFS_INODE_SZ());
+            if (newfs_fsck_load_extents(ino, d, &extents, &ext_blks, &ext_blk_cnt) == NFS_ERROR_NONE) {
+                newfs_fsck_claim_all(ino, extents, d->ext_cnt, ext_blks, ext_blk_cnt, FALSE);
+            }
+            free(extents);
+            free(ext_blks);
+        }
+    }
+    free(inode_d);
+
+    for (blk = 0; blk < super.data_blks; blk += UINT64_BITS) {
+        memcpy(&disk, fsck.data_bits + blk / UINT8_BITS, sizeof(uint64_t));
+        memcpy(&used, fsck.used + blk / UINT8_BITS, sizeof(uint64_t));
+        if (super.data_blks - blk < UINT64_BITS) {      /* 最后一个字只比较有效位 */
+            disk &= (1ULL << (super.data_blks - blk)) - 1;
+            used &= (1ULL << (super.data_blks - blk)) - 1;
+        }
+        report->blocks += __builtin_popcountll(used);
+        for (diff = disk ^ used; diff != 0; diff &= diff - 1) {
+            int b = blk + __builtin_ctzll(diff);
+            if (newfs_fsck_test(fsck.used, b)) {
+                newfs_fsck_error("数据块%d被使用但位图中未分配", b);
+            }
+            else {
+                newfs_fsck_error("数据块%d在位图中已分配但不可达", b);
+            }
+        }
+    }
+}
+/**
+ * @brief 离线检查设备上的newfs，设备不能同时被挂载；已提交的日志会先重放
+ *
+ * @param options device、backend、fsck_threads
+ * @param report 检查结果
+ * @return int 检查完成返回0（是否一致见report->errors），无法检查返回负的错误号
+ */
+int newfs_fsck(struct custom_options options, struct newfs_fsck_report* report) {
+    int nr_threads = options.fsck_threads > 0 ? options.fsck_threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int i, ret;
+
+    nr_threads = nr_threads < 1 ? 1 : nr_threads > NFS_FSCK_MAX_THREADS ? NFS_FSCK_MAX_THREADS : nr_threads;
+    memset(report, 0, sizeof(struct newfs_fsck_report));
+    memset(&fsck, 0, sizeof(fsck));
+    pthread_mutex_init(&fsck.lock, NULL);
+    pthread_cond_init(&fsck.cond, NULL);
+    newfs_lock_init();
+
+    ret = newfs_fsck_load(options);
+    if (ret == NFS_ERROR_NONE) {
+        if (!newfs_fsck_test(fsck.ino_bits, NFS_ROOT_INO)) {
+            newfs_fsck_error("根目录inode %d未分配", NFS_ROOT_INO);
+        }
+        newfs_fsck_run(newfs_fsck_scan_worker, nr_threads);          /* 第2步 */
+
+        qsort(fsck.dirs, fsck.nr_dirs, sizeof(struct newfs_fsck_dir), newfs_fsck_dir_cmp);
+        fsck.queue = (int*)malloc((fsck.nr_dirs + 1) * sizeof(int));
+        if (fsck.queue == NULL) {
+            ret = -NFS_ERROR_NOSPACE;
+        }
+        else if (newfs_fsck_find_dir(NFS_ROOT_INO) == NULL) {
+            newfs_fsck_error("根目录inode %d损坏或不是目录", NFS_ROOT_INO);
+        }
+        else {
+            fsck.state[NFS_ROOT_INO] |= NFS_FSCK_REACHED;
+            newfs_fsck_enqueue(newfs_fsck_find_dir(NFS_ROOT_INO));
+            newfs_fsck_run(newfs_fsck_walk_worker, nr_threads);      /* 第3步 */
+        }
+        if (ret == NFS_ERROR_NONE) {
+            newfs_fsck_compare(report);                              /* 第4步 */
+        }
+        report->dirs   = fsck.visited;
+        report->errors = fsck.errors;
+    }
+
+    for (i = 0; i < fsck.nr_dirs; i++) {
+        free(fsck.dirs[i].blks);
+    }
+    free(fsck.dirs);
+    free(fsck.queue);
+    free(fsck.ino_bits);
+    free(fsck.data_bits);
+    free(fsck.used);
+    free(fsck.state);
+    if (fsck.cached) {
+        newfs_cache_destroy();
+    }
+    newfs_bdev_close();
+    newfs_lock_destroy();
+    pthread_cond_destroy(&fsck.cond);
+    pthread_mutex_destroy(&fsck.lock);
+    return ret;
+}
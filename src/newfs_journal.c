@@ -0,0 +1,186 @@
+#include "../include/newfs.h"
+
+extern struct newfs_super      super;
+
+/*
+ * 元数据日志（write-ahead journal），位于数据区之后的NFS_JOURNAL_BLKS个块
+ *
+ * | 描述块 newfs_journal_d + blks[] | 块1 | 块2 | ... | 块cnt |
+ *
+ * 1. 元数据（super、位图、inode块、目录项块、溢出extent块）经newfs_driver_write_meta写入块缓存，
+ *    newfs_cache_flush时先把这些块的完整内容顺序追加到日志区，最后写描述块作为提交记录，
+ *    之后才写回原位；普通文件数据在提交之前写回（ordered）
+ * 2. 修改操作只计数，累计NFS_JOURNAL_BATCH个后由newfs_writeback_balance调用newfs_sync_fs组提交一次
+ * 3. 挂载时若描述块有效（magic、校验和正确且cnt > 0）则将日志中的块重放到原位；
+ *    重放是幂等的，正常卸载后写cnt = 0的描述块，下次挂载不再重放
+ * 4. 一次flush的元数据超过日志容量时分批提交，每批原位写回落盘后才提交下一批；
+ *    每批各自原子，整次flush不是原子的
+ */
+static uint32_t newfs_journal_csum(uint32_t h, const uint8_t* data, int len) {
+    int i;
+    for (i = 0; i < len; i++) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    return h;
+}
+
+static int newfs_journal_blk() {
+    return super.journal_offset / NFS_BLK_SZ();
+}
+/**
+ * @brief 一次提交最多包含的块数，未启用日志返回0
+ *
+ * @return int
+ */
+int newfs_journal_capacity() {
+    if (super.journal_blks <= 1) {
+        return 0;
+    }
+    return super.journal_blks - 1 < NFS_JOURNAL_CAP() ? super.journal_blks - 1 : NFS_JOURNAL_CAP();
+}
+/**
+ * @brief 写描述块
+ *
+ * @param blks 各块的原位块号
+ * @param cnt
+ * @param csum
+ * @return int
+ */
+static int newfs_journal_write_desc(const int* blks, int cnt, uint32_t csum) {
+    struct newfs_journal_d* desc = (struct newfs_journal_d*)calloc(1, NFS_BLK_SZ());
+    int ret;
+    if (desc == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    desc->magic = NFS_JOURNAL_MAGIC;
+    desc->seq   = super.journal_seq;
+    desc->cnt   = cnt;
+    desc->csum  = csum;
+    memcpy((uint8_t *)desc + sizeof(struct newfs_journal_d), blks, cnt * sizeof(int));
+    ret = newfs_dev_write(newfs_journal_blk(), (uint8_t *)desc, 1);
+    free(desc);
+    return ret;
+}
+/**
+ * @brief 提交一个事务：将bufs的内容顺序写入日志区，再写描述块
+ * 返回后即可将这些块写回原位
+ *
+ * @param bufs 脏元数据块，个数不超过newfs_journal_capacity()
+ * @param n
+ * @return int
+ */
+int newfs_journal_commit(struct newfs_buf** bufs, int n) {
+    int*     blks;
+    uint32_t csum;
+    int      i;
+
+    if (newfs_journal_capacity() == 0 || n == 0) {
+        return NFS_ERROR_NONE;
+    }
+    blks = (int*)malloc(n * sizeof(int));
+    if (blks == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    super.journal_seq++;
+    csum = newfs_journal_csum(2166136261u, (uint8_t *)&super.journal_seq, sizeof(uint32_t));
+    csum = newfs_journal_csum(csum, (uint8_t *)&n, sizeof(int));
+    if (newfs_dev_write_bufs(newfs_journal_blk() + 1, bufs, n) != NFS_ERROR_NONE) {
+        free(blks);                                 /* 日志区内顺序写，一批提交 */
+        return -NFS_ERROR_IO;
+    }
+    for (i = 0; i < n; i++) {
+        blks[i] = bufs[i]->blk;
+        csum = newfs_journal_csum(csum, bufs[i]->data, NFS_BLK_SZ());
+    }
+    csum = newfs_journal_csum(csum, (uint8_t *)blks, n * sizeof(int));
+    if (newfs_bdev_sync() != NFS_ERROR_NONE) {      /* 数据块与日志块先于提交记录落盘 */
+        free(blks);
+        return -NFS_ERROR_IO;
+    }
+    i = newfs_journal_write_desc(blks, n, csum);   /* 提交记录 */
+    free(blks);
+    if (i == NFS_ERROR_NONE && newfs_bdev_sync() != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;                       /* 提交记录落盘后才能写回原位 */
+    }
+    return i;
+}
+/**
+ * @brief 标记日志已全部写回原位，下次挂载无需重放
+ *
+ * @return int
+ */
+int newfs_journal_clean() {
+    if (newfs_journal_capacity() == 0) {
+        return NFS_ERROR_NONE;
+    }
+    return newfs_journal_write_desc(NULL, 0, 0);
+}
+/**
+ * @brief 挂载时重放最近一次提交的事务，需在super.journal_offset/journal_blks确定后、
+ * 读取位图与inode之前调用；重放的块经块缓存写回原位
+ *
+ * @return int
+ */
+int newfs_journal_replay() {
+    struct newfs_journal_d* desc;
+    uint8_t*                data = NULL;
+    int*                    blks;
+    uint32_t                csum;
+    int                     i, ret = NFS_ERROR_NONE;
+
+    super.journal_seq = 0;
+    if (newfs_journal_capacity() == 0) {
+        return NFS_ERROR_NONE;
+    }
+    desc = (struct newfs_journal_d*)malloc(NFS_BLK_SZ());
+    if (desc == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    if (newfs_dev_read(newfs_journal_blk(), (uint8_t *)desc, 1) != NFS_ERROR_NONE) {
+        free(desc);
+        return -NFS_ERROR_IO;
+    }
+    if (desc->magic != NFS_JOURNAL_MAGIC || desc->cnt <= 0 || desc->cnt > newfs_journal_capacity()) {
+        super.journal_seq = desc->magic == NFS_JOURNAL_MAGIC ? desc->seq : 0;
+        free(desc);
+        return NFS_ERROR_NONE;                      /* 没有未写回的事务 */
+    }
+    blks = (int*)((uint8_t *)desc + sizeof(struct newfs_journal_d));
+    data = (uint8_t *)malloc(NFS_BLKS_SZ(desc->cnt));
+    if (data == NULL || newfs_dev_read(newfs_journal_blk() + 1, data, desc->cnt) != NFS_ERROR_NONE) {
+        free(data);
+        free(desc);
+        return -NFS_ERROR_IO;
+    }
+    csum = newfs_journal_csum(2166136261u, (uint8_t *)&desc->seq, sizeof(uint32_t));
+    csum = newfs_journal_csum(csum, (uint8_t *)&desc->cnt, sizeof(int));
+    csum = newfs_journal_csum(csum, data, NFS_BLKS_SZ(desc->cnt));
+    csum = newfs_journal_csum(csum, (uint8_t *)blks, desc->cnt * sizeof(int));
+    super.journal_seq = desc->seq;
+    if (csum == desc->csum) {                       /* 校验失败说明提交记录未写完，事务作废 */
+        for (i = 0; i < desc->cnt && ret == NFS_ERROR_NONE; i++) {
+            ret = newfs_driver_write(NFS_BLKS_SZ(blks[i]), data + NFS_BLKS_SZ(i), NFS_BLK_SZ());
+        }
+        if (ret == NFS_ERROR_NONE) {
+            ret = newfs_cache_flush();
+        }
+    }
+    if (ret == NFS_ERROR_NONE) {
+        ret = newfs_journal_clean();
+    }
+    free(data);
+    free(desc);
+    return ret;
+}
+/**
+ * @brief 记录一次修改操作，累计NFS_JOURNAL_BATCH次后由newfs_writeback_balance组提交
+ *
+ */
+void newfs_journal_note_op() {
+    pthread_mutex_lock(&super.dirty_lock);
+    if (super.dirty_since == 0) {
+        super.dirty_since = time(NULL);             /* 由回写线程在flush_age秒内提交 */
+    }
+    super.journal_ops++;
+    pthread_mutex_unlock(&super.dirty_lock);
+}
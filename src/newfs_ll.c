@@ -0,0 +1,570 @@
+#include "../include/newfs.h"
+#include <fuse/fuse_lowlevel.h>
+
+extern struct newfs_super      super;
+extern struct custom_options   newfs_options;
+
+/*
+ * 低层FUSE前端（fuse_lowlevel_ops），以--lowlevel挂载时代替newfs.c中基于路径的前端
+ *
+ * 1. 内核以inode号调用各操作：fuse_ino_t = newfs ino + 1，根目录即FUSE_ROOT_ID；
+ *    经super.inode_table（newfs_ino_inode）直接取得inode，不解析路径，也不使用路径缓存
+ * 2. lookup、mknod、mkdir每回复一个entry，inode引用数加1，forget按内核给出的次数减去；
+ *    删除时仍被引用（含打开的句柄）的inode保留到引用数归零（newfs_inode_put）
+ * 3. --entry_timeout/--attr_timeout（秒）控制内核缓存目录项与属性的时间，
+ *    只有本前端修改文件系统，缓存不会失效，可以设得较长
+ * 4. 操作本身由newfs_ops.c实现，加锁与newfs.c相同，见newfs_lock.c
+ */
+static struct fuse_session* ll_session;
+
+static fuse_ino_t newfs_ll_ino(struct newfs_inode* inode) {
+    return (fuse_ino_t)inode->ino + FUSE_ROOT_ID - NFS_ROOT_INO;
+}
+
+static struct newfs_inode* newfs_ll_inode(fuse_ino_t ino) {
+    return newfs_ino_inode((int)(ino - FUSE_ROOT_ID + NFS_ROOT_INO));
+}
+
+static struct newfs_inode* newfs_ll_fi_inode(fuse_ino_t ino, struct fuse_file_info* fi) {
+    if (fi != NULL && fi->fh != 0) {
+        return ((struct file_info *)(uintptr_t)fi->fh)->inode;
+    }
+    return newfs_ll_inode(ino);
+}
+/**
+ * @brief 修改操作释放super.fs_lock后按需组提交
+ *
+ * @param ret 操作的返回值
+ * @return int
+ */
+static int newfs_ll_balanced(int ret) {
+    if (ret >= 0 && newfs_writeback_balance() != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    return ret;
+}
+/**
+ * @brief 填充回复给内核的entry并增加inode引用数，调用者共享持有super.fs_lock
+ *
+ * @param inode
+ * @param e
+ */
+static void newfs_ll_entry(struct newfs_inode* inode, struct fuse_entry_param* e) {
+    memset(e, 0, sizeof(struct fuse_entry_param));
+    e->ino           = newfs_ll_ino(inode);
+    e->attr_timeout  = newfs_options.attr_timeout;
+    e->entry_timeout = newfs_options.entry_timeout;
+    newfs_do_getattr(inode, &e->attr);
+    e->attr.st_ino   = e->ino;
+    newfs_inode_get(inode, 1);                      /* 由forget释放 */
+}
+/**
+ * @brief 回复entry；请求已被中断时内核不会记录这次lookup，撤销引用
+ *
+ * @param req
+ * @param e
+ */
+static void newfs_ll_reply_entry(fuse_req_t req, struct fuse_entry_param* e) {
+    struct newfs_inode* inode;
+    if (fuse_reply_entry(req, e) != 0) {
+        pthread_rwlock_rdlock(&super.fs_lock);
+        inode = newfs_ll_inode(e->ino);
+        if (inode != NULL) {
+            newfs_inode_put(inode, 1);
+        }
+        pthread_rwlock_unlock(&super.fs_lock);
+    }
+}
+
+static void newfs_ll_init(void* userdata, struct fuse_conn_info* conn) {
+    (void)userdata;
+#ifdef FUSE_CAP_SPLICE_READ
+    conn->want |= conn->capable & (FUSE_CAP_SPLICE_READ | FUSE_CAP_SPLICE_WRITE);
+#endif
+    if (newfs_mount(newfs_options) != NFS_ERROR_NONE ||
+        newfs_writeback_start(newfs_options) != NFS_ERROR_NONE) {
+        fuse_session_exit(ll_session);
+    }
+}
+
+static void newfs_ll_destroy(void* userdata) {
+    (void)userdata;
+    newfs_writeback_stop();                         /* 先停止回写线程，再同步并卸载 */
+    newfs_umount();
+}
+
+static void newfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char* name) {
+    struct fuse_entry_param e;
+    struct newfs_inode*  dir;
+    struct newfs_inode*  inode  = NULL;
+    struct newfs_dentry* dentry = NULL;
+
+    pthread_rwlock_rdlock(&super.fs_lock);
+    dir = newfs_ll_inode(parent);
+    if (dir != NULL && NFS_IS_DIR(dir)) {
+        pthread_rwlock_rdlock(&dir->lock);
+        dentry = newfs_dir_find(dir, name, strlen(name));
+        pthread_rwlock_unlock(&dir->lock);
+    }
+    if (dentry != NULL) {
+        inode = newfs_dentry_inode(dentry);         /* 未读入时读入 */
+    }
+    if (inode != NULL) {
+        newfs_ll_entry(inode, &e);
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+
+    if (inode == NULL) {
+        fuse_reply_err(req, NFS_ERROR_NOTFOUND);
+        return;
+    }
+    newfs_ll_reply_entry(req, &e);
+}
+
+static void newfs_ll_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup) {
+    struct newfs_inode* inode;
+
+    pthread_rwlock_rdlock(&super.fs_lock);
+    inode = newfs_ll_inode(ino);
+    if (inode != NULL) {
+        newfs_inode_put(inode, (int)nlookup);
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+    newfs_ll_balanced(NFS_ERROR_NONE);
+    fuse_reply_none(req);
+}
+
+static void newfs_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    struct newfs_inode* inode;
+    struct stat         st;
+    int                 ret = -NFS_ERROR_NOTFOUND;
+
+    pthread_rwlock_rdlock(&super.fs_lock);
+    inode = newfs_ll_fi_inode(ino, fi);
+    if (inode != NULL) {
+        ret = newfs_do_getattr(inode, &st);
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+
+    if (ret != NFS_ERROR_NONE) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+    st.st_ino = ino;
+    fuse_reply_attr(req, &st, newfs_options.attr_timeout);
+}
+/**
+ * @brief 只支持改变大小（truncate/ftruncate），其余属性不保存，忽略
+ *
+ */
+static void newfs_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat* attr, int to_set,
+                             struct fuse_file_info* fi) {
+    struct newfs_inode* inode;
+    struct stat         st;
+    int                 ret = -NFS_ERROR_NOTFOUND;
+
+    pthread_rwlock_rdlock(&super.fs_lock);
+    inode = newfs_ll_fi_inode(ino, fi);
+    if (inode != NULL) {
+        ret = NFS_ERROR_NONE;
+        if (to_set & FUSE_SET_ATTR_SIZE) {
+            ret = newfs_do_truncate(inode, attr->st_size);
+        }
+        if (ret == NFS_ERROR_NONE) {
+            ret = newfs_do_getattr(inode, &st);
+        }
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+
+    ret = (to_set & FUSE_SET_ATTR_SIZE) ? newfs_ll_balanced(ret) : ret;
+    if (ret != NFS_ERROR_NONE) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+    st.st_ino = ino;
+    fuse_reply_attr(req, &st, newfs_options.attr_timeout);
+}
+/**
+ * @brief mknod与mkdir共用
+ *
+ */
+static void newfs_ll_create_entry(fuse_req_t req, fuse_ino_t parent, const char* name,
+                                  NFS_FILE_TYPE ftype) {
+    struct fuse_entry_param e;
+    struct newfs_inode*  dir;
+    struct newfs_dentry* dentry;
+    int                  ret = -NFS_ERROR_NOTFOUND;
+
+    if (strlen(name) >= NFS_MAX_FILE_NAME) {
+        fuse_reply_err(req, NFS_ERROR_NAMETOOLONG);
+        return;
+    }
+    pthread_rwlock_rdlock(&super.fs_lock);
+    dir = newfs_ll_inode(parent);
+    if (dir != NULL) {
+        ret = newfs_do_create(dir->dentry, name, ftype, NULL, &dentry);
+    }
+    if (ret == NFS_ERROR_NONE) {
+        newfs_ll_entry(dentry->inode, &e);
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+
+    ret = newfs_ll_balanced(ret);
+    if (ret != NFS_ERROR_NONE) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+    newfs_ll_reply_entry(req, &e);
+}
+
+static void newfs_ll_mknod(fuse_req_t req, fuse_ino_t parent, const char* name, mode_t mode,
+                           dev_t rdev) {
+    (void)rdev;
+    if (!S_ISREG(mode)) {
+        fuse_reply_err(req, NFS_ERROR_UNSUPPORTED);
+        return;
+    }
+    newfs_ll_create_entry(req, parent, name, NFS_REG_FILE);
+}
+
+static void newfs_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char* name, mode_t mode) {
+    (void)mode;
+    newfs_ll_create_entry(req, parent, name, NFS_DIR);
+}
+/**
+ * @brief 独占持有super.fs_lock查找parent下的name，删除与改名使用
+ *
+ * @return struct newfs_dentry* 找不到时为NULL
+ */
+static struct newfs_dentry* newfs_ll_find(fuse_ino_t parent, const char* name) {
+    struct newfs_inode*  dir = newfs_ll_inode(parent);
+    struct newfs_dentry* dentry;
+    if (dir == NULL || !NFS_IS_DIR(dir)) {
+        return NULL;
+    }
+    dentry = newfs_dir_find(dir, name, strlen(name));
+    if (dentry != NULL && newfs_dentry_inode(dentry) == NULL) {
+        return NULL;
+    }
+    return dentry;
+}
+
+static void newfs_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char* name) {
+    struct newfs_dentry* dentry;
+    int                  ret = -NFS_ERROR_NOTFOUND;
+
+    pthread_rwlock_wrlock(&super.fs_lock);
+    dentry = newfs_ll_find(parent, name);
+    if (dentry != NULL) {
+        ret = newfs_do_unlink(dentry);
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+    fuse_reply_err(req, -newfs_ll_balanced(ret));
+}
+
+static void newfs_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char* name) {
+    struct newfs_dentry* dentry;
+    int                  ret = -NFS_ERROR_NOTFOUND;
+
+    pthread_rwlock_wrlock(&super.fs_lock);
+    dentry = newfs_ll_find(parent, name);
+    if (dentry != NULL) {
+        if (!NFS_IS_DIR(dentry->inode)) {
+            ret = -NFS_ERROR_NOTDIR;
+        }
+        else if (dentry->inode->dir_cnt > 0) {      /* 内核逐个删除子项，不递归 */
+            ret = -NFS_ERROR_NOTEMPTY;
+        }
+        else {
+            ret = newfs_rmdir_rs(dentry->inode);
+            newfs_journal_note_op();
+        }
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+    fuse_reply_err(req, -newfs_ll_balanced(ret));
+}
+
+static void newfs_ll_rename(fuse_req_t req, fuse_ino_t parent, const char* name,
+                            fuse_ino_t newparent, const char* newname) {
+    struct newfs_dentry* dentry;
+    struct newfs_dentry* cursor;
+    struct newfs_inode*  new_dir;
+    int                  ret = -NFS_ERROR_NOTFOUND;
+
+    if (strlen(newname) >= NFS_MAX_FILE_NAME) {
+        fuse_reply_err(req, NFS_ERROR_NAMETOOLONG);
+        return;
+    }
+    pthread_rwlock_wrlock(&super.fs_lock);
+    dentry  = newfs_ll_find(parent, name);
+    new_dir = newfs_ll_inode(newparent);
+    if (dentry != NULL && new_dir != NULL) {
+        ret = NFS_ERROR_NONE;
+        if (!NFS_IS_DIR(new_dir)) {
+            ret = -NFS_ERROR_NOTDIR;
+        }
+        else if (newfs_dir_find(new_dir, newname, strlen(newname)) != NULL) {
+            ret = dentry->parent->inode == new_dir && strcmp(name, newname) == 0 ?
+                  NFS_ERROR_NONE : -NFS_ERROR_EXISTS;
+            dentry = NULL;
+        }
+        for (cursor = new_dir->dentry; ret == NFS_ERROR_NONE && dentry != NULL && cursor != NULL;
+             cursor = cursor->parent) {
+            if (cursor == dentry) {                 /* 不能移到自己的子目录下 */
+                ret = -NFS_ERROR_INVAL;
+            }
+        }
+        if (ret == NFS_ERROR_NONE && dentry != NULL) {
+            ret = newfs_do_rename(dentry, new_dir->dentry, newname);
+        }
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+    fuse_reply_err(req, -newfs_ll_balanced(ret));
+}
+/**
+ * @brief open与opendir共用
+ *
+ */
+static void newfs_ll_open_type(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi,
+                               boolean is_dir) {
+    struct newfs_inode* inode;
+    int                 ret = -NFS_ERROR_NOTFOUND;
+
+    pthread_rwlock_rdlock(&super.fs_lock);
+    inode = newfs_ll_inode(ino);
+    if (inode != NULL) {
+        if (is_dir && !NFS_IS_DIR(inode)) {
+            ret = -NFS_ERROR_NOTDIR;
+        }
+        else if (!is_dir && NFS_IS_DIR(inode)) {
+            ret = -NFS_ERROR_ISDIR;
+        }
+        else {
+            ret = newfs_do_open(inode, fi);
+        }
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+
+    if (ret != NFS_ERROR_NONE) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+    if (fuse_reply_open(req, fi) != 0) {            /* 请求已被中断，不会有release */
+        pthread_rwlock_rdlock(&super.fs_lock);
+        newfs_do_release(fi);
+        pthread_rwlock_unlock(&super.fs_lock);
+    }
+}
+
+static void newfs_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    newfs_ll_open_type(req, ino, fi, FALSE);
+}
+
+static void newfs_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    newfs_ll_open_type(req, ino, fi, TRUE);
+}
+
+/**
+ * @brief 回复的数据直接取自文件页：回复完成前一直持有fs_lock与inode->lock，
+ * 内核支持splice时页内存经管道送入内核，用户态不再拷贝
+ *
+ */
+static void newfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                          struct fuse_file_info* fi) {
+    struct newfs_inode* inode;
+    struct fuse_bufvec* bufv = NULL;
+    int                 ret  = -NFS_ERROR_NOTFOUND;
+
+    pthread_rwlock_rdlock(&super.fs_lock);
+    inode = newfs_ll_fi_inode(ino, fi);
+    if (inode != NULL) {
+        ret = newfs_do_read_buf(inode, &bufv, size, off);
+    }
+    if (ret >= 0) {
+        fuse_reply_data(req, bufv, 0);
+        newfs_do_read_buf_end(inode, bufv);
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+
+    if (ret == -NFS_ERROR_SEEK) {                   /* 越过文件末尾读到0字节 */
+        fuse_reply_buf(req, NULL, 0);
+    }
+    else if (ret < 0) {
+        fuse_reply_err(req, -ret);
+    }
+}
+
+/**
+ * @brief 数据从请求buf（内核开启splice时是管道）直接拷贝进文件页
+ *
+ */
+static void newfs_ll_write_buf(fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec* bufv, off_t off,
+                               struct fuse_file_info* fi) {
+    struct newfs_inode* inode;
+    int                 ret = -NFS_ERROR_NOTFOUND;
+
+    pthread_rwlock_rdlock(&super.fs_lock);
+    inode = newfs_ll_fi_inode(ino, fi);
+    if (inode != NULL) {
+        ret = newfs_do_write_buf(inode, bufv, off);
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+
+    ret = newfs_ll_balanced(ret);
+    if (ret < 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+    fuse_reply_write(req, ret);
+}
+
+static void newfs_ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    (void)ino;
+    (void)fi;
+    newfs_writeback_kick();                         /* close时不等待写回 */
+    fuse_reply_err(req, 0);
+}
+
+static void newfs_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    int ret;
+    (void)ino;
+    pthread_rwlock_rdlock(&super.fs_lock);
+    ret = newfs_do_release(fi);
+    pthread_rwlock_unlock(&super.fs_lock);
+    fuse_reply_err(req, -newfs_ll_balanced(ret));
+}
+
+static void newfs_ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync,
+                           struct fuse_file_info* fi) {
+    int ret;
+    (void)ino;
+    (void)datasync;
+    (void)fi;
+    pthread_rwlock_wrlock(&super.fs_lock);
+    ret = newfs_sync_fs();
+    pthread_rwlock_unlock(&super.fs_lock);
+    fuse_reply_err(req, ret == NFS_ERROR_NONE ? 0 : NFS_ERROR_IO);
+}
+
+struct newfs_ll_dirbuf {
+    fuse_req_t req;
+    char*      buf;
+    size_t     size;
+    size_t     pos;
+};
+/**
+ * @brief newfs_do_readdir的filler：把目录项编码进回复buffer，放不下时返回1
+ *
+ */
+static int newfs_ll_fill(void* buf, const char* name, const struct stat* stbuf, off_t off) {
+    struct newfs_ll_dirbuf* db = (struct newfs_ll_dirbuf *)buf;
+    struct stat             st = *stbuf;
+    size_t                  ent;
+
+    st.st_ino = st.st_ino + FUSE_ROOT_ID - NFS_ROOT_INO;
+    ent = fuse_add_direntry(db->req, db->buf + db->pos, db->size - db->pos, name, &st, off);
+    if (ent > db->size - db->pos) {
+        return 1;
+    }
+    db->pos += ent;
+    return 0;
+}
+
+static void newfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                             struct fuse_file_info* fi) {
+    struct newfs_ll_dirbuf db;
+    struct newfs_inode*    inode;
+    int                    ret = -NFS_ERROR_NOTFOUND;
+
+    db.req  = req;
+    db.buf  = (char *)malloc(size);
+    db.size = size;
+    db.pos  = 0;
+    if (db.buf == NULL) {
+        fuse_reply_err(req, NFS_ERROR_NOSPACE);
+        return;
+    }
+    pthread_rwlock_rdlock(&super.fs_lock);
+    inode = newfs_ll_fi_inode(ino, fi);
+    if (inode != NULL) {
+        ret = newfs_do_readdir(inode, &db, newfs_ll_fill, off,
+                               (struct file_info *)(uintptr_t)fi->fh);
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+
+    if (ret != NFS_ERROR_NONE) {
+        fuse_reply_err(req, -ret);
+    }
+    else {
+        fuse_reply_buf(req, db.buf, db.pos);
+    }
+    free(db.buf);
+}
+
+static void newfs_ll_access(fuse_req_t req, fuse_ino_t ino, int mask) {
+    struct newfs_inode* inode;
+    (void)mask;
+    pthread_rwlock_rdlock(&super.fs_lock);
+    inode = newfs_ll_inode(ino);
+    pthread_rwlock_unlock(&super.fs_lock);
+    fuse_reply_err(req, inode != NULL ? 0 : NFS_ERROR_NOTFOUND);
+}
+
+static struct fuse_lowlevel_ops newfs_ll_ops = {
+    .init       = newfs_ll_init,
+    .destroy    = newfs_ll_destroy,
+    .lookup     = newfs_ll_lookup,
+    .forget     = newfs_ll_forget,
+    .getattr    = newfs_ll_getattr,
+    .setattr    = newfs_ll_setattr,
+    .mknod      = newfs_ll_mknod,
+    .mkdir      = newfs_ll_mkdir,
+    .unlink     = newfs_ll_unlink,
+    .rmdir      = newfs_ll_rmdir,
+    .rename     = newfs_ll_rename,
+    .open       = newfs_ll_open,
+    .read       = newfs_ll_read,
+    .write_buf  = newfs_ll_write_buf,
+    .flush      = newfs_ll_flush,
+    .release    = newfs_ll_release,
+    .fsync      = newfs_ll_fsync,
+    .opendir    = newfs_ll_opendir,
+    .readdir    = newfs_ll_readdir,
+    .releasedir = newfs_ll_release,
+    .access     = newfs_ll_access,
+};
+/**
+ * @brief 低层前端入口，main解析出--lowlevel后调用
+ *
+ * @param args 已去掉newfs自有选项的命令行参数
+ * @return int 0成功
+ */
+int newfs_ll_main(struct fuse_args* args) {
+    struct fuse_chan* ch;
+    char*             mountpoint;
+    int               multithreaded, foreground;
+    int               err = -1;
+
+    if (fuse_parse_cmdline(args, &mountpoint, &multithreaded, &foreground) == -1) {
+        return 1;
+    }
+    ch = fuse_mount(mountpoint, args);
+    if (ch != NULL) {
+        ll_session = fuse_lowlevel_new(args, &newfs_ll_ops, sizeof(newfs_ll_ops), NULL);
+        if (ll_session != NULL) {
+            if (fuse_set_signal_handlers(ll_session) != -1) {
+                fuse_session_add_chan(ll_session, ch);
+                if (fuse_daemonize(foreground) != -1) {
+                    err = multithreaded ? fuse_session_loop_mt(ll_session)
+                                        : fuse_session_loop(ll_session);
+                }
+                fuse_remove_signal_handlers(ll_session);
+                fuse_session_remove_chan(ch);
+            }
+            fuse_session_destroy(ll_session);
+        }
+        fuse_unmount(mountpoint, ch);
+    }
+    free(mountpoint);
+    return err ? 1 : 0;
+}
@@ -0,0 +1,77 @@
+#define _GNU_SOURCE                             /* pthread_rwlockattr_setkind_np */
+#include "../include/newfs.h"
+
+extern struct newfs_super      super;
+
+/*
+ * 加锁模型
+ *
+ * FUSE默认多线程调用各操作，另有后台回写线程。锁按以下顺序获取，只能由上往下：
+ *
+ * 1. super.fs_lock（读写锁，写者优先）
+ *    - 共享：getattr、fgetattr、access、open、opendir、readdir、read、write、truncate、ftruncate、
+ *      mknod、mkdir、release
+ *    - 独占：unlink、rmdir、rename（会释放dentry/inode），以及newfs_sync_fs（fsync、组提交、回写线程）
+ *    共享持有期间命名空间只增不减，newfs_lookup返回的dentry一直有效，查找路径不需要引用计数；
+ *    句柄（fi->fh）与低层前端内核lookup持有的inode由inode->ref_cnt保护，删除仍被引用的
+ *    inode只标记orphan，引用数归零时在共享持有下释放它（已不在目录树中，没有其他操作能访问）
+ *    低层前端（newfs_ll.c）的lookup、forget与release同样共享持有
+ * 2. inode->lock（读写锁）
+ *    - 目录：读锁下查找子项（newfs_dir_find）与readdir；写锁下增加子项、按需读入子项inode
+ *    - 文件：读锁下读已载入的页；需要读盘载入页、write、truncate持写锁
+ *    newfs_lookup逐级持有目录读锁，同一时刻只持有一个；创建持有父目录写锁
+ *    独占持有fs_lock时没有其他操作在运行，不再获取inode锁
+ * 3. 叶子锁，持有期间不获取其他锁（块缓存锁可重入）：
+ *    - super.alloc_lock：位图分配与释放（newfs_bitmap.c）
+ *    - super.dirty_lock：脏inode链表、脏页计数、日志操作计数
+ *    - 路径缓存锁（newfs_dcache.c）、块缓存锁（newfs_cache.c，覆盖整个newfs_driver_read/write）
+ *
+ * 路径缓存的负项在持有父目录读锁时插入，创建在持有父目录写锁时使其失效，二者不会交错
+ */
+/**
+ * @brief 初始化super中的锁，挂载时调用
+ *
+ */
+void newfs_lock_init() {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);  /* 同步不被持续的读饿死 */
+#endif
+    pthread_rwlock_init(&super.fs_lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    pthread_mutex_init(&super.alloc_lock, NULL);
+    pthread_mutex_init(&super.dirty_lock, NULL);
+}
+/**
+ * @brief 销毁super中的锁，卸载时调用
+ *
+ */
+void newfs_lock_destroy() {
+    pthread_rwlock_destroy(&super.fs_lock);
+    pthread_mutex_destroy(&super.alloc_lock);
+    pthread_mutex_destroy(&super.dirty_lock);
+}
+/**
+ * @brief 取得dentry对应的inode，未读入时持有父目录写锁读入
+ * 调用者不能持有父目录的锁
+ *
+ * @param dentry
+ * @return struct newfs_inode*
+ */
+struct newfs_inode* newfs_dentry_inode(struct newfs_dentry* dentry) {
+    struct newfs_inode* inode = __atomic_load_n(&dentry->inode, __ATOMIC_ACQUIRE);
+    struct newfs_inode* parent;
+    if (inode != NULL || dentry->parent == NULL) {
+        return inode;
+    }
+    parent = dentry->parent->inode;
+    pthread_rwlock_wrlock(&parent->lock);
+    inode = dentry->inode;
+    if (inode == NULL) {
+        inode = newfs_read_inode(dentry, dentry->ino);
+        __atomic_store_n(&dentry->inode, inode, __ATOMIC_RELEASE);
+    }
+    pthread_rwlock_unlock(&parent->lock);
+    return inode;
+}
@@ -0,0 +1,448 @@
+#include "../include/newfs.h"
+
+extern struct newfs_super      super;
+
+/*
+ * 与前端无关的inode级操作，供路径前端（newfs.c）与低层前端（newfs_ll.c）共用
+ *
+ * 1. 参数是已经找到的inode/dentry，不解析路径；路径前端负责查找与路径缓存失效
+ * 2. 调用者按newfs_lock.c的模型持有super.fs_lock：删除与改名独占，其余共享；
+ *    inode->lock在这里获取
+ * 3. 修改操作在返回前调用newfs_journal_note_op，由前端在释放fs_lock后组提交
+ */
+/**
+ * @brief 按inode填充属性，根目录给出整个文件系统的用量
+ *
+ * @param inode
+ * @param st
+ * @return int
+ */
+int newfs_do_getattr(struct newfs_inode* inode, struct stat* st) {
+    newfs_fill_stat(inode, st);
+    if (inode == super.root_dentry->inode) {
+        st->st_size   = super.sz_usage;
+        st->st_blocks = NFS_DISK_SZ() / NFS_BLK_SZ();
+        st->st_nlink  = 2;                          /* 根目录link数为2 */
+    }
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 在目录parent下创建名为fname的文件或目录
+ *
+ * @param parent 父目录的dentry
+ * @param fname 文件名
+ * @param ftype NFS_REG_FILE或NFS_DIR
+ * @param path 完整路径，非NULL时在持有父目录写锁时使路径缓存的负项失效
+ * @param created 返回新建的dentry
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_do_create(struct newfs_dentry* parent, const char* fname, NFS_FILE_TYPE ftype,
+                    const char* path, struct newfs_dentry** created) {
+    struct newfs_inode*  dir = parent->inode;
+    struct newfs_dentry* dentry;
+    int ret;
+
+    if (!NFS_IS_DIR(dir)) {
+        return -NFS_ERROR_UNSUPPORTED;
+    }
+    if (strlen(fname) >= NFS_MAX_FILE_NAME) {       /* dentry->fname与目录项记录都放不下 */
+        return -NFS_ERROR_NAMETOOLONG;
+    }
+    pthread_rwlock_wrlock(&dir->lock);
+    if (newfs_dir_find(dir, fname, strlen(fname)) != NULL) {    /* 其他线程已创建 */
+        pthread_rwlock_unlock(&dir->lock);
+        return -NFS_ERROR_EXISTS;
+    }
+    dentry = new_dentry((char *)fname, ftype);
+    dentry->parent = parent;
+    if (newfs_alloc_inode(dentry) == NULL) {
+        pthread_rwlock_unlock(&dir->lock);
+        free(dentry);
+        return -NFS_ERROR_NOSPACE;
+    }
+    if ((ret = newfs_alloc_dentry(dir, dentry)) < 0) {       /* 目录块写满且无空闲块 */
+        newfs_drop_inode(dentry->inode);
+        pthread_rwlock_unlock(&dir->lock);
+        free(dentry);
+        return ret;
+    }
+    if (path != NULL) {
+        newfs_dcache_invalidate(path, FALSE);       /* 清除该路径的负项 */
+    }
+    pthread_rwlock_unlock(&dir->lock);
+
+    newfs_journal_note_op();                        /* 累计到一定操作数后组提交 */
+    *created = dentry;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 写入文件，只载入首尾不完整的页，涉及的页标脏
+ *
+ * @param inode
+ * @param buf
+ * @param size
+ * @param offset
+ * @return int 写入大小，否则返回对应错误号
+ */
+int newfs_do_write(struct newfs_inode* inode, const char* buf, size_t size, off_t offset) {
+    if (NFS_IS_DIR(inode)) {
+        return -NFS_ERROR_ISDIR;
+    }
+    if (offset + (off_t)size > super.file_max) {
+        return -NFS_ERROR_FBIG;
+    }
+
+    pthread_rwlock_wrlock(&inode->lock);
+    if (inode->size < offset) {
+        pthread_rwlock_unlock(&inode->lock);
+        return -NFS_ERROR_SEEK;
+    }
+    if (newfs_page_write(inode, offset, (const uint8_t *)buf, size) != NFS_ERROR_NONE) {
+        pthread_rwlock_unlock(&inode->lock);
+        return -NFS_ERROR_IO;
+    }
+    if (inode->size < offset + size) {
+        inode->size = offset + size;
+        newfs_mark_inode_dirty(inode, NFS_INODE_DIRTY);
+    }
+    pthread_rwlock_unlock(&inode->lock);
+
+    newfs_journal_note_op();                        /* 累计到一定操作数后组提交 */
+    return size;
+}
+/**
+ * @brief 读取文件，按需载入涉及的页；页都已载入时只持有读锁
+ *
+ * @param inode
+ * @param buf
+ * @param size
+ * @param offset
+ * @return int 读取大小，否则返回对应错误号
+ */
+int newfs_do_read(struct newfs_inode* inode, char* buf, size_t size, off_t offset) {
+    if (NFS_IS_DIR(inode)) {
+        return -NFS_ERROR_ISDIR;
+    }
+
+    pthread_rwlock_rdlock(&inode->lock);
+    if (!newfs_page_cached(inode, offset, size)) {  /* 需要读盘载入页，改持写锁 */
+        pthread_rwlock_unlock(&inode->lock);
+        pthread_rwlock_wrlock(&inode->lock);
+    }
+    if (inode->size < offset) {
+        pthread_rwlock_unlock(&inode->lock);
+        return -NFS_ERROR_SEEK;
+    }
+    if (offset + size > inode->size) {
+        size = inode->size - offset;
+    }
+    if (newfs_page_read(inode, offset, (uint8_t *)buf, size) != NFS_ERROR_NONE) {
+        pthread_rwlock_unlock(&inode->lock);
+        return -NFS_ERROR_IO;
+    }
+    pthread_rwlock_unlock(&inode->lock);
+    return size;
+}
+/**
+ * @brief 写入文件，数据从FUSE的buf（内存或splice管道）直接拷贝进页
+ *
+ * @param inode
+ * @param buf
+ * @param offset
+ * @return int 写入大小，否则返回对应错误号
+ */
+int newfs_do_write_buf(struct newfs_inode* inode, struct fuse_bufvec* buf, off_t offset) {
+    int ret;
+
+    if (NFS_IS_DIR(inode)) {
+        return -NFS_ERROR_ISDIR;
+    }
+    if (offset + (off_t)fuse_buf_size(buf) > super.file_max) {
+        return -NFS_ERROR_FBIG;
+    }
+
+    pthread_rwlock_wrlock(&inode->lock);
+    if (inode->size < offset) {
+        pthread_rwlock_unlock(&inode->lock);
+        return -NFS_ERROR_SEEK;
+    }
+    ret = newfs_page_write_buf(inode, offset, buf);
+    if (ret > 0 && inode->size < offset + ret) {
+        inode->size = offset + ret;
+        newfs_mark_inode_dirty(inode, NFS_INODE_DIRTY);
+    }
+    pthread_rwlock_unlock(&inode->lock);
+
+    if (ret > 0) {
+        newfs_journal_note_op();                    /* 累计到一定操作数后组提交 */
+    }
+    return ret;
+}
+/**
+ * @brief 读取文件，返回直接指向页内存的bufvec，不拷贝数据
+ * 成功时inode->lock保持持有，调用者回复内核后调用newfs_do_read_buf_end释放
+ *
+ * @param inode
+ * @param bufp
+ * @param size
+ * @param offset
+ * @return int 读取大小，否则返回对应错误号
+ */
+int newfs_do_read_buf(struct newfs_inode* inode, struct fuse_bufvec** bufp, size_t size,
+                      off_t offset) {
+    if (NFS_IS_DIR(inode)) {
+        return -NFS_ERROR_ISDIR;
+    }
+
+    pthread_rwlock_rdlock(&inode->lock);
+    if (!newfs_page_cached(inode, offset, size)) {  /* 需要读盘载入页，改持写锁 */
+        pthread_rwlock_unlock(&inode->lock);
+        pthread_rwlock_wrlock(&inode->lock);
+    }
+    if (inode->size < offset) {
+        pthread_rwlock_unlock(&inode->lock);
+        return -NFS_ERROR_SEEK;
+    }
+    if (offset + size > inode->size) {
+        size = inode->size - offset;
+    }
+    if (newfs_page_read_buf(inode, offset, size, bufp) != NFS_ERROR_NONE) {
+        pthread_rwlock_unlock(&inode->lock);
+        return -NFS_ERROR_IO;
+    }
+    return size;
+}
+/**
+ * @brief 回复完成，释放newfs_do_read_buf持有的inode->lock与bufvec
+ *
+ * @param inode
+ * @param bufv
+ */
+void newfs_do_read_buf_end(struct newfs_inode* inode, struct fuse_bufvec* bufv) {
+    pthread_rwlock_unlock(&inode->lock);
+    free(bufv);
+}
+/**
+ * @brief 改变文件大小，扩展部分补零，缩小时释放新大小之外的数据块与页
+ *
+ * @param inode
+ * @param offset 改变后文件大小
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_do_truncate(struct newfs_inode* inode, off_t offset) {
+    int used;
+
+    if (NFS_IS_DIR(inode)) {
+        return -NFS_ERROR_ISDIR;
+    }
+    if (offset > super.file_max) {
+        return -NFS_ERROR_FBIG;
+    }
+
+    pthread_rwlock_wrlock(&inode->lock);
+    if (offset > inode->size) {                     /* 未分配的块写回时补零 */
+        if (newfs_page_zero(inode, inode->size, offset) != NFS_ERROR_NONE) {
+            pthread_rwlock_unlock(&inode->lock);
+            return -NFS_ERROR_IO;
+        }
+    }
+    inode->size = offset;
+    used = (int)(NFS_ROUND_UP(inode->size, NFS_BLK_SZ()) / NFS_BLK_SZ());
+    newfs_extent_truncate(inode, used);             /* 释放新大小之外的数据块 */
+    newfs_page_truncate(inode, used);               /* 丢弃新大小之外的页 */
+    newfs_mark_inode_dirty(inode, NFS_INODE_DIRTY);
+    pthread_rwlock_unlock(&inode->lock);
+
+    newfs_journal_note_op();                        /* 累计到一定操作数后组提交 */
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 删除普通文件，仍被引用时dentry随inode保留到引用数归零
+ * 调用者独占持有super.fs_lock
+ *
+ * @param dentry
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_do_unlink(struct newfs_dentry* dentry) {
+    struct newfs_inode* inode = dentry->inode;
+    boolean is_opened;
+
+    if (NFS_IS_DIR(inode)) {
+        return -NFS_ERROR_ISDIR;
+    }
+    is_opened = newfs_inode_opened(inode);
+    newfs_drop_inode(inode);
+    newfs_drop_dentry(dentry->parent->inode, dentry);
+    if (!is_opened) {
+        free(dentry);
+    }
+
+    newfs_journal_note_op();                        /* 累计到一定操作数后组提交 */
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 递归删除目录及其下所有文件，调用者独占持有super.fs_lock
+ *
+ * @param inode 目录的inode
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_rmdir_rs(struct newfs_inode* inode) {
+    struct newfs_dentry* dentry = inode->dentry;
+    struct newfs_dentry* dentry_cursor;
+    struct newfs_dentry* old_dentry;
+    struct newfs_inode*  sub_inode;
+    boolean              is_opened;
+    int                  ret;
+
+    if (!NFS_IS_DIR(inode)) {
+        return -NFS_ERROR_UNSUPPORTED;
+    }
+
+    dentry_cursor = inode->dentrys;
+    while (dentry_cursor != NULL)
+    {
+        if (dentry_cursor->inode == NULL) {         /* 子项inode可能尚未读入 */
+            dentry_cursor->inode = newfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            if (dentry_cursor->inode == NULL) {     /* 已删除的子项保持删除，本目录保留 */
+                return -NFS_ERROR_IO;
+            }
+        }
+        sub_inode     = dentry_cursor->inode;
+        old_dentry    = dentry_cursor;
+        dentry_cursor = dentry_cursor->brother;
+        if (NFS_IS_REG(sub_inode)) {
+            is_opened = newfs_inode_opened(sub_inode);
+            newfs_drop_inode(sub_inode);
+            newfs_drop_dentry(inode, old_dentry);
+            if (!is_opened) {
+                free(old_dentry);
+            }
+        }
+        else if (NFS_IS_DIR(sub_inode) && (ret = newfs_rmdir_rs(sub_inode)) != NFS_ERROR_NONE) {
+            return ret;
+        }
+    }
+
+    is_opened = newfs_inode_opened(inode);
+    newfs_drop_inode(inode);
+    newfs_drop_dentry(dentry->parent->inode, dentry);
+    if (inode != super.root_dentry->inode && !is_opened) {
+        free(dentry);
+    }
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 将dentry移到目录new_parent下并改名为fname，调用者独占持有super.fs_lock
+ *
+ * @param dentry
+ * @param new_parent 目标目录的dentry
+ * @param fname
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_do_rename(struct newfs_dentry* dentry, struct newfs_dentry* new_parent, const char* fname) {
+    struct newfs_dentry* old_parent = dentry->parent;
+    char old_fname[NFS_MAX_FILE_NAME];
+    int  ret;
+
+    if (strlen(fname) >= NFS_MAX_FILE_NAME) {
+        return -NFS_ERROR_NAMETOOLONG;
+    }
+    memcpy(old_fname, dentry->fname, NFS_MAX_FILE_NAME);
+    newfs_drop_dentry(old_parent->inode, dentry);
+    memset(dentry->fname, 0, NFS_MAX_FILE_NAME);
+    NFS_ASSIGN_FNAME(dentry, (char *)fname);
+    dentry->parent = new_parent;
+    if ((ret = newfs_alloc_dentry(new_parent->inode, dentry)) < 0) {
+        memcpy(dentry->fname, old_fname, NFS_MAX_FILE_NAME);  /* 原记录的空间刚释放，放回原目录 */
+        dentry->parent = old_parent;
+        newfs_alloc_dentry(old_parent->inode, dentry);
+        return ret;
+    }
+
+    newfs_journal_note_op();                        /* 累计到一定操作数后组提交 */
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 为inode分配file_info存入fi->fh，并持有一个引用
+ *
+ * @param inode
+ * @param fi
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_do_open(struct newfs_inode* inode, struct fuse_file_info* fi) {
+    struct file_info* f_info = (struct file_info *)calloc(1, sizeof(struct file_info));
+    if (f_info == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    f_info->inode = inode;
+    newfs_inode_get(inode, 1);                      /* 删除后推迟到release释放 */
+    fi->fh = (uintptr_t)f_info;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 释放open/opendir分配的file_info及其引用
+ *
+ * @param fi
+ * @return int
+ */
+int newfs_do_release(struct fuse_file_info* fi) {
+    struct file_info* f_info = (struct file_info *)(uintptr_t)fi->fh;
+    if (f_info == NULL) {
+        return NFS_ERROR_NONE;
+    }
+    fi->fh = 0;
+    newfs_inode_put(f_info->inode, 1);
+    free(f_info);
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 从offset起遍历目录项，逐个交给filler，filler返回非0（buf已满）时停止
+ * 游标记在f_info中，下次从停止处继续，不必从头遍历兄弟链表
+ *
+ * @param inode 目录的inode
+ * @param buf 交给filler的buffer
+ * @param filler
+ * @param offset 第几个目录项
+ * @param f_info opendir分配的file_info，可为NULL
+ * @return int 0成功，否则返回对应错误号
+ */
+int newfs_do_readdir(struct newfs_inode* inode, void* buf, fuse_fill_dir_t filler, off_t offset,
+                     struct file_info* f_info) {
+    struct newfs_dentry* sub_dentry;
+    struct stat          sub_stat;
+
+    if (!NFS_IS_DIR(inode)) {
+        return -NFS_ERROR_NOTDIR;
+    }
+    pthread_rwlock_rdlock(&inode->lock);
+    if (f_info != NULL && f_info->inode == inode && f_info->cursor != NULL &&
+        f_info->offset == offset && f_info->cursor_gen == inode->dir_gen) {
+        sub_dentry = f_info->cursor;                /* 从上次buf填满处继续 */
+    }
+    else {
+        sub_dentry = newfs_get_dentry(inode, offset);
+    }
+    while (sub_dentry) {
+        if (sub_dentry->inode != NULL) {
+            newfs_fill_stat(sub_dentry->inode, &sub_stat);
+        }
+        else {                                      /* 未读入的子项只给出类型与inode号，不为此读盘 */
+            memset(&sub_stat, 0, sizeof(struct stat));
+            sub_stat.st_ino  = sub_dentry->ino;
+            sub_stat.st_mode = (sub_dentry->ftype == NFS_DIR ? S_IFDIR : S_IFREG) | NFS_DEFAULT_PERM;
+        }
+        if (filler(buf, sub_dentry->fname, &sub_stat, offset + 1) != 0) {
+            break;                                  /* buf已满，下次从sub_dentry继续 */
+        }
+        offset++;
+        sub_dentry = sub_dentry->brother;
+    }
+    if (f_info != NULL) {
+        f_info->inode      = inode;
+        f_info->cursor     = sub_dentry;
+        f_info->cursor_gen = inode->dir_gen;
+        f_info->offset     = offset;
+    }
+    pthread_rwlock_unlock(&inode->lock);
+    return NFS_ERROR_NONE;
+}
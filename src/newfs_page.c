@@ -0,0 +1,421 @@
+#include "../include/newfs.h"
+
+extern struct newfs_super      super;
+
+/*
+ * 文件数据页：普通文件内容按逻辑块分页，按需载入
+ *
+ * inode->pages[lblk]指向一个NFS_BLK_SZ()大小的页，未载入时为NULL
+ * inode->page_flags[lblk]记录NFS_PAGE_VALID（页内容有效）与NFS_PAGE_DIRTY（需写回）
+ * 读取inode时不读任何数据块，只有newfs_read/newfs_write/newfs_truncate触及的页才会读盘
+ * 逻辑块号不小于data_blk_cnt的页在磁盘上尚未分配，载入时直接清零；
+ * 内联文件（inode->inline_data）只有第0页，从磁盘inode记录末尾及其后inline_span - 1个槽载入，
+ * 见newfs_sync_inode
+ * 页的分配与脏标记的变化计入super.page_cnt/super.dirty_pages，供回写线程判断
+ * 调用者持有inode->lock，只有newfs_page_read在页均已载入时可以只持读锁（见newfs_page_cached）
+ */
+
+static void newfs_page_cnt_add(int delta) {
+    pthread_mutex_lock(&super.dirty_lock);
+    super.page_cnt += delta;
+    pthread_mutex_unlock(&super.dirty_lock);
+}
+
+/**
+ * @brief 保证pages与page_flags至少能容纳nblks个逻辑块
+ *
+ * @param inode
+ * @param nblks
+ * @return int
+ */
+int newfs_page_reserve(struct newfs_inode* inode, int nblks) {
+    int       cap = inode->page_cap ? inode->page_cap : 1;
+    uint8_t** pages;
+    uint8_t*  flags;
+    if (nblks <= inode->page_cap) {
+        return NFS_ERROR_NONE;
+    }
+    while (cap < nblks) {
+        cap *= 2;
+    }
+    pages = (uint8_t **)realloc(inode->pages, cap * sizeof(uint8_t *));
+    if (pages == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    inode->pages = pages;
+    flags = (uint8_t *)realloc(inode->page_flags, cap);
+    if (flags == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    inode->page_flags = flags;
+    memset(inode->pages + inode->page_cap, 0, (cap - inode->page_cap) * sizeof(uint8_t *));
+    memset(inode->page_flags + inode->page_cap, 0, cap - inode->page_cap);
+    inode->page_cap = cap;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 为逻辑块lblk分配页内存（不填充内容）
+ *
+ * @param inode
+ * @param lblk
+ * @return uint8_t* 失败返回NULL
+ */
+static uint8_t* newfs_page_alloc(struct newfs_inode* inode, int lblk) {
+    if (newfs_page_reserve(inode, lblk + 1) != NFS_ERROR_NONE) {
+        return NULL;
+    }
+    if (inode->pages[lblk] == NULL) {
+        inode->pages[lblk] = (uint8_t *)malloc(NFS_BLK_SZ());
+        if (inode->pages[lblk] != NULL) {
+            newfs_page_cnt_add(1);
+        }
+    }
+    return inode->pages[lblk];
+}
+/**
+ * @brief 标脏逻辑块lblk的页
+ *
+ * @param inode
+ * @param lblk
+ */
+static void newfs_page_dirty(struct newfs_inode* inode, int lblk) {
+    if (!(inode->page_flags[lblk] & NFS_PAGE_DIRTY)) {
+        inode->page_flags[lblk] |= NFS_PAGE_DIRTY;
+        newfs_mark_inode_dirty(inode, NFS_INODE_DIRTY);
+        newfs_writeback_account(1);
+    }
+}
+/**
+ * @brief 页已写回，清除脏标记
+ *
+ * @param inode
+ * @param lblk
+ */
+void newfs_page_clean(struct newfs_inode* inode, int lblk) {
+    if (inode->page_flags[lblk] & NFS_PAGE_DIRTY) {
+        inode->page_flags[lblk] &= ~NFS_PAGE_DIRTY;
+        newfs_writeback_account(-1);
+    }
+}
+/**
+ * @brief 释放已写回的页，下次访问时重新从磁盘载入
+ *
+ * @param inode
+ */
+void newfs_page_release_clean(struct newfs_inode* inode) {
+    int lblk;
+    for (lblk = 0; lblk < inode->page_cap; lblk++) {
+        if (inode->pages[lblk] != NULL && !(inode->page_flags[lblk] & NFS_PAGE_DIRTY)) {
+            free(inode->pages[lblk]);
+            inode->pages[lblk]      = NULL;
+            inode->page_flags[lblk] = 0;
+            newfs_page_cnt_add(-1);
+        }
+    }
+}
+/**
+ * @brief 载入逻辑块[from, to)中尚未载入的页
+ * 数据块直接读入页（newfs_cache_read_through_vec），不经块缓存中转；所有需读盘的块作为一批请求提交
+ *
+ * @param inode
+ * @param from
+ * @param to
+ * @return int
+ */
+int newfs_page_load(struct newfs_inode* inode, int from, int to) {
+    int       lblk, n = 0, ret = NFS_ERROR_NONE;
+    int*      blks;
+    uint8_t** data;
+    if (from >= to) {
+        return NFS_ERROR_NONE;
+    }
+    blks = (int *)malloc((to - from) * (sizeof(int) + sizeof(uint8_t *)));
+    if (blks == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    data = (uint8_t **)(blks + (to - from));
+    for (lblk = from; lblk < to; lblk++)
+    {
+        if (lblk < inode->page_cap && (inode->page_flags[lblk] & NFS_PAGE_VALID)) {
+            continue;
+        }
+        if (newfs_page_alloc(inode, lblk) == NULL) {
+            ret = -NFS_ERROR_NOSPACE;
+            break;
+        }
+        if (lblk >= inode->data_blk_cnt) {                 /* 磁盘上未分配 */
+            memset(inode->pages[lblk], 0, NFS_BLK_SZ());
+            if (lblk == 0 && inode->inline_data &&         /* inode块通常仍在块缓存中 */
+                newfs_driver_read(NFS_INLINE_OFS(inode->ino), inode->pages[0],
+                                  NFS_INLINE_CAP(inode->inline_span))
+                != NFS_ERROR_NONE) {
+                ret = -NFS_ERROR_IO;
+                break;
+            }
+            inode->page_flags[lblk] |= NFS_PAGE_VALID;
+            continue;
+        }
+        blks[n] = NFS_DATA_OFS(newfs_bmap(inode, lblk)) / NFS_BLK_SZ();
+        data[n] = inode->pages[lblk];
+        n++;
+    }
+    if (ret == NFS_ERROR_NONE && n > 0 &&
+        (ret = newfs_cache_read_through_vec(blks, data, n)) == NFS_ERROR_NONE) {
+        for (lblk = from; lblk < to && lblk < inode->data_blk_cnt; lblk++) {
+            inode->page_flags[lblk] |= NFS_PAGE_VALID;
+        }
+    }
+    free(blks);
+    return ret;
+}
+/**
+ * @brief 文件offset处size字节（截到文件末尾）涉及的页是否都已载入，
+ * 是则newfs_page_read不会修改inode，持读锁即可
+ *
+ * @param inode
+ * @param offset
+ * @param size
+ * @return boolean
+ */
+boolean newfs_page_cached(struct newfs_inode* inode, off_t offset, int size) {
+    int lblk, to;
+    if (offset + size > inode->size) {
+        size = (int)(inode->size - offset);
+    }
+    if (size <= 0) {
+        return TRUE;
+    }
+    to = (int)(NFS_ROUND_UP(offset + size, NFS_BLK_SZ()) / NFS_BLK_SZ());
+    for (lblk = (int)(offset / NFS_BLK_SZ()); lblk < to; lblk++) {
+        if (lblk >= inode->page_cap || !(inode->page_flags[lblk] & NFS_PAGE_VALID)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+/**
+ * @brief 从文件offset处读出size字节，只载入涉及的页
+ *
+ * @param inode
+ * @param offset
+ * @param out_content
+ * @param size
+ * @return int
+ */
+int newfs_page_read(struct newfs_inode* inode, off_t offset, uint8_t* out_content, int size) {
+    int lblk = (int)(offset / NFS_BLK_SZ());
+    int bias = (int)(offset % NFS_BLK_SZ());
+    int len;
+    if (size <= 0) {
+        return NFS_ERROR_NONE;
+    }
+    if (newfs_page_load(inode, lblk, (int)(NFS_ROUND_UP(offset + size, NFS_BLK_SZ()) / NFS_BLK_SZ()))
+        != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    while (size > 0)
+    {
+        len = NFS_BLK_SZ() - bias < size ? NFS_BLK_SZ() - bias : size;
+        memcpy(out_content, inode->pages[lblk] + bias, len);
+        out_content += len;
+        size        -= len;
+        bias         = 0;
+        lblk++;
+    }
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 准备写入逻辑块lblk的len字节：整页覆盖时只分配页，否则先载入
+ *
+ * @param inode
+ * @param lblk
+ * @param len
+ * @return int
+ */
+static int newfs_page_prepare(struct newfs_inode* inode, int lblk, int len) {
+    if (len == NFS_BLK_SZ()) {
+        if (newfs_page_alloc(inode, lblk) == NULL) {
+            return -NFS_ERROR_NOSPACE;
+        }
+        inode->page_flags[lblk] |= NFS_PAGE_VALID;
+        return NFS_ERROR_NONE;
+    }
+    return newfs_page_load(inode, lblk, lblk + 1);
+}
+/**
+ * @brief 载入文件offset处size字节涉及的页，返回直接指向页内存的fuse_bufvec，不拷贝数据
+ * 每页一段；返回的bufvec只在调用者持有inode->lock期间有效，用完后free
+ *
+ * @param inode
+ * @param offset
+ * @param size 不超过文件末尾
+ * @param bufp
+ * @return int
+ */
+int newfs_page_read_buf(struct newfs_inode* inode, off_t offset, int size, struct fuse_bufvec** bufp) {
+    int lblk = (int)(offset / NFS_BLK_SZ());
+    int bias = (int)(offset % NFS_BLK_SZ());
+    int nseg = size > 0 ? (int)(NFS_ROUND_UP(offset + size, NFS_BLK_SZ()) / NFS_BLK_SZ()) - lblk : 0;
+    int len, i;
+    struct fuse_bufvec* bufv;
+
+    if (nseg > 0 && newfs_page_load(inode, lblk, lblk + nseg) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    bufv = (struct fuse_bufvec *)calloc(1, sizeof(struct fuse_bufvec) +
+                                          (nseg > 1 ? nseg - 1 : 0) * sizeof(struct fuse_buf));
+    if (bufv == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    bufv->count = nseg;
+    for (i = 0; i < nseg; i++) {
+        len = NFS_BLK_SZ() - bias < size ? NFS_BLK_SZ() - bias : size;
+        bufv->buf[i].size = len;
+        bufv->buf[i].mem  = inode->pages[lblk + i] + bias;
+        bufv->buf[i].fd   = -1;
+        size -= len;
+        bias  = 0;
+    }
+    *bufp = bufv;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 向文件offset处写入size字节并标脏，整页覆盖的页不读盘
+ *
+ * @param inode
+ * @param offset
+ * @param in_content
+ * @param size
+ * @return int
+ */
+int newfs_page_write(struct newfs_inode* inode, off_t offset, const uint8_t* in_content, int size) {
+    int lblk = (int)(offset / NFS_BLK_SZ());
+    int bias = (int)(offset % NFS_BLK_SZ());
+    int len;
+    while (size > 0)
+    {
+        len = NFS_BLK_SZ() - bias < size ? NFS_BLK_SZ() - bias : size;
+        if (newfs_page_prepare(inode, lblk, len) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+        memcpy(inode->pages[lblk] + bias, in_content, len);
+        newfs_page_dirty(inode, lblk);
+        in_content += len;
+        size       -= len;
+        bias        = 0;
+        lblk++;
+    }
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 从FUSE给出的buf（内存或splice管道）直接拷贝到文件offset处的页并标脏，
+ * 不经中间buffer；整页覆盖的页不读盘
+ *
+ * @param inode
+ * @param offset
+ * @param buf
+ * @return int 写入的字节数，否则返回对应错误号
+ */
+int newfs_page_write_buf(struct newfs_inode* inode, off_t offset, struct fuse_bufvec* buf) {
+    int     lblk   = (int)(offset / NFS_BLK_SZ());
+    int     bias   = (int)(offset % NFS_BLK_SZ());
+    int     size   = (int)fuse_buf_size(buf);
+    int     copied = 0;
+    int     len;
+    boolean valid;
+    ssize_t ret;
+    struct fuse_bufvec dst = FUSE_BUFVEC_INIT(0);
+
+    while (size > 0)
+    {
+        len   = NFS_BLK_SZ() - bias < size ? NFS_BLK_SZ() - bias : size;
+        valid = lblk < inode->page_cap && (inode->page_flags[lblk] & NFS_PAGE_VALID);
+        if (newfs_page_prepare(inode, lblk, len) != NFS_ERROR_NONE) {
+            return copied > 0 ? copied : -NFS_ERROR_IO;
+        }
+        dst.buf[0].size = len;
+        dst.buf[0].mem  = inode->pages[lblk] + bias;
+        dst.idx = dst.off = 0;
+        ret = fuse_buf_copy(&dst, buf, 0);
+        if (ret != len) {
+            if (!valid && len == NFS_BLK_SZ()) {            /* 未载入的页没有写满，内容无效 */
+                inode->page_flags[lblk] &= ~NFS_PAGE_VALID;
+            }
+            else if (ret > 0) {
+                newfs_page_dirty(inode, lblk);
+                copied += ret;
+            }
+            return copied > 0 ? copied : -NFS_ERROR_IO;
+        }
+        newfs_page_dirty(inode, lblk);
+        copied += len;
+        size   -= len;
+        bias    = 0;
+        lblk++;
+    }
+    return copied;
+}
+/**
+ * @brief 将文件[from, to)字节清零并标脏，用于截断后扩展
+ * 只处理已载入、已在磁盘上分配或内联的块，其余块在写回时整块补零
+ *
+ * @param inode
+ * @param from
+ * @param to
+ * @return int
+ */
+int newfs_page_zero(struct newfs_inode* inode, off_t from, off_t to) {
+    int lblk = (int)(from / NFS_BLK_SZ());
+    int bias = (int)(from % NFS_BLK_SZ());
+    int len;
+    while (from < to)
+    {
+        len = NFS_BLK_SZ() - bias < to - from ? NFS_BLK_SZ() - bias : (int)(to - from);
+        if (lblk < inode->data_blk_cnt || (lblk == 0 && inode->inline_data) ||
+            (lblk < inode->page_cap && (inode->page_flags[lblk] & NFS_PAGE_VALID))) {
+            if (newfs_page_load(inode, lblk, lblk + 1) != NFS_ERROR_NONE) {
+                return -NFS_ERROR_IO;
+            }
+            memset(inode->pages[lblk] + bias, 0, len);
+            newfs_page_dirty(inode, lblk);
+        }
+        from += len;
+        bias  = 0;
+        lblk++;
+    }
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 丢弃逻辑块号不小于nblks的页
+ *
+ * @param inode
+ * @param nblks
+ */
+void newfs_page_truncate(struct newfs_inode* inode, int nblks) {
+    int lblk;
+    if (nblks == 0) {                                       /* 内联内容随之作废 */
+        inode->inline_data = FALSE;
+    }
+    for (lblk = nblks; lblk < inode->page_cap; lblk++) {
+        newfs_page_clean(inode, lblk);
+        if (inode->pages[lblk] != NULL) {
+            newfs_page_cnt_add(-1);
+        }
+        free(inode->pages[lblk]);
+        inode->pages[lblk]      = NULL;
+        inode->page_flags[lblk] = 0;
+    }
+}
+/**
+ * @brief 释放全部页
+ *
+ * @param inode
+ */
+void newfs_page_free_all(struct newfs_inode* inode) {
+    newfs_page_truncate(inode, 0);
+    free(inode->pages);
+    free(inode->page_flags);
+    inode->pages      = NULL;
+    inode->page_flags = NULL;
+    inode->page_cap   = 0;
+}
@@ -1,4 +1,5 @@
 #include "../include/newfs.h"
+#include <limits.h>
 
 extern struct newfs_super      super; 
 extern struct custom_options newfs_options;
@@ -44,113 +45,177 @@ int newfs_calc_lvl(const char * path) {
     return lvl;
 }
 /**
- * @brief find a free data block
+ * @brief find a free data block, 追加到文件末尾
  * 
  * @return int: the number of the datablock
  */
 int newfs_alloc_datab(struct newfs_inode * inode)
 {
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int data_cursor  = 0;
-    boolean is_find_free_entry = FALSE;
-
-    if (inode->data_blk_cnt == NFS_DATA_PER_FILE)
-    {
+    int data_cursor = newfs_extent_append(inode);
+    if (data_cursor < 0) {
         return -NFS_ERROR_NOSPACE;
     }
-
-    /* 检查位图是否有空位 */
-    for (byte_cursor = 0; byte_cursor < NFS_BLKS_SZ(super.ino_map_blks); 
-         byte_cursor++)
+    inode->data_blk_cnt++;
+    return data_cursor;
+}
+/**
+ * @brief 驱动读，经过块缓存，未命中的相邻块合并为一次顺序读
+ * 
+ * @param offset 
+ * @param out_content 
+ * @param size 
+ * @return int 
+ */
+int newfs_driver_read(off_t offset, uint8_t *out_content, int size) {
+    int      blk  = (int)(offset / NFS_BLK_SZ());
+    int      bias = (int)(offset % NFS_BLK_SZ());
+    int      nblks, len, i;
+    int      ret = NFS_ERROR_NONE;
+    struct newfs_buf* bufs[NFS_CACHE_BATCH];
+    newfs_cache_lock();                               /* 拷贝完成前块不能被其他线程淘汰 */
+    while (size > 0)
     {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            if((super.data_map[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                                                      /* 当前ino_cursor位置空闲 */
-                super.data_map[byte_cursor] |= (0x1 << bit_cursor);
-                is_find_free_entry = TRUE;           
-                break;
-            }
-            data_cursor++;
-        }
-        if (is_find_free_entry) {
+        nblks = NFS_ROUND_UP(bias + size, NFS_BLK_SZ()) / NFS_BLK_SZ();
+        nblks = nblks > NFS_CACHE_BATCH ? NFS_CACHE_BATCH : nblks;
+        if (newfs_cache_get_range(blk, nblks, bufs, 0, 0) != NFS_ERROR_NONE) {
+            ret = -NFS_ERROR_IO;
             break;
         }
+        for (i = 0; i < nblks && size > 0; i++) {
+            len = NFS_BLK_SZ() - bias < size ? NFS_BLK_SZ() - bias : size;
+            memcpy(out_content, bufs[i]->data + bias, len);
+            out_content += len;
+            size        -= len;
+            bias         = 0;
+        }
+        blk += nblks;
     }
-
-    if (!is_find_free_entry || data_cursor >= super.data_blks) {
-        return -NFS_ERROR_NOSPACE;
-    }
-
-    inode->block_pointer[inode->data_blk_cnt++] = data_cursor;
-    return data_cursor;
+    newfs_cache_unlock();
+    return ret;
 }
 /**
- * @brief 驱动读
+ * @brief 写入块缓存并标脏
  * 
  * @param offset 
- * @param out_content 
+ * @param in_content 
  * @param size 
+ * @param is_meta 是否为元数据，元数据写回前需经日志提交
  * @return int 
  */
-int newfs_driver_read(int offset, uint8_t *out_content, int size) {
-    // printf("%d\n", NFS_BLK_SZ());
-    int      offset_aligned = NFS_ROUND_DOWN(offset, NFS_BLK_SZ());
-    int      bias           = offset - offset_aligned;
-    int      size_aligned   = NFS_ROUND_UP((size + bias), NFS_BLK_SZ());
-    uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
-    // lseek(NFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(NFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
+static int newfs_driver_write_buf(off_t offset, uint8_t *in_content, int size, boolean is_meta) {
+    int      blk  = (int)(offset / NFS_BLK_SZ());
+    int      bias = (int)(offset % NFS_BLK_SZ());
+    int      nblks, len, i;
+    int      full_from, full_to;
+    int      ret = NFS_ERROR_NONE;
+    struct newfs_buf* bufs[NFS_CACHE_BATCH];
+    newfs_cache_lock();
+    while (size > 0)
     {
-        // read(NFS_DRIVER(), cur, NFS_IO_SZ());
-        ddriver_read(NFS_DRIVER(), cur, NFS_IO_SZ());
-        cur          += NFS_IO_SZ();
-        size_aligned -= NFS_IO_SZ();   
+        nblks = NFS_ROUND_UP(bias + size, NFS_BLK_SZ()) / NFS_BLK_SZ();
+        nblks = nblks > NFS_CACHE_BATCH ? NFS_CACHE_BATCH : nblks;
+        full_from = bias == 0 ? 0 : 1;               /* 本批中被整块覆盖的块[full_from, full_to) */
+        full_to   = (bias + size) / NFS_BLK_SZ();
+        full_to   = full_to > nblks ? nblks : full_to;
+        if (newfs_cache_get_range(blk, nblks, bufs, full_from, full_to) != NFS_ERROR_NONE) {
+            ret = -NFS_ERROR_IO;
+            break;
+        }
+        for (i = 0; i < nblks && size > 0; i++) {
+            len = NFS_BLK_SZ() - bias < size ? NFS_BLK_SZ() - bias : size;
+            memcpy(bufs[i]->data + bias, in_content, len);
+            if (is_meta) {
+                newfs_cache_mark_meta(bufs[i]);
+            }
+            else {
+                newfs_cache_mark_dirty(bufs[i]);
+            }
+            in_content += len;
+            size       -= len;
+            bias        = 0;
+        }
+        blk += nblks;
     }
-    memcpy(out_content, temp_content + bias, size);
-    free(temp_content);
-    return NFS_ERROR_NONE;
+    newfs_cache_unlock();
+    return ret;
 }
 /**
- * @brief 驱动写
+ * @brief 驱动写，只写入块缓存并标脏，由newfs_cache_flush写回
+ * 被整块覆盖的块不读盘，只有首尾不完整的块需要先读出
  * 
  * @param offset 
  * @param in_content 
  * @param size 
  * @return int 
  */
-int newfs_driver_write(int offset, uint8_t *in_content, int size) {
-    int      offset_aligned = NFS_ROUND_DOWN(offset, NFS_BLK_SZ());
-    int      bias           = offset - offset_aligned;
-    int      size_aligned   = NFS_ROUND_UP((size + bias), NFS_BLK_SZ());
-    uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
-    newfs_driver_read(offset_aligned, temp_content, size_aligned);
-    memcpy(temp_content + bias, in_content, size);
-    
-    // lseek(NFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(NFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
-    {
-        // write(NFS_DRIVER(), cur, NFS_IO_SZ());
-        ddriver_write(NFS_DRIVER(), cur, NFS_IO_SZ());
-        cur          += NFS_IO_SZ();
-        size_aligned -= NFS_IO_SZ();   
+int newfs_driver_write(off_t offset, uint8_t *in_content, int size) {
+    return newfs_driver_write_buf(offset, in_content, size, FALSE);
+}
+/**
+ * @brief 元数据驱动写，与newfs_driver_write相同，但写回原位之前先写入日志
+ * 
+ * @param offset 
+ * @param in_content 
+ * @param size 
+ * @return int 
+ */
+int newfs_driver_write_meta(off_t offset, uint8_t *in_content, int size) {
+    return newfs_driver_write_buf(offset, in_content, size, TRUE);
+}
+/**
+ * @brief 标记inode需要同步，首次标记时加入super.dirty_inodes
+ * 
+ * @param inode 
+ * @param flags NFS_INODE_DIRTY
+ */
+void newfs_mark_inode_dirty(struct newfs_inode* inode, int flags) {
+    pthread_mutex_lock(&super.dirty_lock);
+    if (inode->dirty == 0) {
+        inode->dirty_prev = NULL;
+        inode->dirty_next = super.dirty_inodes;
+        if (super.dirty_inodes) {
+            super.dirty_inodes->dirty_prev = inode;
+        }
+        super.dirty_inodes = inode;
     }
-
-    free(temp_content);
-    return NFS_ERROR_NONE;
+    inode->dirty |= flags;
+    pthread_mutex_unlock(&super.dirty_lock);
 }
 /**
- * @brief 将denry插入到inode中，采用头插法
+ * @brief 将inode移出super.dirty_inodes并清除脏标记
+ * 
+ * @param inode 
+ */
+static void newfs_clear_inode_dirty(struct newfs_inode* inode) {
+    pthread_mutex_lock(&super.dirty_lock);
+    if (inode->dirty == 0) {
+        pthread_mutex_unlock(&super.dirty_lock);
+        return;
+    }
+    if (inode->dirty_prev) {
+        inode->dirty_prev->dirty_next = inode->dirty_next;
+    }
+    else {
+        super.dirty_inodes = inode->dirty_next;
+    }
+    if (inode->dirty_next) {
+        inode->dirty_next->dirty_prev = inode->dirty_prev;
+    }
+    inode->dirty_prev = inode->dirty_next = NULL;
+    inode->dirty      = 0;
+    pthread_mutex_unlock(&super.dirty_lock);
+}
+/**
+ * @brief 将dentry头插到inode的dentrys中，同时加入目录哈希索引，不标脏
  * 
  * @param inode 
  * @param dentry 
  * @return int 
  */
-int newfs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+static int newfs_link_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    if (newfs_dir_insert(inode, dentry) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_NOSPACE;
+    }
     if (inode->dentrys == NULL) {
         inode->dentrys = dentry;
     }
@@ -159,12 +224,31 @@ int newfs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
         inode->dentrys = dentry;
     }
     inode->dir_cnt++;
-    inode->size += sizeof(struct newfs_dentry);
 
     return inode->dir_cnt;
 }
 /**
- * @brief 将dentry从inode的dentrys中取出
+ * @brief 将denry插入到inode中，采用头插法，同时加入目录哈希索引并写入目录项记录
+ * 
+ * @param inode 
+ * @param dentry 
+ * @return int 
+ */
+int newfs_alloc_dentry(struct newfs_inode* inode, struct newfs_dentry* dentry) {
+    int ret = newfs_dir_add_rec(inode, dentry);
+    if (ret != NFS_ERROR_NONE) {
+        return ret;
+    }
+    ret = newfs_link_dentry(inode, dentry);
+    if (ret < 0) {
+        newfs_dir_del_rec(inode, dentry);
+        return ret;
+    }
+    newfs_mark_inode_dirty(inode, NFS_INODE_DIRTY);
+    return ret;
+}
+/**
+ * @brief 将dentry从inode的dentrys及目录哈希索引中取出
  * 
  * @param inode 一个目录的索引结点
  * @param dentry 该目录下的一个目录项
@@ -193,42 +277,84 @@ int newfs_drop_dentry(struct newfs_inode * inode, struct newfs_dentry * dentry)
     if (!is_find) {
         return -NFS_ERROR_NOTFOUND;
     }
+    newfs_dir_remove(inode, dentry);
+    newfs_dir_del_rec(inode, dentry);
     inode->dir_cnt--;
+    inode->dir_gen++;                               /* 使该目录的readdir游标失效 */
+    newfs_mark_inode_dirty(inode, NFS_INODE_DIRTY);
     return inode->dir_cnt;
 }
+/**
+ * @brief 为新inode选择块组
+ * 普通文件放在父目录所在的组；根目录下的子目录分散到空闲inode不少于平均值、空闲块最多
+ * （相同时空闲inode最多）的组，
+ * 更深的目录在父目录所在组的空闲inode与空闲块都不少于平均值时留在该组，否则同样分散
+ *
+ * @param dentry 新inode的dentry，parent已设置
+ * @return int 目标块组
+ */
+static int newfs_inode_group(struct newfs_dentry * dentry) {
+    int64_t avg_inodes, avg_blks;
+    int     g, best = -1, parent;
+
+    if (dentry->parent == NULL || dentry->parent->inode == NULL) {
+        return 0;
+    }
+    parent = NFS_INO_GROUP(dentry->parent->inode->ino);
+    if (dentry->ftype != NFS_DIR) {
+        return parent;
+    }
+    pthread_mutex_lock(&super.alloc_lock);
+    avg_inodes = super.ino_map.nfree / super.groups;
+    avg_blks   = super.data_map.nfree / super.groups;
+    if (dentry->parent != super.root_dentry &&
+        super.ino_map.group_free[parent] >= avg_inodes &&
+        super.data_map.group_free[parent] >= avg_blks) {
+        pthread_mutex_unlock(&super.alloc_lock);
+        return parent;
+    }
+    for (g = 0; g < super.groups; g++) {
+        if (super.ino_map.group_free[g] > 0 && super.ino_map.group_free[g] >= avg_inodes &&
+            (best < 0 || super.data_map.group_free[g] > super.data_map.group_free[best] ||
+             (super.data_map.group_free[g] == super.data_map.group_free[best] &&
+              super.ino_map.group_free[g] > super.ino_map.group_free[best]))) {
+            best = g;
+        }
+    }
+    pthread_mutex_unlock(&super.alloc_lock);
+    return best < 0 ? parent : best;
+}
+/**
+ * @brief 内联内容最多可占用的inode槽数，不超过一个inode块
+ *
+ * @return int
+ */
+static int newfs_inline_max_span() {
+    int span = NFS_INLINE_SPAN(NFS_INLINE_MAX);
+    return span < NFS_INODE_PER_BLK() ? span : NFS_INODE_PER_BLK();
+}
 /**
  * @brief 分配一个inode，占用位图
+ * 普通文件优先放在其后留有空闲槽的位置，以便内联内容增长到NFS_INLINE_MAX；没有时按next-fit
  * 
  * @param dentry 该dentry指向分配的inode
  * @return newfs_inode
  */
 struct newfs_inode* newfs_alloc_inode(struct newfs_dentry * dentry) {
     struct newfs_inode* inode;
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int ino_cursor  = 0;
-    boolean is_find_free_entry = FALSE;
-    /* 检查位图是否有空位 */
-    for (byte_cursor = 0; byte_cursor < NFS_BLKS_SZ(super.ino_map_blks); 
-         byte_cursor++)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            if((super.ino_map[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                                                      /* 当前ino_cursor位置空闲 */
-                super.ino_map[byte_cursor] |= (0x1 << bit_cursor);
-                is_find_free_entry = TRUE;           
-                break;
-            }
-            ino_cursor++;
-        }
-        if (is_find_free_entry) {
-            break;
-        }
-    }
+    int group      = newfs_inode_group(dentry);
+    int ino_cursor = -1;
 
+    if (dentry->ftype == NFS_REG_FILE && newfs_inline_max_span() > 1) {
+        ino_cursor = newfs_bitmap_alloc_run(&super.ino_map, group, NFS_INODE_PER_BLK(),
+                                            newfs_inline_max_span());
+    }
+    if (ino_cursor < 0) {
+        ino_cursor = newfs_bitmap_alloc_group(&super.ino_map, group);
+    }
 
-    if (!is_find_free_entry || ino_cursor >= super.ino_max)
-        return -NFS_ERROR_NOSPACE;
+    if (ino_cursor < 0)
+        return NULL;
 
     printf("ino_cursor = %d\n", ino_cursor);
 
@@ -245,99 +371,174 @@ struct newfs_inode* newfs_alloc_inode(struct newfs_dentry * dentry) {
     inode->dir_cnt = 0;
 
     inode->data_blk_cnt = 0;
+    inode->link = 1;
 
-    for(int i = 0; i < NFS_DATA_PER_FILE; i ++) {
-        inode->block_pointer[i] = -1; // not alloc
-        inode->dirty[i] = 0;
-    }
-    
-    if (NFS_IS_REG(inode)) {
-        inode->data = (uint8_t *)malloc(NFS_BLKS_SZ(NFS_DATA_PER_FILE));
-    }
+    inode->extents     = NULL;
+    inode->ext_cnt     = 0;
+    inode->ext_cap     = 0;
+    inode->ext_blks    = NULL;
+    inode->ext_blk_cnt = 0;
+
+    inode->pages      = NULL;
+    inode->page_flags = NULL;
+    inode->page_cap   = 0;
+    inode->inline_data = FALSE;
+    inode->inline_span = 1;
+    inode->dir_hash    = NULL;
+    inode->dir_hash_sz = 0;
+    inode->dirty       = 0;
+    inode->dir_gen     = 0;
+    inode->ref_cnt     = 0;
+    inode->orphan      = FALSE;
+    pthread_rwlock_init(&inode->lock, NULL);
+    newfs_mark_inode_dirty(inode, NFS_INODE_DIRTY);       /* 新inode需写入inode表 */
+    __atomic_store_n(&super.inode_table[inode->ino], inode, __ATOMIC_RELEASE);
 
     return inode;
 }
 /**
- * @brief 将内存inode及其下方结构全部刷回磁盘
+ * @brief 释放内联内容不再需要的inode槽[span, inline_span)
+ *
+ * @param inode
+ * @param span 保留的槽数，不小于1
+ */
+static void newfs_inline_release(struct newfs_inode* inode, int span) {
+    int k;
+    for (k = span; k < inode->inline_span; k++) {
+        newfs_bitmap_free(&super.ino_map, inode->ino + k);
+    }
+    inode->inline_span = span < inode->inline_span ? span : inode->inline_span;
+}
+/**
+ * @brief 内联内容增长时占用同一inode块中紧随其后的槽，使共span个槽
+ * 先载入原内联内容，之后按新的槽数读记录会读到尚未写入的槽
+ *
+ * @param inode
+ * @param span 由NFS_INLINE_FITS保证不跨inode块
+ * @return int 槽已被占用返回-NFS_ERROR_NOSPACE，此时不改变已占用的槽
+ */
+static int newfs_inline_reserve(struct newfs_inode* inode, int span) {
+    int old = inode->inline_span, k;
+
+    if (inode->inline_data && newfs_page_load(inode, 0, 1) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    for (k = old; k < span; k++) {
+        if (newfs_bitmap_alloc_at(&super.ino_map, inode->ino + k) < 0) {
+            inode->inline_span = k;
+            newfs_inline_release(inode, old);
+            return -NFS_ERROR_NOSPACE;
+        }
+    }
+    inode->inline_span = span;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 将一个inode刷回磁盘：文件与目录写回脏页（目录块经日志），最后写inode本身
+ * 不递归，子项由各自的脏标记驱动
+ * 没有数据块且满足NFS_INLINE_FITS的普通文件，内容随inode记录一起写入，超过NFS_INLINE_SZ()时
+ * 延伸到其后的inode槽；放不下时在这里分配数据块，内联内容作为第0块写出，多占的槽随之释放
  * 
  * @param inode 
  * @return int 
  */
 int newfs_sync_inode(struct newfs_inode * inode) {
     struct newfs_inode_d  inode_d;
-    struct newfs_dentry*  dentry_cursor;
-    struct newfs_dentry_d dentry_d;
-    int offset;
     int blk_cnt;
+    int nblks, old_blks;
+    uint8_t* zero_blk = NULL;
+    int*      wb_blks;
+    uint8_t** wb_pages;
+    int       nr_wb = 0;
+    uint8_t*  inline_page = NULL;
+    uint8_t*  record;
+    int       ret;
+    int       span = NFS_INLINE_SPAN(inode->size), old_span = inode->inline_span;
 
-    // newfs_dump_imap();
-
-    /* 再写inode下方的数据 */  // need change
-    if (NFS_IS_DIR(inode)) { /* 如果当前inode是目录，那么数据是目录项，且目录项的inode也要写回 */                          
-        dentry_cursor = inode->dentrys;
-        blk_cnt = 0;
-        if(inode->block_pointer[blk_cnt] == -1)
-        {
-            newfs_alloc_datab(inode);
-        }
-        offset       = NFS_DATA_OFS(inode->block_pointer[blk_cnt]);
-        int offset_l = offset;
-        int offset_r = offset + NFS_BLK_SZ();
-        int dentry_cnt = 0;
-        // newfs_dump_dmap();
-        while (dentry_cursor != NULL)
-        {
-            if(offset_r <= offset + sizeof(struct newfs_dentry_d)) // switch block
-            {
-                blk_cnt ++;
-                if(inode->block_pointer[blk_cnt] == -1)
-                {
-                    newfs_alloc_datab(inode);
-                }
-                offset = NFS_DATA_OFS(inode->block_pointer[blk_cnt]);
-                int offset_l = offset;
-                int offset_r = offset + NFS_BLK_SZ();
-            }
-            memcpy(dentry_d.fname, dentry_cursor->fname, NFS_MAX_FILE_NAME);
-            dentry_d.ftype = dentry_cursor->ftype;
-            dentry_d.ino = dentry_cursor->ino;
-            if (newfs_driver_write(offset, (uint8_t *)&dentry_d, 
-                                 sizeof(struct newfs_dentry_d)) != NFS_ERROR_NONE) {
-                // NFS_DBG("[%s] io error\n", __func__);
-                return -NFS_ERROR_IO;                     
-            }
-            
-            if (dentry_cursor->inode != NULL) {
-                newfs_sync_inode(dentry_cursor->inode);
+    /* 再写inode下方的数据 */
+    if (NFS_IS_REG(inode) && inode->data_blk_cnt == 0 && NFS_INLINE_FITS(inode->ino, inode->size) &&
+        (span <= old_span || newfs_inline_reserve(inode, span) == NFS_ERROR_NONE)) {
+        if (inode->size > 0 &&                        /* 内容或槽数有变化，或第一次内联（空洞补零） */
+            (!inode->inline_data || span != old_span ||
+             (inode->page_cap > 0 && (inode->page_flags[0] & NFS_PAGE_DIRTY)))) {
+            if (newfs_page_load(inode, 0, 1) != NFS_ERROR_NONE) {
+                return -NFS_ERROR_IO;
             }
-
-            dentry_cursor = dentry_cursor->brother;
-            offset += sizeof(struct newfs_dentry_d);
+            inline_page = inode->pages[0];
         }
+        inode->inline_data = inode->size > 0;
     }
-    else if (NFS_IS_REG(inode)) { /* 如果当前inode是文件，那么数据是文件内容，直接写即可 */
-        for(int blk_cnt = 0; blk_cnt < NFS_DATA_PER_FILE; blk_cnt++)
+    else if (NFS_IS_REG(inode) || NFS_IS_DIR(inode)) { /* 文件内容或目录项记录，只写脏页 */
+        nblks    = (int)(NFS_ROUND_UP(inode->size, NFS_BLK_SZ()) / NFS_BLK_SZ());
+        old_blks = inode->data_blk_cnt;
+        if (inode->inline_data && newfs_page_load(inode, 0, 1) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;                     /* 分配数据块前从inode记录载入内联内容 */
+        }
+        while (inode->data_blk_cnt < nblks) {
+            if (newfs_alloc_datab(inode) < 0) {
+                return -NFS_ERROR_NOSPACE;
+            }
+        }
+        wb_blks  = (int *)malloc((nblks + 1) * sizeof(int));
+        wb_pages = (uint8_t **)malloc((nblks + 1) * sizeof(uint8_t *));
+        if (wb_blks == NULL || wb_pages == NULL) {
+            free(wb_blks);
+            free(wb_pages);
+            return -NFS_ERROR_NOSPACE;
+        }
+        for (blk_cnt = 0; blk_cnt < nblks; blk_cnt++)
         {   
-            if (inode->dirty[blk_cnt] == 0)
-            {
-                continue;
+            uint8_t* page = NULL;
+            if (blk_cnt < inode->page_cap && (inode->page_flags[blk_cnt] & NFS_PAGE_DIRTY)) {
+                page = inode->pages[blk_cnt];
             }
-
-            if (inode->block_pointer[blk_cnt] == -1)
-            {
-                newfs_alloc_datab(inode);
-                // continue;
+            else if (blk_cnt >= old_blks && blk_cnt < inode->page_cap &&
+                     (inode->page_flags[blk_cnt] & NFS_PAGE_VALID)) {
+                page = inode->pages[blk_cnt];         /* 新分配的块：转为数据块的内联内容 */
             }
-            // printf("writing: %d\n", inode->block_pointer[blk_cnt]);
-            if (newfs_driver_write(NFS_DATA_OFS(inode->block_pointer[blk_cnt]), inode->data + blk_cnt * NFS_BLK_SZ(), 
-                             NFS_BLK_SZ()) != NFS_ERROR_NONE) {
-                // NFS_DBG("[%s] io error\n", __func__);
-                return -NFS_ERROR_IO;
+            else if (blk_cnt >= old_blks) {           /* 新分配但从未写过的块（截断扩展的空洞）补零 */
+                if (zero_blk == NULL) {
+                    zero_blk = (uint8_t *)calloc(1, NFS_BLK_SZ());
+                }
+                page = zero_blk;
             }
+            if (page == NULL) {                       /* 未载入或未修改的页无需写回 */
+                continue;
+            }
+            wb_blks[nr_wb]  = NFS_DATA_OFS(newfs_bmap(inode, blk_cnt)) / NFS_BLK_SZ();
+            wb_pages[nr_wb] = page;
+            nr_wb++;
         }   
+        for (blk_cnt = 0; NFS_IS_DIR(inode) && blk_cnt < nr_wb; blk_cnt++) {
+            if (newfs_driver_write_meta(NFS_BLKS_SZ(wb_blks[blk_cnt]), wb_pages[blk_cnt],
+                                        NFS_BLK_SZ()) != NFS_ERROR_NONE) {
+                nr_wb = -1;                           /* 目录块是元数据，经日志写 */
+                break;
+            }
+        }
+        if (nr_wb < 0 || (NFS_IS_REG(inode) && nr_wb > 0 &&
+                          newfs_cache_write_through_vec(wb_blks, wb_pages, nr_wb) 
+                          != NFS_ERROR_NONE)) {       /* 文件脏页一批直接写盘，不经缓存中转 */
+            // NFS_DBG("[%s] io error\n", __func__);
+            free(zero_blk);
+            free(wb_blks);
+            free(wb_pages);
+            return -NFS_ERROR_IO;
+        }
+        for (blk_cnt = 0; blk_cnt < nblks && blk_cnt < inode->page_cap; blk_cnt++) {
+            newfs_page_clean(inode, blk_cnt);
+        }
+        free(zero_blk);
+        free(wb_blks);
+        free(wb_pages);
+        inode->inline_data = FALSE;
+        if (super.page_cnt > NFS_PAGE_CACHE_MAX) {    /* 页缓存过大，释放已写回的页 */
+            newfs_page_release_clean(inode);
+        }
     }
     /* Lastly: 写inode本身 */
     int ino             = inode->ino;
+    memset(&inode_d, 0, sizeof(struct newfs_inode_d));
     inode_d.ino         = ino;
     inode_d.link        = inode->link;
     inode_d.size        = inode->size;
@@ -345,18 +546,79 @@ int newfs_sync_inode(struct newfs_inode * inode) {
     inode_d.dir_cnt     = inode->dir_cnt;
     inode_d.data_blk_cnt = inode->data_blk_cnt;
 
-    for (blk_cnt = 0; blk_cnt < NFS_DATA_PER_FILE; blk_cnt++) {
-        inode_d.block_pointer[blk_cnt] = inode->block_pointer[blk_cnt];
+    if (newfs_extent_sync(inode, &inode_d) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    if (inline_page != NULL) {                        /* 记录末尾补零，不留旧内容 */
+        record = (uint8_t *)calloc(span, NFS_INODE_SZ());
+        if (record == NULL) {
+            return -NFS_ERROR_NOSPACE;
+        }
+        memcpy(record, &inode_d, sizeof(struct newfs_inode_d));
+        memcpy(record + sizeof(struct newfs_inode_d), inline_page, inode->size);
+        ret = newfs_driver_write_meta(NFS_INO_OFS(ino), record, span * NFS_INODE_SZ());
+        free(record);
+        if (ret != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+        newfs_page_clean(inode, 0);
     }
-    if (newfs_driver_write(NFS_INO_OFS(ino), (uint8_t *)&inode_d, 
+    else if (newfs_driver_write_meta(NFS_INO_OFS(ino), (uint8_t *)&inode_d, 
                     sizeof(struct newfs_inode_d)) != NFS_ERROR_NONE) {
         // NFS_DBG("[%s] io error\n", __func__);
         return -NFS_ERROR_IO;
     }
-    // newfs_dump_dmap();
-    // newfs_dump_imap();
+    newfs_inline_release(inode, inode->inline_data ? span : 1);    /* 缩小或转为数据块后多余的槽 */
     return NFS_ERROR_NONE;
 }
+/**
+ * @brief inode是否仍被引用（打开的句柄或内核lookup）；此时删除只将其标记为orphan，
+ * inode与dentry保留到newfs_inode_put使引用数归零
+ * 
+ * @param inode 
+ * @return boolean
+ */
+boolean newfs_inode_opened(struct newfs_inode* inode) {
+    return __atomic_load_n(&inode->ref_cnt, __ATOMIC_ACQUIRE) > 0;
+}
+/**
+ * @brief 增加inode的引用数，调用者至少共享持有super.fs_lock
+ * 
+ * @param inode 
+ * @param n 
+ */
+void newfs_inode_get(struct newfs_inode* inode, int n) {
+    __atomic_add_fetch(&inode->ref_cnt, n, __ATOMIC_ACQ_REL);
+}
+/**
+ * @brief 减少inode的引用数；已删除的inode引用数归零时释放inode、数据块与dentry
+ * 调用者至少共享持有super.fs_lock：orphan只在独占持有时设置，此时已不在目录树中，
+ * 其他操作无法再访问它
+ * 
+ * @param inode 
+ * @param n 
+ */
+void newfs_inode_put(struct newfs_inode* inode, int n) {
+    struct newfs_dentry* dentry;
+    if (__atomic_sub_fetch(&inode->ref_cnt, n, __ATOMIC_ACQ_REL) == 0 && inode->orphan) {
+        dentry = inode->dentry;
+        newfs_drop_inode(inode);
+        free(dentry);
+        newfs_journal_note_op();
+    }
+}
+/**
+ * @brief 按inode号取得已载入的inode
+ * 
+ * @param ino 
+ * @return struct newfs_inode* 未载入或已删除时为NULL
+ */
+struct newfs_inode* newfs_ino_inode(int ino) {
+    if (ino < 0 || ino >= super.ino_max) {
+        return NULL;
+    }
+    return __atomic_load_n(&super.inode_table[ino], __ATOMIC_ACQUIRE);
+}
 /**
  * @brief 删除内存中的一个inode
  * Case 1: Reg File
@@ -389,16 +651,15 @@ int newfs_drop_inode(struct newfs_inode * inode) {
     struct newfs_dentry*  dentry_cursor;
     struct newfs_dentry*  dentry_to_free;
     struct newfs_inode*   inode_cursor;
-
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int ino_cursor  = 0;
-    int data_cursor = 0;
-    boolean is_find = FALSE;
+    boolean               is_opened;
 
     if (inode == super.root_dentry->inode) {
         return NFS_ERROR_INVAL;
     }
+    if (newfs_inode_opened(inode)) {
+        inode->orphan = TRUE;                             /* 仍被打开，最后一次release时再释放 */
+        return NFS_ERROR_NONE;
+    }
 
     if (NFS_IS_DIR(inode)) {
         dentry_cursor = inode->dentrys;
@@ -406,97 +667,83 @@ int newfs_drop_inode(struct newfs_inode * inode) {
         while (dentry_cursor)
         {   
             inode_cursor = dentry_cursor->inode;
+            is_opened = newfs_inode_opened(inode_cursor); /* 仍被打开时dentry随inode保留 */
             newfs_drop_inode(inode_cursor);
             newfs_drop_dentry(inode, dentry_cursor);
             dentry_to_free = dentry_cursor;
             dentry_cursor = dentry_cursor->brother;
-            free(dentry_to_free);
-        }
-
-        for (byte_cursor = 0; byte_cursor < NFS_BLKS_SZ(super.ino_map_blks); 
-            byte_cursor++)                            /* 调整inodemap */
-        {
-            for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-                if (ino_cursor == inode->ino) {
-                     super.ino_map[byte_cursor] &= (uint8_t)(~(0x1 << bit_cursor));
-                     is_find = TRUE;
-                     break;
-                }
-                ino_cursor++;
-            }
-            if (is_find == TRUE) {
-                break;
-            }
-        }
-
-        // Clean the data map for directories
-        for (int blk_cnt = 0; blk_cnt < NFS_DATA_PER_FILE; blk_cnt++) {
-            if (inode->block_pointer[blk_cnt] == -1) {
-                continue;
-            }
-            is_find = FALSE;
-            data_cursor = 0;
-            for (byte_cursor = 0; byte_cursor < NFS_BLKS_SZ(super.data_map_blks); 
-            byte_cursor++)                            /* 调整datamap */
-            {
-                for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-                    if (data_cursor == inode->block_pointer[blk_cnt]) {
-                        super.data_map[byte_cursor] &= (uint8_t)(~(0x1 << bit_cursor));
-                        is_find = TRUE;
-                        break;
-                    }
-                    data_cursor++;
-                }
-                if (is_find == TRUE) {
-                    break;
-                }
+            if (!is_opened) {
+                free(dentry_to_free);
             }
         }
     }
-    else if (NFS_IS_REG(inode) || NFS_IS_SYM_LINK(inode)) {
-        for (byte_cursor = 0; byte_cursor < NFS_BLKS_SZ(super.ino_map_blks); 
-            byte_cursor++)                            /* 调整inodemap */
-        {
-            for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-                if (ino_cursor == inode->ino) {
-                     super.ino_map[byte_cursor] &= (uint8_t)(~(0x1 << bit_cursor));
-                     is_find = TRUE;
-                     break;
-                }
-                ino_cursor++;
-            }
-            if (is_find == TRUE) {
-                break;
-            }
-        }
-        for (int blk_cnt = 0; blk_cnt < 6; blk_cnt++) {
-            if (inode->block_pointer[blk_cnt] == -1) {
-                continue;
-            }
-            is_find = FALSE;
-            data_cursor = 0;
-            for (byte_cursor = 0; byte_cursor < NFS_BLKS_SZ(super.data_map_blks); 
-            byte_cursor++)                            /* 调整datamap */
-            {
-                for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-                    if (data_cursor == inode->block_pointer[blk_cnt]) {
-                        super.data_map[byte_cursor] &= (uint8_t)(~(0x1 << bit_cursor));
-                        is_find = TRUE;
-                        break;
-                    }
-                    data_cursor++;
-                }
-                if (is_find == TRUE) {
-                    break;
-                }
-            }
-        }
-        if (inode->data)
-            free(inode->data);
+    
+    newfs_clear_inode_dirty(inode);                       /* 已删除，无需同步 */
+    __atomic_store_n(&super.inode_table[inode->ino], NULL, __ATOMIC_RELEASE);
+    if (NFS_IS_DIR(inode) || NFS_IS_REG(inode) || NFS_IS_SYM_LINK(inode)) {
+        newfs_inline_release(inode, 1);                   /* 内联内容占用的其余槽 */
+        newfs_bitmap_free(&super.ino_map, inode->ino);    /* 调整inodemap */
+        newfs_extent_free_all(inode);                     /* 调整datamap */
+    }
+    if (NFS_IS_DIR(inode)) {
+        newfs_dir_free(inode);
+    }
+
+    if (NFS_IS_DIR(inode) || NFS_IS_REG(inode) || NFS_IS_SYM_LINK(inode)) {
+        newfs_page_free_all(inode);
+        pthread_rwlock_destroy(&inode->lock);
         free(inode);
     }
     return NFS_ERROR_NONE;
 }
+static int newfs_int_cmp(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+/**
+ * @brief 批量预读目录下子项inode所在的inode块
+ * 一个inode块存放多个inode，相邻的块合并为一次顺序读，之后逐个读取子项inode时直接命中块缓存
+ * 
+ * @param inode 目录inode，dentrys已读出
+ */
+static void newfs_prefetch_inodes(struct newfs_inode* inode) {
+    struct newfs_dentry* dentry_cursor;
+    int* blks;
+    int  cnt = 0, i, run;
+    int  limit = NFS_CACHE_BLKS / 2;                /* 不让预读冲掉整个缓存 */
+
+    if (inode->dir_cnt == 0) {
+        return;
+    }
+    blks = (int*)malloc(inode->dir_cnt * sizeof(int));
+    if (blks == NULL) {
+        return;
+    }
+    for (dentry_cursor = inode->dentrys; dentry_cursor; dentry_cursor = dentry_cursor->brother) {
+        blks[cnt++] = NFS_INO_BLK(dentry_cursor->ino);
+    }
+    qsort(blks, cnt, sizeof(int), newfs_int_cmp);
+    for (i = 0; i < cnt && limit > 0; i += run) {
+        run = 1;
+        while (i + run < cnt && blks[i + run] - blks[i + run - 1] <= 1 && 
+               blks[i + run] - blks[i] < limit) {
+            run++;
+        }
+        newfs_cache_prefetch(blks[i], blks[i + run - 1] - blks[i] + 1);
+        limit -= blks[i + run - 1] - blks[i] + 1;
+    }
+    free(blks);
+}
+/**
+ * @brief 读inode失败时释放已读入的extent与页，不动位图，inode尚未登记到inode_table
+ *
+ * @param inode
+ */
+static void newfs_read_inode_abort(struct newfs_inode* inode) {
+    newfs_page_free_all(inode);
+    free(inode->extents);
+    free(inode->ext_blks);
+    free(inode);
+}
 /**
  * @brief 
  * 
@@ -508,70 +755,72 @@ struct newfs_inode* newfs_read_inode(struct newfs_dentry * dentry, int ino) {
     struct newfs_inode* inode = (struct newfs_inode*)malloc(sizeof(struct newfs_inode));
     struct newfs_inode_d inode_d;
     struct newfs_dentry* sub_dentry;
-    struct newfs_dentry_d dentry_d;
-    int    dir_cnt = 0, i;
+    struct newfs_dentry_d* rec;
+    char   fname[NFS_MAX_FILE_NAME];
+    int    lblk, off;
     /* 从磁盘读索引结点 */
-    if (newfs_driver_read(NFS_INO_OFS(ino), (uint8_t *)&inode_d, 
+    if (inode == NULL || newfs_driver_read(NFS_INO_OFS(ino), (uint8_t *)&inode_d, 
                         sizeof(struct newfs_inode_d)) != NFS_ERROR_NONE) {
         // NFS_DBG("[%s] io error\n", __func__);
+        free(inode);
         return NULL;                    
     }
     inode->dir_cnt = 0;
     inode->ino = inode_d.ino;
     inode->size = inode_d.size;
+    inode->link = inode_d.link;
     inode->data_blk_cnt = inode_d.data_blk_cnt;
     inode->dentry = dentry;
     inode->dentrys = NULL;
-    for (int blk_cnt = 0; blk_cnt < NFS_DATA_PER_FILE; blk_cnt++) {
-        inode->block_pointer[blk_cnt] = inode_d.block_pointer[blk_cnt];
+    inode->pages      = NULL;
+    inode->page_flags = NULL;
+    inode->page_cap   = 0;
+    inode->inline_data = inode_d.ftype == NFS_REG_FILE && inode_d.data_blk_cnt == 0 && inode_d.size > 0;
+    inode->inline_span = inode->inline_data ? NFS_INLINE_SPAN(inode_d.size) : 1;
+    inode->dir_hash    = NULL;
+    inode->dir_hash_sz = 0;
+    inode->dirty       = 0;
+    inode->dir_gen     = 0;
+    inode->ref_cnt     = 0;
+    inode->orphan      = FALSE;
+    if (newfs_extent_load(inode, &inode_d) != NFS_ERROR_NONE) {
+        newfs_read_inode_abort(inode);
+        return NULL;
+    }
+    if (inode->inline_data && !NFS_INLINE_FITS(ino, inode_d.size)) {
+        newfs_read_inode_abort(inode);                /* 损坏的大小，内联内容会越过inode块 */
+        return NULL;
     }
     /* 内存中的inode的数据或子目录项部分也需要读出 */
-    if (NFS_IS_DIR(inode)) {
-        dir_cnt = inode_d.dir_cnt;
-        int blk_cnt = 0;
-        int offset   = NFS_DATA_OFS(inode->block_pointer[blk_cnt]);
-        int offset_l = offset;
-        int offset_r = offset + NFS_BLK_SZ();
-        for (i = 0; i < dir_cnt; i++)
-        {
-            if (offset_r <= offset + sizeof(struct newfs_dentry_d)) // switch block
-            {
-                blk_cnt++;
-                if(inode->block_pointer[blk_cnt] == -1)
-                {
-                    // wasted
-                    return NULL;
-                }
-                offset = NFS_DATA_OFS(inode->block_pointer[blk_cnt]);
-                offset_l = offset;
-                offset_r = offset + NFS_BLK_SZ();
-            }
-            if (newfs_driver_read(offset, (uint8_t *)&dentry_d, 
-                                sizeof(struct newfs_dentry_d)) != NFS_ERROR_NONE) {
-                // NFS_DBG("[%s] io error\n", __func__);
-                return NULL;
-            }
-            sub_dentry = new_dentry(dentry_d.fname, dentry_d.ftype);
-            sub_dentry->parent = inode->dentry;
-            sub_dentry->ino    = dentry_d.ino; 
-            newfs_alloc_dentry(inode, sub_dentry);
-            offset += sizeof(struct newfs_dentry_d);
+    if (NFS_IS_DIR(inode)) {                          /* 目录块一批读入页，之后增删目录项只改页 */
+        if (newfs_page_load(inode, 0, inode->data_blk_cnt) != NFS_ERROR_NONE) {
+            // NFS_DBG("[%s] io error\n", __func__);
+            newfs_read_inode_abort(inode);
+            return NULL;
         }
-    }
-    else if (NFS_IS_REG(inode)) {
-        inode->data = (uint8_t *)malloc(NFS_BLKS_SZ(NFS_DATA_PER_FILE));
-        for (int blk_cnt = 0; blk_cnt < NFS_DATA_PER_FILE; blk_cnt++) {
-            if (inode->block_pointer[blk_cnt] != -1) { // Check if the block is allocated
-                if (newfs_driver_read(NFS_DATA_OFS(inode->block_pointer[blk_cnt]) , 
-                                       inode->data + blk_cnt * NFS_BLK_SZ(), 
-                                       NFS_BLK_SZ()) != NFS_ERROR_NONE) {
-                    // NFS_DBG("[%s] io error\n", __func__);
-                    free(inode->data);
-                    return NULL;                    
+        for (lblk = 0; lblk < inode->data_blk_cnt; lblk++) {
+            for (off = 0; off < NFS_BLK_SZ(); off += rec->rec_len) {
+                rec = (struct newfs_dentry_d *)(inode->pages[lblk] + off);
+                if (!newfs_dir_rec_ok(rec, off)) {      /* 损坏的记录，跳过本块其余部分 */
+                    break;
+                }
+                if (rec->name_len == 0) {
+                    continue;
                 }
+                memcpy(fname, NFS_DENTRY_NAME(rec), rec->name_len);
+                fname[rec->name_len] = '\0';
+                sub_dentry = new_dentry(fname, rec->ftype);
+                sub_dentry->parent = inode->dentry;
+                sub_dentry->ino    = rec->ino; 
+                sub_dentry->d_off  = (int)NFS_BLKS_SZ(lblk) + off;
+                newfs_link_dentry(inode, sub_dentry);
             }
         }
+        newfs_prefetch_inodes(inode);
     }
+    /* 普通文件的数据页在newfs_read/newfs_write触及时才载入 */
+    pthread_rwlock_init(&inode->lock, NULL);
+    __atomic_store_n(&super.inode_table[inode->ino], inode, __ATOMIC_RELEASE);
     return inode;
 }
 /**
@@ -594,6 +843,33 @@ struct newfs_dentry* newfs_get_dentry(struct newfs_inode * inode, int dir) {
     }
     return NULL;
 }
+/**
+ * @brief 按inode填充文件属性，供getattr、fgetattr与readdir使用
+ * 
+ * @param inode 
+ * @param st 
+ */
+void newfs_fill_stat(struct newfs_inode* inode, struct stat* st) {
+    memset(st, 0, sizeof(struct stat));
+    pthread_rwlock_rdlock(&inode->lock);
+    st->st_ino = inode->ino;
+    if (NFS_IS_DIR(inode)) {
+        st->st_mode = S_IFDIR | NFS_DEFAULT_PERM;
+        st->st_size = inode->size;
+    }
+    else if (NFS_IS_REG(inode)) {
+        st->st_mode = S_IFREG | NFS_DEFAULT_PERM;
+        st->st_size = inode->size;
+    }
+    st->st_nlink   = inode->orphan ? 0 : inode->link;
+    st->st_uid     = getuid();
+    st->st_gid     = getgid();
+    st->st_atime   = time(NULL);
+    st->st_mtime   = time(NULL);
+    st->st_blksize = NFS_BLK_SZ();
+    st->st_blocks  = inode->data_blk_cnt;
+    pthread_rwlock_unlock(&inode->lock);
+}
 /**
  * @brief 查找文件或目录
  * path: /qwe/ad  total_lvl = 2,
@@ -616,6 +892,8 @@ struct newfs_dentry* newfs_get_dentry(struct newfs_inode * inode, int dir) {
  *      3) find a's inode     lvl = 2
  *      4) find b's dentry    如果此时找不到了，is_find=FALSE且返回的是a的inode对应的dentry
  * 
+ * 逐级持有目录读锁查找，调用者需至少共享持有super.fs_lock（见newfs_lock.c）
+ * 
  * @param path 
  * @return struct newfs_dentry* 
  */
@@ -625,10 +903,18 @@ struct newfs_dentry* newfs_lookup(const char * path, boolean* is_find, boolean*
     struct newfs_inode*  inode; 
     int   total_lvl = newfs_calc_lvl(path);
     int   lvl = 0;
-    boolean is_hit;
+    boolean is_hit, is_negative;
     char* fname = NULL;
-    char* path_cpy = (char*)malloc(sizeof(path));
+    char* path_cpy;
+    char* save_ptr;
+    *is_find = FALSE;
     *is_root = FALSE;
+
+    if (total_lvl > 0 && (dentry_ret = newfs_dcache_lookup(path, &is_negative)) != NULL) {
+        *is_find = !is_negative;                    /* 路径缓存命中，负项返回所在目录 */
+        return dentry_ret;
+    }
+    path_cpy = (char*)malloc(strlen(path) + 1);
     strcpy(path_cpy, path);
 
     if (total_lvl == 0) {                           /* 根目录 */
@@ -636,15 +922,11 @@ struct newfs_dentry* newfs_lookup(const char * path, boolean* is_find, boolean*
         *is_root = TRUE;
         dentry_ret = super.root_dentry;
     }
-    fname = strtok(path_cpy, "/");       
+    fname = strtok_r(path_cpy, "/", &save_ptr);     /* 多个FUSE线程同时查找，不能用strtok */
     while (fname)
     {   
         lvl++;
-        if (dentry_cursor->inode == NULL) {           /* Cache机制 */
-            newfs_read_inode(dentry_cursor, dentry_cursor->ino);
-        }
-
-        inode = dentry_cursor->inode;
+        inode = newfs_dentry_inode(dentry_cursor);    /* Cache机制，未读入时读入 */
 
         if (NFS_IS_REG(inode) && lvl < total_lvl) {
             // NFS_DBG("[%s] not a dir\n", __func__);
@@ -652,24 +934,21 @@ struct newfs_dentry* newfs_lookup(const char * path, boolean* is_find, boolean*
             break;
         }
         if (NFS_IS_DIR(inode)) {
-            dentry_cursor = inode->dentrys;
-            is_hit        = FALSE;
-
-            while (dentry_cursor)   /* 遍历子目录项 */
-            {
-                if (memcmp(dentry_cursor->fname, fname, strlen(fname)) == 0) {
-                    is_hit = TRUE;
-                    break;
-                }
-                dentry_cursor = dentry_cursor->brother;
-            }
+            pthread_rwlock_rdlock(&inode->lock);
+            dentry_cursor = newfs_dir_find(inode, fname, strlen(fname));  /* 按完整文件名哈希查找 */
+            is_hit        = dentry_cursor != NULL;
             
             if (!is_hit) {
                 *is_find = FALSE;
                 // NFS_DBG("[%s] not found %s\n", __func__, fname);
                 dentry_ret = inode->dentry;
+                if (lvl == total_lvl) {               /* 只缓存最后一级不存在的路径，持有目录读锁时插入 */
+                    newfs_dcache_insert(path, dentry_ret, TRUE);
+                }
+                pthread_rwlock_unlock(&inode->lock);
                 break;
             }
+            pthread_rwlock_unlock(&inode->lock);
 
             if (is_hit && lvl == total_lvl) {
                 *is_find = TRUE;
@@ -677,55 +956,191 @@ struct newfs_dentry* newfs_lookup(const char * path, boolean* is_find, boolean*
                 break;
             }
         }
-        fname = strtok(NULL, "/"); 
+        fname = strtok_r(NULL, "/", &save_ptr); 
     }
 
-    if (dentry_ret->inode == NULL) {
-        dentry_ret->inode = newfs_read_inode(dentry_ret, dentry_ret->ino);
+    if (newfs_dentry_inode(dentry_ret) != NULL && *is_find && !*is_root) {
+        newfs_dcache_insert(path, dentry_ret, FALSE);
     }
+    free(path_cpy);
     
     return dentry_ret;
 }
+/**
+ * @brief 按设备大小与块大小（super.sz_blks）计算格式化布局，结果写入super_d
+ * 块号与块数为int，设备超过INT_MAX块时只使用前INT_MAX块
+ *
+ * 每个块组的数据区由一个data位图块管理（8 * BLK_SZ块），组内inode数按--inode_ratio计算，
+ * 未指定时小于NFS_SMALL_DEV_SZ的设备按NFS_SMALL_INODE_RATIO，其余按NFS_INODE_RATIO；
+ * 放不下一个整组的设备只有一组，按设备大小缩小；末尾不足一组的空间作为数据区较短的最后一组
+ *
+ * @param super_d
+ * @param options inode_size、inode_ratio
+ * @return int
+ */
+static int newfs_calc_layout(struct newfs_super_d* super_d, struct custom_options options) {
+    int64_t total        = NFS_DISK_SZ() / NFS_BLK_SZ();
+    int64_t ratio        = options.inode_ratio ? options.inode_ratio :
+                           NFS_DISK_SZ() < NFS_SMALL_DEV_SZ ? NFS_SMALL_INODE_RATIO : NFS_INODE_RATIO;
+    int64_t limit        = options.inode_ratio ? INT_MAX / 2 : NFS_INODE_MAX;
+    int     sz_inode     = options.inode_size ? options.inode_size : NFS_DEFAULT_INODE_SZ;
+    int     bits_per_blk = NFS_BLK_SZ() * UINT8_BITS;
+    int64_t avail, ipg;
+    int     inode_per_blk, unit, journal_blks, gd_blks, groups, group_blks, overhead;
+    int     ino_map_blks, data_map_blks = 1, inode_blks, dpg = bits_per_blk, last;
+
+    if (sz_inode < (int)sizeof(struct newfs_inode_d) || sz_inode > NFS_BLK_SZ() ||
+        (sz_inode & (sz_inode - 1)) != 0 || ratio <= 0) {
+        return -NFS_ERROR_INVAL;
+    }
+    if (total < NFS_MIN_BLKS) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    total         = total > INT_MAX ? INT_MAX : total;
+    inode_per_blk = NFS_BLK_SZ() / sz_inode;
+    unit          = inode_per_blk > UINT8_BITS ? inode_per_blk : UINT8_BITS; /* 每组inode位图按字节拼接 */
+    journal_blks  = NFS_JOURNAL_BLKS;               /* 描述块放不下更多块号时，多余的日志块无用 */
+    journal_blks  = journal_blks > NFS_JOURNAL_CAP() + 1 ? NFS_JOURNAL_CAP() + 1 : journal_blks;
+    journal_blks  = journal_blks > total / 16 ? (int)(total / 16) : journal_blks;
+    avail         = total - NFS_SUPER_BLKS - journal_blks;
+
+    ipg = NFS_BLKS_SZ(dpg) / ratio;                 /* 整组 */
+    if (ipg * (avail / (dpg + 2) + 1) > limit) {
+        ipg = limit / (avail / (dpg + 2) + 1);
+    }
+    ipg          = ipg > (int64_t)dpg * inode_per_blk ? (int64_t)dpg * inode_per_blk : ipg;
+    ipg          = ipg < unit ? unit : NFS_ROUND_UP(ipg, unit);
+    inode_blks   = (int)(ipg / inode_per_blk);
+    ino_map_blks = (int)((ipg + bits_per_blk - 1) / bits_per_blk);
+    group_blks   = ino_map_blks + data_map_blks + inode_blks + dpg;
+    gd_blks      = (int)(((avail / group_blks + 1) * sizeof(struct newfs_group_d) + NFS_BLK_SZ() - 1)
+                         / NFS_BLK_SZ());
+    avail       -= gd_blks;
+
+    if (avail < group_blks) {                       /* 只有一组，按设备大小缩小 */
+        ipg = NFS_BLKS_SZ(avail) / ratio;
+        ipg = ipg > limit ? limit : ipg;
+        ipg = ipg > avail * inode_per_blk / 2 ? avail * inode_per_blk / 2 : ipg;
+        ipg = ipg < unit ? unit : NFS_ROUND_UP(ipg, unit);
+        inode_blks   = (int)(ipg / inode_per_blk);
+        ino_map_blks = (int)((ipg + bits_per_blk - 1) / bits_per_blk);
+        dpg          = (int)(avail - ino_map_blks - data_map_blks - inode_blks);
+        dpg          = dpg > bits_per_blk ? bits_per_blk : NFS_ROUND_DOWN(dpg, UINT8_BITS);
+        group_blks   = ino_map_blks + data_map_blks + inode_blks + dpg;
+        groups       = 1;
+        last         = dpg;
+    }
+    else {
+        overhead = ino_map_blks + data_map_blks + inode_blks;
+        groups   = (int)(avail / group_blks);
+        last     = (int)(avail % group_blks) - overhead;
+        if (last >= NFS_MIN_BLKS) {                 /* 剩余空间作为数据区较短的最后一组 */
+            groups++;
+        }
+        else {
+            last = dpg;
+        }
+    }
+    if (dpg < 2) {
+        return -NFS_ERROR_NOSPACE;
+    }
+
+    super_d->sz_blks         = NFS_BLK_SZ();
+    super_d->sz_inode        = sz_inode;
+    super_d->gd_offset       = NFS_SUPER_OFS + NFS_BLKS_SZ(NFS_SUPER_BLKS);
+    super_d->gd_blks         = gd_blks;
+    super_d->group_offset    = super_d->gd_offset + NFS_BLKS_SZ(gd_blks);
+    super_d->groups          = groups;
+    super_d->group_blks      = group_blks;
+    super_d->ino_per_group   = (int)ipg;
+    super_d->data_per_group  = dpg;
+    super_d->ino_map_blks    = ino_map_blks;
+    super_d->data_map_blks   = data_map_blks;
+    super_d->ino_blks        = inode_blks;
+    super_d->ino_max         = (int)(groups * ipg);
+    super_d->data_blks       = (groups - 1) * dpg + last;
+    super_d->journal_offset  = super_d->group_offset +
+                               NFS_BLKS_SZ((int64_t)(groups - 1) * group_blks + group_blks - dpg + last);
+    super_d->journal_blks    = journal_blks;
+    super_d->file_max        = NFS_BLKS_SZ(super_d->data_blks);
+    super_d->sz_usage        = 0;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 读入或写回第g组的inode位图与数据位图，内存中各组的位图依次拼接
+ *
+ * @param g
+ * @param write
+ * @return int
+ */
+static int newfs_group_maps(int g, boolean write) {
+    int      ibytes = super.ino_per_group / UINT8_BITS;
+    int      dbits  = super.data_blks - g * super.data_per_group;
+    uint8_t* imap   = super.ino_map.bits + (off_t)g * ibytes;
+    uint8_t* dmap   = super.data_map.bits + (off_t)g * (super.data_per_group / UINT8_BITS);
+    int      dbytes;
+
+    dbits  = dbits < super.data_per_group ? dbits : super.data_per_group;
+    dbytes = (dbits + UINT8_BITS - 1) / UINT8_BITS;
+    if (write) {
+        if (newfs_driver_write_meta(NFS_IMAP_OFS(g), imap, ibytes) != NFS_ERROR_NONE ||
+            newfs_driver_write_meta(NFS_DMAP_OFS(g), dmap, dbytes) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+        return NFS_ERROR_NONE;
+    }
+    newfs_cache_prefetch((int)(NFS_IMAP_OFS(g) / NFS_BLK_SZ()),  /* 组内两个位图相邻，一批读入 */
+                         super.ino_map_blks + super.data_map_blks);
+    if (newfs_driver_read(NFS_IMAP_OFS(g), imap, ibytes) != NFS_ERROR_NONE ||
+        newfs_driver_read(NFS_DMAP_OFS(g), dmap, dbytes) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    return NFS_ERROR_NONE;
+}
 /**
  * @brief 挂载sfs, Layout 如下
  * 
  * Layout
- * | Super | Inode Map | Data |
+ * | Super | Group Desc | Group 0 | Group 1 | ... | Journal |
+ * Group: | Inode Map | Data Map | Inode | Data |
  * 
- * IO_SZ = BLK_SZ
+ * BLK_SZ由格式化时的--block_size决定（默认2 * IO_SZ），记录在super中；
+ * 块组的大小与个数按设备大小计算（见newfs_calc_layout），偏移均为64位；
+ * 新inode放在父目录所在的组，数据块放在inode或上一个extent所在的组，见newfs_alloc_inode
  * 
- * 每个Inode占用一个Blk
+ * Inode区紧凑存放，每个Inode占NFS_INODE_SZ()字节，一个块存放NFS_INODE_PER_BLK()个
  * @param options 
  * @return int 
  */
 int newfs_mount(struct custom_options options){
     int                 ret = NFS_ERROR_NONE;
-    int                 driver_fd;
+    int                 driver_ret;
     struct newfs_super_d  super_d; 
+    struct newfs_super_d  layout_d; 
     struct newfs_dentry*  root_dentry;
     struct newfs_inode*   root_inode;
+    int                 g;
 
-    int                 ino_map_blks;
-    int                 data_map_blks;
-    int                 inode_blks;
-    int                 data_blks;
-    
-    int                 super_blks;
     boolean             is_init = FALSE;
 
     super.is_mounted = FALSE;
+    newfs_lock_init();
+
+    driver_ret = newfs_bdev_open(options);       /* 按--backend打开设备，得到设备大小与IO单位 */
 
-    // driver_fd = open(options.device, O_RDWR);
-    driver_fd = ddriver_open(options.device);
+    if (driver_ret != NFS_ERROR_NONE) {
+        return driver_ret;
+    }
 
-    if (driver_fd < 0) {
-        return driver_fd;
+    super.sz_blks = options.block_size ? options.block_size : 2 * super.sz_io;
+    if (super.sz_blks % super.sz_io != 0 || (super.sz_blks & (super.sz_blks - 1)) != 0 ||
+        super.sz_blks < (int)sizeof(struct newfs_super_d) || super.sz_blks > NFS_MAX_BLK_SZ) {
+        return -NFS_ERROR_INVAL;
     }
 
-    super.fd = driver_fd;
-    ddriver_ioctl(NFS_DRIVER(), IOC_REQ_DEVICE_SIZE,  &super.sz_disk);
-    ddriver_ioctl(NFS_DRIVER(), IOC_REQ_DEVICE_IO_SZ, &super.sz_io);
-    super.sz_blks = 2 * super.sz_io;
+    if (newfs_cache_init(NFS_CACHE_BLKS) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_NOSPACE;
+    }
     
     root_dentry = new_dentry("/", NFS_DIR);     /* 根目录项每次挂载时新建 */
 
@@ -733,62 +1148,105 @@ int newfs_mount(struct custom_options options){
                         sizeof(struct newfs_super_d)) != NFS_ERROR_NONE) {
         return -NFS_ERROR_IO;
     }   
+    if (options.format) {                       /* 重新格式化，旧super与日志作废 */
+        super_d.magic = 0;
+    }
+    if (super_d.magic == NFS_MAGIC_NUM && super_d.sz_blks != super.sz_blks) {
+        if (super_d.sz_blks % super.sz_io != 0 ||   /* 按格式化时的块大小重建缓存 */
+            newfs_cache_destroy() != NFS_ERROR_NONE) {
+            return -NFS_ERROR_INVAL;
+        }
+        super.sz_blks = super_d.sz_blks;
+        if (newfs_cache_init(NFS_CACHE_BLKS) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_NOSPACE;
+        }
+    }
                                                 /* 读取super */
-    if (super_d.magic != NFS_MAGIC_NUM) {     /* 幻数不正确，初始化 */
-                                                /* 估算各部分大小 */
-        super_blks    = NFS_SUPER_BLKS;
-        ino_map_blks  = NFS_MAP_INODE_BLKS;
-        data_map_blks = NFS_MAP_DATA_BLKS;
-        inode_blks    = NFS_INODE_BLKS;
-        data_blks     = NFS_DATA_BLKS; // need calculation
-        // printf("Hello\n");
-
-                                                /* 布局layout */
-        super.ino_max           = inode_blks;
-        super_d.ino_map_offset  = NFS_SUPER_OFS + NFS_BLKS_SZ(super_blks);
-        super_d.ino_map_blks    = ino_map_blks;
-        super_d.data_map_offset = super_d.ino_map_offset + NFS_BLKS_SZ(ino_map_blks);
-        super_d.data_map_blks   = data_map_blks;
-        super_d.ino_offset      = super_d.data_map_offset + NFS_BLKS_SZ(data_map_blks);
-        super_d.ino_blks        = inode_blks;
-        super_d.data_offset     = super_d.ino_offset + NFS_BLKS_SZ(inode_blks);
-        super_d.data_blks       = data_blks;
-        super_d.sz_usage        = 0;
-        // NFS_DBG("inode map blocks: %d\n", ino_map_blks);
+    if (super_d.magic == NFS_MAGIC_NUM) {     /* 日志位置，super损坏时按格式化布局计算 */
+        super.journal_offset = super_d.journal_offset;
+        super.journal_blks   = super_d.journal_blks;
+    }
+    else if (!options.format && newfs_calc_layout(&layout_d, options) == NFS_ERROR_NONE) {
+        super.journal_offset = layout_d.journal_offset;
+        super.journal_blks   = layout_d.journal_blks;
+    }
+    else {
+        super.journal_blks   = 0;
+    }
+    if (newfs_journal_replay() != NFS_ERROR_NONE ||  /* 重放已提交但可能未写回原位的元数据 */
+        newfs_driver_read(NFS_SUPER_OFS, (uint8_t *)(&super_d), 
+                          sizeof(struct newfs_super_d)) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    if (options.format || super_d.magic != NFS_MAGIC_NUM) {   /* 幻数不正确，按设备大小格式化 */
+        ret = newfs_calc_layout(&super_d, options);
+        if (ret != NFS_ERROR_NONE) {
+            return ret;
+        }
+        // NFS_DBG("inode map blocks: %d\n", super_d.ino_map_blks);
         is_init = TRUE;
     }
 
     super.sz_usage        = super_d.sz_usage;
+    super.ino_max         = super_d.ino_max;
+    super.sz_inode        = super_d.sz_inode;
+    super.file_max        = super_d.file_max;
     
-    super.ino_map         = (uint8_t *)malloc(NFS_BLKS_SZ(super_d.ino_map_blks));
-    super.data_map        = (uint8_t *)malloc(NFS_BLKS_SZ(super_d.data_map_blks));
-    
-    super.ino_map_offset  = super_d.ino_map_offset;
+    super.gd_offset       = super_d.gd_offset;
+    super.gd_blks         = super_d.gd_blks;
+    super.group_offset    = super_d.group_offset;
+    super.groups          = super_d.groups;
+    super.group_blks      = super_d.group_blks;
+    super.ino_per_group   = super_d.ino_per_group;
+    super.data_per_group  = super_d.data_per_group;
     super.ino_map_blks    = super_d.ino_map_blks;
-    super.data_map_offset = super_d.data_map_offset;
     super.data_map_blks   = super_d.data_map_blks;
-    super.ino_offset      = super_d.ino_offset;
     super.ino_blks        = super_d.ino_blks;
-    super.data_offset     = super_d.data_offset;
     super.data_blks       = super_d.data_blks;
+    super.journal_offset  = super_d.journal_offset;
+    super.journal_blks    = super_d.journal_blks;
+    super.journal_ops     = 0;
+    super.dirty_pages     = 0;
+    super.page_cnt        = 0;
+    super.dirty_since     = 0;
+    super.dirty_inodes    = NULL;
+    super.inode_table     = (struct newfs_inode **)calloc(super.ino_max, sizeof(struct newfs_inode *));
 
     // newfs_dump_imap();
 
 	printf("\n--------------------------------------------------------------------------------\n\n");
 
-    if (newfs_driver_read(super_d.ino_map_offset, (uint8_t *)(super.ino_map), 
-                        NFS_BLKS_SZ(super_d.ino_map_blks)) != NFS_ERROR_NONE) {
-        return -NFS_ERROR_IO;
-    } // read inode map
-
-    if (newfs_driver_read(super_d.data_map_offset, (uint8_t *)(super.data_map), 
-                         NFS_BLKS_SZ(super_d.data_map_blks)) != NFS_ERROR_NONE) {
-        return -NFS_ERROR_IO;
-    } // read data map
+    super.ino_map.bits    = (uint8_t *)calloc((super.ino_max + UINT64_BITS - 1) / UINT64_BITS,
+                                              sizeof(uint64_t));  /* 按64位字扫描 */
+    super.data_map.bits   = (uint8_t *)calloc((super.data_blks + UINT64_BITS - 1) / UINT64_BITS,
+                                              sizeof(uint64_t));
+    if (super.ino_map.bits == NULL || super.data_map.bits == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    for (g = 0; g < super.groups && !is_init; g++) {  /* 新格式化的位图全空 */
+        if (newfs_group_maps(g, FALSE) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+    }
+    if (newfs_bitmap_init(&super.ino_map, super.ino_max, super.ino_per_group) != NFS_ERROR_NONE ||
+        newfs_bitmap_init(&super.data_map, super.data_blks, super.data_per_group) != NFS_ERROR_NONE) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    if (is_init) {                                    /* 全部块组的位图与描述符都要写出 */
+        memset(super.ino_map.group_dirty, TRUE, super.groups);
+    }
 
     if (is_init) {                                    /* 分配根节点 */
+        super.journal_seq = 0;
+        if (newfs_journal_clean() != NFS_ERROR_NONE) {    /* 清除旧的日志描述块 */
+            return -NFS_ERROR_IO;
+        }
         root_inode = newfs_alloc_inode(root_dentry);
         newfs_sync_inode(root_inode);
+        newfs_clear_inode_dirty(root_inode);          /* 下面重新读出根目录 */
+        super.inode_table[root_inode->ino] = NULL;
+        pthread_rwlock_destroy(&root_inode->lock);
+        free(root_inode);
     }
     
     root_inode            = newfs_read_inode(root_dentry, NFS_ROOT_INO);  /* 读取根目录 */
@@ -801,52 +1259,147 @@ int newfs_mount(struct custom_options options){
     return ret;
 }
 /**
- * @brief 
+ * @brief 按位图中的各组空闲数写出块组描述符
+ *
+ * @return int
+ */
+static int newfs_sync_group_desc() {
+    struct newfs_group_d* gd;
+    int                   g, ret;
+
+    gd = (struct newfs_group_d *)calloc(super.groups, sizeof(struct newfs_group_d));
+    if (gd == NULL) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    for (g = 0; g < super.groups; g++) {
+        gd[g].free_inodes = super.ino_map.group_free[g];
+        gd[g].free_blks   = super.data_map.group_free[g];
+    }
+    ret = newfs_driver_write_meta(super.gd_offset, (uint8_t *)gd,
+                                  super.groups * sizeof(struct newfs_group_d));
+    free(gd);
+    return ret == NFS_ERROR_NONE ? NFS_ERROR_NONE : -NFS_ERROR_IO;
+}
+/**
+ * @brief 将内存中的全部修改写回：刷写super.dirty_inodes中的inode，写super与位图，再经日志提交并写回原位
+ * 代价只与自上次同步以来修改过的对象数有关
  * 
  * @return int 
  */
-int newfs_umount() {
+int newfs_sync_fs() {
     struct newfs_super_d super_d; 
+    struct newfs_inode*  inode;
+    boolean              gd_dirty = FALSE;
+    int                  g;
 
-    if (!super.is_mounted) {
-        return NFS_ERROR_NONE;
+    while (super.dirty_inodes != NULL) {            /* 只刷写修改过的节点 */
+        inode = super.dirty_inodes;
+        if (newfs_sync_inode(inode) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+        newfs_clear_inode_dirty(inode);
     }
-    // newfs_dump_dmap();                           
-
-    newfs_sync_inode(super.root_dentry->inode);     /* 从根节点向下刷写节点 */   
 
+    memset(&super_d, 0, sizeof(struct newfs_super_d));
     super_d.magic           = NFS_MAGIC_NUM;
-    super_d.ino_map_offset  = super.ino_map_offset;
+    super_d.sz_blks         = super.sz_blks;
+    super_d.file_max        = super.file_max;
+    super_d.gd_offset       = super.gd_offset;
+    super_d.gd_blks         = super.gd_blks;
+    super_d.group_offset    = super.group_offset;
+    super_d.groups          = super.groups;
+    super_d.group_blks      = super.group_blks;
+    super_d.ino_per_group   = super.ino_per_group;
+    super_d.data_per_group  = super.data_per_group;
     super_d.ino_map_blks    = super.ino_map_blks;
-    super_d.data_map_offset = super.data_map_offset;
     super_d.data_map_blks   = super.data_map_blks;
-    super_d.ino_offset      = super.ino_offset;
     super_d.ino_blks        = super.ino_blks;
-    super_d.data_offset     = super.data_offset;
     super_d.data_blks       = super.data_blks;
+    super_d.ino_max         = super.ino_max;
     super_d.sz_usage        = super.sz_usage;
+    super_d.sz_inode        = super.sz_inode;
+    super_d.journal_offset  = super.journal_offset;
+    super_d.journal_blks    = super.journal_blks;
 
-    newfs_dump_imap();
-    newfs_dump_dmap(); 
-
-    if (newfs_driver_write(NFS_SUPER_OFS, (uint8_t *)&super_d, 
+    if (newfs_driver_write_meta(NFS_SUPER_OFS, (uint8_t *)&super_d, 
                      sizeof(struct newfs_super_d)) != NFS_ERROR_NONE) {
         return -NFS_ERROR_IO;
     } // write super block
 
-    if (newfs_driver_write(super_d.ino_map_offset, (uint8_t *)(super.ino_map), 
-                         NFS_BLKS_SZ(super_d.ino_map_blks)) != NFS_ERROR_NONE) {
+    for (g = 0; g < super.groups; g++) {            /* 只写回位图有修改的块组 */
+        if (!super.ino_map.group_dirty[g] && !super.data_map.group_dirty[g]) {
+            continue;
+        }
+        if (newfs_group_maps(g, TRUE) != NFS_ERROR_NONE) {
+            return -NFS_ERROR_IO;
+        }
+        super.ino_map.group_dirty[g]  = FALSE;
+        super.data_map.group_dirty[g] = FALSE;
+        gd_dirty = TRUE;
+    }
+
+    if (gd_dirty && newfs_sync_group_desc() != NFS_ERROR_NONE) {
         return -NFS_ERROR_IO;
-    } // write inode map
+    } // write group descriptors
 
-    if (newfs_driver_write(super_d.data_map_offset, (uint8_t *)(super.data_map), 
-                         NFS_BLKS_SZ(super_d.data_map_blks)) != NFS_ERROR_NONE) {
+    if (newfs_cache_flush() != NFS_ERROR_NONE) {    /* 组提交 */
         return -NFS_ERROR_IO;
-    } // write data map
+    }
+    pthread_mutex_lock(&super.dirty_lock);          /* 回写线程不持有fs_lock读这两项 */
+    super.journal_ops = 0;
+    super.dirty_since = 0;
+    pthread_mutex_unlock(&super.dirty_lock);
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 
+ * 
+ * @return int 
+ */
+int newfs_umount() {
+    if (!super.is_mounted) {
+        return NFS_ERROR_NONE;
+    }
+    // newfs_dump_dmap();                           
+
+    if (newfs_sync_fs() != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    }
+    newfs_dcache_destroy();                         /* dentry在重新挂载后失效 */
+
+    newfs_dump_imap();
+    newfs_dump_dmap(); 
+
+    if (newfs_journal_clean() != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    } // 日志已全部写回原位
 
-    free(super.ino_map);
-    free(super.data_map);
-    ddriver_close(NFS_DRIVER());
+    if (newfs_cache_destroy() != NFS_ERROR_NONE) {
+        return -NFS_ERROR_IO;
+    } // flush block cache
+
+    newfs_bitmap_destroy(&super.ino_map);
+    free(super.inode_table);
+    newfs_bitmap_destroy(&super.data_map);
+    super.is_mounted = FALSE;
+    newfs_bdev_close();
+    newfs_lock_destroy();
 
     return NFS_ERROR_NONE;
 }
+/**
+ * @brief 格式化设备（mkfs.newfs）：按options计算布局，写出空的位图、根目录与日志描述块
+ * 旧的super与日志一律作废
+ *
+ * @param options device、backend、dev_size、block_size、inode_ratio、inode_size
+ * @return int
+ */
+int newfs_mkfs(struct custom_options options) {
+    int ret;
+    options.format = TRUE;
+    ret = newfs_mount(options);
+    if (ret != NFS_ERROR_NONE) {
+        return ret;
+    }
+    return newfs_umount();
+}
@@ -0,0 +1,143 @@
+#include "../include/newfs.h"
+
+extern struct newfs_super      super;
+
+/*
+ * 后台回写线程
+ *
+ * 1. 回写即独占持有super.fs_lock调用newfs_sync_fs（一次组提交）
+ * 2. 最早的未回写修改超过flush_age秒，或脏页超过dirty_limit字节时回写
+ * 3. 修改操作释放fs_lock后调用newfs_writeback_balance：累计NFS_JOURNAL_BATCH个操作，
+ *    脏页超过dirty_limit两倍（回写线程跟不上），或脏元数据块占满块缓存时由该操作同步提交，
+ *    保证持续写入时内存有界
+ * 4. 回写线程每秒检查一次，脏页越限时由写者直接唤醒
+ */
+static pthread_t       wb_thread;
+static pthread_mutex_t wb_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wb_cond = PTHREAD_COND_INITIALIZER;
+static boolean         wb_running = FALSE;
+static boolean         wb_stop;
+
+static boolean newfs_writeback_due() {
+    boolean due;
+    pthread_mutex_lock(&super.dirty_lock);
+    due = super.dirty_since != 0 &&
+          (time(NULL) - super.dirty_since >= super.flush_age ||
+           NFS_BLKS_SZ(super.dirty_pages) >= super.dirty_limit);
+    pthread_mutex_unlock(&super.dirty_lock);
+    return due;
+}
+
+static boolean newfs_writeback_pressure() {
+    boolean due;
+    pthread_mutex_lock(&super.dirty_lock);
+    due = (newfs_journal_capacity() > 0 && super.journal_ops >= NFS_JOURNAL_BATCH) ||
+          (super.dirty_limit > 0 && NFS_BLKS_SZ(super.dirty_pages) >= 2 * super.dirty_limit) ||
+          newfs_cache_overflow() > 0;
+    pthread_mutex_unlock(&super.dirty_lock);
+    return due;
+}
+
+static void* newfs_writeback_main(void* arg) {
+    struct timespec deadline;
+    (void)arg;
+    pthread_mutex_lock(&wb_lock);
+    while (!wb_stop)
+    {
+        if (newfs_writeback_due()) {
+            pthread_mutex_unlock(&wb_lock);
+            pthread_rwlock_wrlock(&super.fs_lock);
+            if (newfs_writeback_due()) {
+                newfs_sync_fs();
+            }
+            pthread_rwlock_unlock(&super.fs_lock);
+            pthread_mutex_lock(&wb_lock);
+            if (wb_stop) {
+                break;
+            }
+        }
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        pthread_cond_timedwait(&wb_cond, &wb_lock, &deadline);
+    }
+    pthread_mutex_unlock(&wb_lock);
+    return NULL;
+}
+/**
+ * @brief 启动回写线程，挂载成功后调用
+ *
+ * @param options flush_age与dirty_limit为0时使用默认值
+ * @return int
+ */
+int newfs_writeback_start(struct custom_options options) {
+    super.flush_age   = options.flush_age > 0 ? options.flush_age : NFS_FLUSH_AGE;
+    super.dirty_limit = (options.dirty_limit > 0 ? options.dirty_limit : NFS_DIRTY_LIMIT_KB) * 1024;
+    wb_stop = FALSE;
+    if (pthread_create(&wb_thread, NULL, newfs_writeback_main, NULL) != 0) {
+        return -NFS_ERROR_NOSPACE;
+    }
+    wb_running = TRUE;
+    return NFS_ERROR_NONE;
+}
+/**
+ * @brief 停止回写线程，卸载前调用，不能持有super.fs_lock
+ *
+ */
+void newfs_writeback_stop() {
+    if (!wb_running) {
+        return;
+    }
+    pthread_mutex_lock(&wb_lock);
+    wb_stop = TRUE;
+    pthread_cond_signal(&wb_cond);
+    pthread_mutex_unlock(&wb_lock);
+    pthread_join(wb_thread, NULL);
+    wb_running = FALSE;
+}
+/**
+ * @brief 唤醒回写线程立即检查
+ *
+ */
+void newfs_writeback_kick() {
+    pthread_mutex_lock(&wb_lock);
+    pthread_cond_signal(&wb_cond);
+    pthread_mutex_unlock(&wb_lock);
+}
+/**
+ * @brief 记录脏页数的变化，脏页超过上限时唤醒回写线程
+ *
+ * @param dirty_pages 新增（正）或回写/丢弃（负）的脏页数
+ */
+void newfs_writeback_account(int dirty_pages) {
+    boolean kick = FALSE;
+    pthread_mutex_lock(&super.dirty_lock);
+    super.dirty_pages += dirty_pages;
+    if (dirty_pages > 0) {
+        if (super.dirty_since == 0) {
+            super.dirty_since = time(NULL);
+        }
+        kick = super.dirty_limit > 0 && NFS_BLKS_SZ(super.dirty_pages) >= super.dirty_limit;
+    }
+    pthread_mutex_unlock(&super.dirty_lock);
+    if (kick) {
+        newfs_writeback_kick();
+    }
+}
+/**
+ * @brief 修改操作结束、释放super.fs_lock后调用：操作数达到组提交批量，
+ * 脏页超过上限两倍，或块缓存被脏元数据块撑大时，独占fs_lock同步提交
+ *
+ * @return int
+ */
+int newfs_writeback_balance() {
+    int ret = NFS_ERROR_NONE;
+    if (!newfs_writeback_pressure()) {
+        return NFS_ERROR_NONE;
+    }
+    pthread_rwlock_wrlock(&super.fs_lock);
+    if (newfs_writeback_pressure()) {               /* 可能已被其他线程提交 */
+        ret = newfs_sync_fs();
+    }
+    pthread_rwlock_unlock(&super.fs_lock);
+    return ret;
+}
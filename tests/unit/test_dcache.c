@@ -0,0 +1,127 @@
+/**
+ * @file test_dcache.c
+ * @brief 路径缓存失效测试，不挂载FUSE，按newfs.c中各操作的顺序调用核心接口
+ *
+ * 1. 查找后unlink或rmdir，再次查找应不存在，目录下的路径一并失效
+ * 2. 目录改名后旧路径下的子项不存在，新路径下的子项可找到
+ * 3. 不存在的路径留下负项，创建同名文件后可找到
+ * 4. 删除/ab不影响/abc及其下的缓存项
+ *
+ * 用法: test_dcache --device=img [--backend=file|mmap|mem|uring]
+ */
+#include "test_util.h"
+
+struct custom_options newfs_options;
+struct newfs_super    super;
+
+/* newfs_lookup的结果：路径存在时返回其dentry，否则返回NULL */
+static struct newfs_dentry* lookup(const char* path) {
+    boolean is_find, is_root;
+    struct newfs_dentry* dentry = newfs_lookup(path, &is_find, &is_root);
+    return is_find ? dentry : NULL;
+}
+
+/* 路径是否在缓存中（正项或负项） */
+static boolean cached(const char* path, boolean negative) {
+    boolean is_negative;
+    return newfs_dcache_lookup(path, &is_negative) != NULL && is_negative == negative;
+}
+
+/* 按newfs_mkdir/newfs_mknod的方式创建，失败时计入failed并返回NULL */
+static struct newfs_dentry* create(const char* path, NFS_FILE_TYPE ftype) {
+    boolean is_find, is_root;
+    struct newfs_dentry* parent = newfs_lookup(path, &is_find, &is_root);
+    struct newfs_dentry* dentry = NULL;
+    if (is_find || newfs_do_create(parent, newfs_get_fname(path), ftype, path, &dentry) != NFS_ERROR_NONE) {
+        printf("\033[31mfail: create %s\033[0m\n", path);
+        failed++;
+        return NULL;
+    }
+    return dentry;
+}
+
+/* 按newfs_rmdir的方式删除目录 */
+static int remove_dir(const char* path) {
+    struct newfs_dentry* dentry = lookup(path);
+    if (dentry == NULL) {
+        return -NFS_ERROR_NOTFOUND;
+    }
+    newfs_dcache_invalidate(path, TRUE);
+    return newfs_rmdir_rs(dentry->inode);
+}
+
+static void test_unlink() {
+    struct newfs_dentry* file;
+    if (create("/a", NFS_DIR) == NULL || (file = create("/a/f", NFS_REG_FILE)) == NULL) {
+        return;
+    }
+    CHECK(lookup("/a/f") == file && cached("/a/f", FALSE), "lookup caches the file");
+    newfs_dcache_invalidate("/a/f", FALSE);         /* newfs_unlink */
+    CHECK(newfs_do_unlink(file) == NFS_ERROR_NONE, "unlink");
+    CHECK(lookup("/a/f") == NULL, "unlinked file not found");
+}
+
+static void test_rmdir() {
+    if (create("/b", NFS_DIR) == NULL || create("/b/c", NFS_DIR) == NULL || create("/b/c/f", NFS_REG_FILE) == NULL) {
+        return;
+    }
+    CHECK(lookup("/b/c/f") != NULL && lookup("/b/c") != NULL && cached("/b/c/f", FALSE),
+          "lookup caches the subtree");
+    CHECK(remove_dir("/b") == NFS_ERROR_NONE, "rmdir");
+    CHECK(!cached("/b/c", FALSE) && !cached("/b/c/f", FALSE), "subtree dropped from cache");
+    CHECK(lookup("/b") == NULL && lookup("/b/c") == NULL && lookup("/b/c/f") == NULL,
+          "removed directory and children not found");
+}
+
+static void test_rename() {
+    struct newfs_dentry* dir;
+    struct newfs_dentry* child;
+    if ((dir = create("/r", NFS_DIR)) == NULL || (child = create("/r/x", NFS_REG_FILE)) == NULL) {
+        return;
+    }
+    CHECK(lookup("/r/x") == child && cached("/r/x", FALSE), "old child path cached before rename");
+    CHECK(lookup("/s") == NULL && cached("/s", TRUE), "new path cached as negative");
+    newfs_dcache_invalidate("/r", TRUE);            /* newfs_rename */
+    newfs_dcache_invalidate("/s", FALSE);
+    CHECK(newfs_do_rename(dir, super.root_dentry, "s") == NFS_ERROR_NONE, "rename directory");
+    CHECK(lookup("/r/x") == NULL && lookup("/r") == NULL, "old child path not found after rename");
+    CHECK(lookup("/s") == dir && lookup("/s/x") == child, "new child path found after rename");
+}
+
+static void test_negative() {
+    struct newfs_dentry* file;
+    CHECK(lookup("/n") == NULL && cached("/n", TRUE), "missing path cached as negative");
+    if ((file = create("/n", NFS_REG_FILE)) == NULL) {
+        return;
+    }
+    CHECK(!cached("/n", TRUE), "create drops the negative entry");
+    CHECK(lookup("/n") == file, "created file found after negative probe");
+}
+
+static void test_prefix() {
+    if (create("/ab", NFS_DIR) == NULL || create("/ab/f", NFS_REG_FILE) == NULL ||
+        create("/abc", NFS_DIR) == NULL || create("/abc/f", NFS_REG_FILE) == NULL) {
+        return;
+    }
+    CHECK(lookup("/ab/f") != NULL && lookup("/abc/f") != NULL && lookup("/abc") != NULL, "lookup both prefixes");
+    CHECK(remove_dir("/ab") == NFS_ERROR_NONE, "rmdir /ab");
+    CHECK(cached("/abc", FALSE) && cached("/abc/f", FALSE), "sibling sharing the name prefix stays cached");
+    CHECK(lookup("/ab/f") == NULL && lookup("/abc/f") != NULL, "only the removed directory's paths invalidated");
+}
+
+int main(int argc, char **argv) {
+    newfs_options.dev_size = NFS_BDEV_DEFAULT_KB;
+    test_parse_args(argc, argv, &newfs_options);
+
+    if (newfs_mkfs(newfs_options) != NFS_ERROR_NONE || newfs_mount(newfs_options) != NFS_ERROR_NONE) {
+        CHECK(FALSE, "mkfs and mount");
+        return 1;
+    }
+    test_unlink();
+    test_rmdir();
+    test_rename();
+    test_negative();
+    test_prefix();
+    CHECK(newfs_umount() == NFS_ERROR_NONE, "umount");
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file test_driver_io.c
+ * @brief newfs_driver_read / newfs_driver_write的IO计数测试
+ *
+ * 通过IOC_REQ_DEVICE_STATE检查设备的read_cnt增量：
+ *   整块覆盖的写不应读盘，非对齐写只应读出首尾两块
+ *
+ * 用法: test_driver_io --device=$HOME/ddriver [--backend=ddriver|file|mmap|mem|uring]
+ */
+#include "test_util.h"
+
+struct custom_options newfs_options;
+struct newfs_super    super;
+
+static int read_cnt() {
+    struct ddriver_state state;
+    newfs_bdev_ioctl(IOC_REQ_DEVICE_STATE, &state);
+    return state.read_cnt;
+}
+
+/* 清空块缓存，保证之后的访问都未命中 */
+static void drop_cache() {
+    newfs_cache_destroy();
+    newfs_cache_init(NFS_CACHE_BLKS);
+}
+
+int main(int argc, char **argv) {
+    int      i, before;
+    int      io_per_blk;
+    int      base;
+    uint8_t* wbuf;
+    uint8_t* rbuf;
+
+    newfs_options.dev_size = NFS_BDEV_DEFAULT_KB;   /* 镜像文件不存在时创建 */
+    test_parse_args(argc, argv, &newfs_options);
+
+    if (newfs_mount(newfs_options) != NFS_ERROR_NONE) {
+        printf("\033[31mfail: mount %s\033[0m\n", newfs_options.device);
+        return 1;
+    }
+    io_per_blk = NFS_BLK_SZ() / NFS_IO_SZ();
+    base       = NFS_DATA_OFS(super.data_blks - 8);   /* 数据区末尾的空闲块 */
+    wbuf       = (uint8_t *)malloc(NFS_BLKS_SZ(4));
+    rbuf       = (uint8_t *)malloc(NFS_BLKS_SZ(4));
+    for (i = 0; i < NFS_BLKS_SZ(4); i++) {
+        wbuf[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    drop_cache();
+    before = read_cnt();
+    newfs_driver_write(base, wbuf, NFS_BLK_SZ());
+    CHECK(read_cnt() - before == 0, "aligned single-block write issues no read");
+
+    drop_cache();
+    before = read_cnt();
+    newfs_driver_write(base, wbuf, NFS_BLKS_SZ(4));
+    CHECK(read_cnt() - before == 0, "aligned multi-block write issues no read");
+
+    drop_cache();
+    before = read_cnt();
+    newfs_driver_write(base + 10, wbuf, 100);
+    CHECK(read_cnt() - before == io_per_blk, "sub-block write reads only its block");
+
+    drop_cache();
+    before = read_cnt();
+    newfs_driver_write(base + 10, wbuf, NFS_BLKS_SZ(3));
+    CHECK(read_cnt() - before == 2 * io_per_blk, "unaligned write reads only head and tail");
+
+    drop_cache();
+    before = read_cnt();
+    newfs_driver_write(base, wbuf, NFS_BLKS_SZ(3) + 1);
+    CHECK(read_cnt() - before == io_per_blk, "aligned head, partial tail reads only tail");
+
+    drop_cache();
+    newfs_driver_read(base, rbuf, NFS_BLKS_SZ(4));
+    CHECK(memcmp(rbuf, wbuf, NFS_BLKS_SZ(3) + 1) == 0, "written data survives flush");
+
+    newfs_umount();
+    free(wbuf);
+    free(rbuf);
+    return failed == 0 ? 0 : 1;
+}
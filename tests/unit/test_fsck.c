@@ -0,0 +1,321 @@
+/**
+ * @file test_fsck.c
+ * @brief mkfs与fsck测试
+ *
+ * 每个用例在多个块组的镜像上重新格式化，卸载后fsck应无不一致，重新挂载后内容不变：
+ * 1. 块组：顶层目录分散到其他组，文件与数据块放在父目录的组，碎片文件使用溢出extent块
+ * 2. 内联：小文件内联在inode记录中（默认inode大小下约500字节的文件占用随后的inode槽），
+ *    增长后转为数据块
+ * 3. 目录项：变长目录项紧凑存放、删除后空间被复用，过长的文件名被拒绝；
+ *    目录块中文件名长度损坏时fsck报告，挂载后跳过该记录
+ * 4. 位图：直接改写设备上的位图，fsck应分别报告不可达块、未登记的块与无效inode
+ *
+ * 用法: test_fsck --device=<镜像文件> [--backend=file|mmap|uring]
+ */
+#include "test_util.h"
+
+struct custom_options newfs_options;
+struct newfs_super    super;
+
+/* 重新挂载后读出path的前size字节，与expect比较 */
+static boolean read_back(const char* path, const uint8_t* expect, int size) {
+    boolean is_find, is_root, same = FALSE;
+    char*   out = (char *)malloc(size);
+    struct newfs_dentry* dentry;
+    if (newfs_mount(newfs_options) != NFS_ERROR_NONE) {
+        free(out);
+        return FALSE;
+    }
+    dentry = newfs_lookup(path, &is_find, &is_root);
+    if (is_find && newfs_do_read(newfs_dentry_inode(dentry), out, size, 0) == size) {
+        same = memcmp(out, expect, size) == 0;
+    }
+    newfs_umount();
+    free(out);
+    return same;
+}
+
+/* 重新挂载后查找path是否存在 */
+static boolean exists(const char* path) {
+    boolean is_find = FALSE, is_root;
+    if (newfs_mount(newfs_options) != NFS_ERROR_NONE) {
+        return FALSE;
+    }
+    newfs_lookup(path, &is_find, &is_root);
+    newfs_umount();
+    return is_find;
+}
+
+/* 绕过文件系统翻转设备上位图的一位，bit为组内位号 */
+static void flip_bit(off_t map_offset, int bit) {
+    uint8_t* blk    = (uint8_t *)malloc(NFS_BLK_SZ());
+    off_t    offset = map_offset + NFS_BLKS_SZ(bit / UINT8_BITS / NFS_BLK_SZ());
+    newfs_bdev_open(newfs_options);
+    newfs_bdev_read(offset, blk, NFS_BLK_SZ());
+    blk[bit / UINT8_BITS % NFS_BLK_SZ()] ^= (uint8_t)(1 << (bit % UINT8_BITS));
+    newfs_bdev_write(offset, blk, NFS_BLK_SZ());
+    newfs_bdev_close();
+    free(blk);
+}
+
+static struct newfs_fsck_report check() {
+    struct newfs_fsck_report report;
+    if (newfs_fsck(newfs_options, &report) != NFS_ERROR_NONE) {
+        report.errors = -1;
+    }
+    return report;
+}
+
+/* 格式化并挂载，失败时计入failed */
+static boolean setup() {
+    if (newfs_mkfs(newfs_options) != NFS_ERROR_NONE || newfs_mount(newfs_options) != NFS_ERROR_NONE) {
+        CHECK(FALSE, "mkfs and mount");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* 在parent下创建name，失败时计入failed并返回NULL */
+static struct newfs_dentry* create(struct newfs_dentry* parent, const char* name, NFS_FILE_TYPE ftype) {
+    struct newfs_dentry* dentry = NULL;
+    if (newfs_do_create(parent, name, ftype, NULL, &dentry) != NFS_ERROR_NONE) {
+        printf("\033[31mfail: create %s\033[0m\n", name);
+        failed++;
+        return NULL;
+    }
+    return dentry;
+}
+
+/* 写入size字节，未写满时计入failed */
+static boolean write_all(struct newfs_dentry* dentry, const void* buf, int size, off_t offset) {
+    if (newfs_do_write(dentry->inode, (const char *)buf, size, offset) != size) {
+        printf("\033[31mfail: write %s\033[0m\n", dentry->fname);
+        failed++;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void test_fresh() {
+    struct newfs_fsck_report report;
+    CHECK(newfs_mkfs(newfs_options) == NFS_ERROR_NONE, "mkfs");
+    report = check();
+    CHECK(report.errors == 0 && report.inodes == 1 && report.dirs == 1, "fresh fs is consistent");
+}
+
+static void test_groups() {
+    int      i, round;
+    char     name[16];
+    char*    buf;
+    boolean  ok = TRUE;
+    struct newfs_dentry*     dir;
+    struct newfs_dentry*     files[8];
+    struct newfs_fsck_report report;
+
+    if (!setup()) {
+        return;
+    }
+    if ((dir = create(super.root_dentry, "d", NFS_DIR)) == NULL) {
+        newfs_umount();
+        return;
+    }
+    CHECK(super.groups > 1 && NFS_INO_GROUP(dir->inode->ino) != NFS_ROOT_INO / super.ino_per_group,
+          "top-level directory spread to another group");
+    for (i = 0; i < 8 && ok; i++) {
+        sprintf(name, "f%d", i);
+        ok = (files[i] = create(dir, name, NFS_REG_FILE)) != NULL;
+    }
+    buf = (char *)calloc(1, NFS_BLK_SZ());
+    for (round = 0; round < 3 * NFS_INLINE_EXTENTS && ok; round++) {    /* 交替追加，extent放不下inode */
+        for (i = 0; i < 2 && ok; i++) {
+            memset(buf, 'a' + round, NFS_BLK_SZ());
+            ok = write_all(files[i], buf, NFS_BLK_SZ(), (off_t)round * NFS_BLK_SZ()) &&
+                 newfs_sync_inode(files[i]->inode) == NFS_ERROR_NONE;
+        }
+    }
+    for (i = 2; i < 8 && ok; i++) {
+        ok = write_all(files[i], buf, i * 100, 0);
+    }
+    free(buf);
+    if (!ok) {
+        newfs_umount();
+        return;
+    }
+    CHECK(files[0]->inode->ext_blk_cnt > 0, "fragmented file uses an overflow extent block");
+    newfs_sync_inode(files[7]->inode);              /* 回写时才分配数据块 */
+    CHECK(NFS_INO_GROUP(files[7]->inode->ino) == NFS_INO_GROUP(dir->inode->ino) &&
+          NFS_DATA_GROUP(files[7]->inode->extents[0].start) == NFS_INO_GROUP(dir->inode->ino),
+          "files and their data are placed in the parent directory's group");
+    CHECK(newfs_umount() == NFS_ERROR_NONE, "umount");
+
+    report = check();
+    CHECK(report.errors == 0 && report.inodes == 10 && report.dirs == 2, "grouped fs is consistent");
+}
+
+static void test_inline() {
+    int      i;
+    uint8_t* pattern;
+    struct newfs_dentry*     dir;
+    struct newfs_dentry*     tiny;
+    struct newfs_dentry*     grow;
+    struct newfs_dentry*     small;
+    struct newfs_fsck_report report;
+
+    if (!setup()) {
+        return;
+    }
+    if ((dir = create(super.root_dentry, "d", NFS_DIR)) == NULL || (tiny = create(dir, "tiny", NFS_REG_FILE)) == NULL ||
+        (grow = create(dir, "grow", NFS_REG_FILE)) == NULL || (small = create(dir, "small", NFS_REG_FILE)) == NULL) {
+        newfs_umount();
+        return;
+    }
+    pattern = (uint8_t *)malloc(NFS_BLK_SZ() + 100);
+    for (i = 0; i < NFS_BLK_SZ() + 100; i++) {
+        pattern[i] = (uint8_t)(i * 13 + 7);
+    }
+    if (!write_all(tiny, pattern, NFS_INLINE_SZ(), 0) || !write_all(grow, pattern, 10, 0) ||
+        !write_all(small, pattern, 500, 0)) {
+        free(pattern);
+        newfs_umount();
+        return;
+    }
+    newfs_sync_inode(tiny->inode);
+    newfs_sync_inode(grow->inode);
+    newfs_sync_inode(small->inode);
+    CHECK(tiny->inode->data_blk_cnt == 0 && tiny->inode->inline_data && grow->inode->inline_data,
+          "tiny files stored inline without data blocks");
+    CHECK(small->inode->data_blk_cnt == 0 && small->inode->inline_data && small->inode->inline_span > 1,
+          "500-byte file stored inline in the following inode slots");
+    newfs_page_release_clean(grow->inode);          /* 增长时从inode记录重新载入内联内容 */
+    if (write_all(grow, pattern + 10, NFS_BLK_SZ() + 90, 10)) {
+        newfs_sync_inode(grow->inode);
+        CHECK(grow->inode->data_blk_cnt == 2 && !grow->inode->inline_data,
+              "inline file promoted to data blocks when it grows");
+    }
+    CHECK(newfs_umount() == NFS_ERROR_NONE, "umount");
+
+    report = check();
+    CHECK(report.errors == 0 && report.inodes == 5 && report.dirs == 2, "inline fs is consistent");
+    CHECK(read_back("/d/tiny", pattern, NFS_INLINE_SZ()), "inline content survives remount");
+    CHECK(read_back("/d/small", pattern, 500), "multi-slot inline content survives remount");
+    CHECK(read_back("/d/grow", pattern, NFS_BLK_SZ() + 100), "promoted content survives remount");
+    free(pattern);
+}
+
+static void test_dirents() {
+    int      i, per_blk, nblks, many_blk;
+    char     name[NFS_MAX_FILE_NAME + 1], path[NFS_MAX_FILE_NAME + 2];
+    uint8_t* blk;
+    struct newfs_dentry*     many;
+    struct newfs_dentry*     longest;
+    struct newfs_dentry*     entries[200];
+    struct newfs_fsck_report report;
+
+    if (!setup()) {
+        return;
+    }
+    if ((many = create(super.root_dentry, "many", NFS_DIR)) == NULL) {
+        newfs_umount();
+        return;
+    }
+    for (i = 0; i < 200; i++) {
+        sprintf(name, "file-%03d", i);
+        if ((entries[i] = create(many, name, NFS_REG_FILE)) == NULL) {
+            newfs_umount();
+            return;
+        }
+    }
+    newfs_sync_inode(many->inode);
+    per_blk = NFS_BLK_SZ() / NFS_DENTRY_REC_LEN(8);
+    nblks   = many->inode->data_blk_cnt;
+    CHECK(nblks == (200 + per_blk - 1) / per_blk && many->inode->size == NFS_BLKS_SZ(nblks),
+          "directory entries packed by name length");
+    for (i = 0; i < 200; i += 4) {                  /* 每4项删1项，空出的记录分散在各块 */
+        newfs_do_unlink(entries[i]);
+    }
+    for (i = 0; i < 200; i += 4) {
+        sprintf(name, "item-%03d", i);
+        if ((entries[i] = create(many, name, NFS_REG_FILE)) == NULL) {
+            newfs_umount();
+            return;
+        }
+    }
+    newfs_sync_inode(many->inode);
+    CHECK(many->inode->data_blk_cnt == nblks && many->inode->dir_cnt == 200,
+          "freed directory records reused without growing");
+    many_blk = many->inode->extents[0].start;
+
+    memset(name, 'n', NFS_MAX_FILE_NAME);
+    name[NFS_MAX_FILE_NAME] = '\0';
+    CHECK(newfs_do_create(super.root_dentry, name, NFS_REG_FILE, NULL, &longest) == -NFS_ERROR_NAMETOOLONG &&
+          newfs_do_rename(entries[1], super.root_dentry, name) == -NFS_ERROR_NAMETOOLONG,
+          "over-long names rejected");
+    name[NFS_MAX_FILE_NAME - 1] = '\0';
+    CHECK(newfs_do_create(super.root_dentry, name, NFS_REG_FILE, NULL, &longest) == NFS_ERROR_NONE,
+          "longest allowed name accepted");
+    CHECK(newfs_umount() == NFS_ERROR_NONE, "umount");
+
+    report = check();
+    CHECK(report.errors == 0 && report.inodes == 203 && report.dirs == 2, "directory fs is consistent");
+    CHECK(exists("/many/item-100") && exists("/many/file-101") && !exists("/many/file-100"),
+          "directory entries survive remount");
+    path[0] = '/';
+    memcpy(path + 1, name, NFS_MAX_FILE_NAME);
+    CHECK(exists(path), "longest name survives remount");
+
+    blk = (uint8_t *)malloc(NFS_BLK_SZ());          /* /many首块的第一条记录：名字长度超过上限 */
+    newfs_bdev_open(newfs_options);
+    newfs_bdev_read(NFS_DATA_OFS(many_blk), blk, NFS_BLK_SZ());
+    ((struct newfs_dentry_d *)blk)->name_len = 200;
+    newfs_bdev_write(NFS_DATA_OFS(many_blk), blk, NFS_BLK_SZ());
+    newfs_bdev_close();
+    free(blk);
+    CHECK(check().errors > 0, "corrupt directory record detected");
+    CHECK(!exists("/many/item-000") && exists("/many/file-199"), "corrupt directory record skipped on mount");
+}
+
+static void test_bitmaps() {
+    int      last;
+    char     buf[100] = { 0 };
+    struct newfs_dentry*     dir;
+    struct newfs_dentry*     file;
+
+    if (!setup()) {
+        return;
+    }
+    if ((dir = create(super.root_dentry, "d", NFS_DIR)) == NULL || (file = create(dir, "f", NFS_REG_FILE)) == NULL ||
+        !write_all(file, buf, sizeof(buf), 0)) {
+        newfs_umount();
+        return;
+    }
+    CHECK(newfs_umount() == NFS_ERROR_NONE, "umount");
+    CHECK(check().errors == 0, "populated fs is consistent");
+
+    last = super.groups - 1;                        /* 每处位图不一致同时使块组描述符的空闲数不符 */
+    flip_bit(NFS_DMAP_OFS(0), 0);                   /* 根目录的数据块在位图中丢失 */
+    CHECK(check().errors == 2, "block in use but free in bitmap detected");
+    flip_bit(NFS_DMAP_OFS(0), 0);
+
+    flip_bit(NFS_DMAP_OFS(last), (super.data_blks - 1) % super.data_per_group);
+    CHECK(check().errors == 2, "leaked block detected");
+    flip_bit(NFS_DMAP_OFS(last), (super.data_blks - 1) % super.data_per_group);
+
+    flip_bit(NFS_IMAP_OFS(last), super.ino_per_group - 1);
+    CHECK(check().errors == 2, "allocated inode with invalid record detected");
+    flip_bit(NFS_IMAP_OFS(last), super.ino_per_group - 1);
+
+    CHECK(check().errors == 0, "consistent again after restoring bitmaps");
+}
+
+int main(int argc, char **argv) {
+    newfs_options.fsck_threads = 4;
+    newfs_options.dev_size     = 32 * 1024;         /* KB，至少两个块组 */
+    test_parse_args(argc, argv, &newfs_options);
+
+    test_fresh();
+    test_groups();
+    test_inline();
+    test_dirents();
+    test_bitmaps();
+    return failed == 0 ? 0 : 1;
+}
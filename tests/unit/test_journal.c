@@ -0,0 +1,94 @@
+/**
+ * @file test_journal.c
+ * @brief 元数据日志的提交与重放测试
+ *
+ * 提交后不正常卸载（模拟崩溃），并破坏原位的位图块，
+ * 重新挂载时应从日志重放出已提交的元数据；
+ * 脏元数据块超过缓存容量时不被淘汰、不提前提交，sync时分批提交
+ *
+ * 用法: test_journal --device=$HOME/ddriver [--backend=ddriver|file|mmap|uring]
+ */
+#include "test_util.h"
+
+struct custom_options newfs_options;
+struct newfs_super    super;
+
+/* 不写回、不清理日志，直接关闭设备 */
+static void crash() {
+    newfs_dcache_destroy();
+    newfs_bdev_close();
+    super.is_mounted = FALSE;
+}
+
+/* 绕过文件系统直接改写设备上的一个块 */
+static void smash_blk(int blk) {
+    char* garbage = (char *)calloc(1, NFS_BLK_SZ());
+    newfs_bdev_open(newfs_options);
+    newfs_bdev_write(NFS_BLKS_SZ((off_t)blk), (uint8_t *)garbage, NFS_BLK_SZ());
+    newfs_bdev_close();
+    free(garbage);
+}
+
+static struct newfs_journal_d read_desc() {
+    struct newfs_journal_d desc;
+    uint8_t* blk = (uint8_t *)malloc(NFS_BLK_SZ());
+    newfs_dev_read(super.journal_offset / NFS_BLK_SZ(), blk, 1);
+    memcpy(&desc, blk, sizeof(desc));
+    free(blk);
+    return desc;
+}
+
+int main(int argc, char **argv) {
+    int      i, ino;
+    uint32_t seq;
+    uint8_t* blk;
+    boolean  is_find, is_root;
+    struct newfs_dentry* dentry;
+
+    newfs_options.dev_size = NFS_BDEV_DEFAULT_KB;   /* 镜像文件不存在时创建 */
+    test_parse_args(argc, argv, &newfs_options);
+
+    if (newfs_mount(newfs_options) != NFS_ERROR_NONE) {
+        printf("\033[31mfail: mount %s\033[0m\n", newfs_options.device);
+        return 1;
+    }
+    CHECK(newfs_journal_capacity() > 0, "journal region present");
+
+    dentry = new_dentry("journal_test", NFS_REG_FILE);
+    dentry->parent = super.root_dentry;
+    newfs_alloc_inode(dentry);
+    newfs_alloc_dentry(super.root_dentry->inode, dentry);
+    ino = dentry->ino;
+    CHECK(newfs_sync_fs() == NFS_ERROR_NONE, "commit");
+    CHECK(read_desc().cnt > 0, "committed transaction recorded in descriptor");
+    crash();
+
+    smash_blk(NFS_IMAP_OFS(0) / NFS_BLK_SZ());      /* 模拟检查点写到一半：原位inode位图被破坏 */
+
+    if (newfs_mount(newfs_options) != NFS_ERROR_NONE) {
+        printf("\033[31mfail: remount\033[0m\n");
+        return 1;
+    }
+    CHECK(newfs_bitmap_test(&super.ino_map, ino), "inode map replayed from journal");
+    dentry = newfs_lookup("/journal_test", &is_find, &is_root);
+    CHECK(is_find && dentry->ino == ino, "committed create survives crash");
+    CHECK(read_desc().cnt == 0, "descriptor cleaned after replay");
+
+    seq = super.journal_seq;                        /* 原样重写数据区末尾的块，多于缓存容量 */
+    blk = (uint8_t *)malloc(NFS_BLK_SZ());
+    for (i = super.data_blks - NFS_CACHE_BLKS - 64; i < super.data_blks; i++) {
+        newfs_driver_read(NFS_DATA_OFS(i), blk, NFS_BLK_SZ());
+        newfs_driver_write_meta(NFS_DATA_OFS(i), blk, NFS_BLK_SZ());
+    }
+    free(blk);
+    CHECK(newfs_cache_overflow() > 0 && super.journal_seq == seq,
+          "dirty metadata stays cached without an early commit");
+    CHECK(newfs_sync_fs() == NFS_ERROR_NONE && newfs_cache_overflow() == 0 &&
+          super.journal_seq > seq + 1, "oversized flush committed in batches");
+
+    newfs_drop_inode(dentry->inode);
+    newfs_drop_dentry(super.root_dentry->inode, dentry);
+    free(dentry);
+    newfs_umount();
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+#ifndef _TEST_UTIL_H_
+#define _TEST_UTIL_H_
+/**
+ * @file test_util.h
+ * @brief 单元测试共用的检查宏与参数解析
+ *
+ * 每个测试程序包含一次；CHECK失败时计入failed，main以failed决定退出码
+ */
+#include "newfs.h"
+
+static int failed = 0;
+
+#define CHECK(cond, msg)                                                 \
+    do {                                                                 \
+        if (cond) {                                                      \
+            printf("\033[32mpass: %s\033[0m\n", msg);                    \
+        } else {                                                         \
+            printf("\033[31mfail: %s (%s:%d)\033[0m\n", msg,             \
+                   __FILE__, __LINE__);                                  \
+            failed++;                                                    \
+        }                                                                \
+    } while (0)
+
+/**
+ * @brief 解析--device=与--backend=，其余参数忽略
+ *
+ * @param argc
+ * @param argv
+ * @param options device未给出时为空串
+ */
+static inline void test_parse_args(int argc, char** argv, struct custom_options* options) {
+    int i;
+    options->device = "";
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--device=", 9) == 0) {
+            options->device = argv[i] + 9;
+        }
+        else if (strncmp(argv[i], "--backend=", 10) == 0) {
+            options->backend = argv[i] + 10;
+        }
+    }
+}
+
+#endif /* _TEST_UTIL_H_ */
@@ -0,0 +1,49 @@
+/**
+ * @file mkfs_newfs.c
+ * @brief mkfs.newfs：按设备大小格式化newfs，布局计算与挂载时的自动格式化相同
+ *
+ * 用法: mkfs.newfs --device=<镜像或设备> [--backend=ddriver|file|mmap|uring] [--dev_size=KB]
+ *                  [--block_size=字节] [--inode_ratio=字节] [--inode_size=字节]
+ */
+#include "newfs.h"
+
+#define OPTION(t, p)        { t, offsetof(struct custom_options, p), 1 }
+
+static const struct fuse_opt option_spec[] = {
+	OPTION("--device=%s", device),
+	OPTION("--backend=%s", backend),
+	OPTION("--dev_size=%d", dev_size),
+	OPTION("--block_size=%d", block_size),
+	OPTION("--inode_ratio=%d", inode_ratio),
+	OPTION("--inode_size=%d", inode_size),
+	FUSE_OPT_END
+};
+
+struct custom_options newfs_options;
+struct newfs_super    super;
+
+int main(int argc, char **argv)
+{
+	int ret;
+	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+
+	if (fuse_opt_parse(&args, &newfs_options, option_spec, NULL) == -1)
+		return 1;
+	if (newfs_options.device == NULL || args.argc > 1) {
+		fprintf(stderr, "用法: %s --device=<镜像或设备> [--backend=...] [--dev_size=KB] "
+				"[--block_size=字节] [--inode_ratio=字节] [--inode_size=字节]\n", argv[0]);
+		fuse_opt_free_args(&args);
+		return 1;
+	}
+
+	ret = newfs_mkfs(newfs_options);
+	fuse_opt_free_args(&args);
+	if (ret != NFS_ERROR_NONE) {
+		fprintf(stderr, "mkfs.newfs: %s: %s\n", newfs_options.device, strerror(-ret));
+		return 1;
+	}
+	printf("%s: %lld字节，块大小%d，%d个块组，%d个inode，%d个数据块，日志%d块\n", newfs_options.device,
+		   (long long)super.sz_disk, super.sz_blks, super.groups, super.ino_max, super.data_blks,
+		   super.journal_blks);
+	return 0;
+}